@@ -2,6 +2,7 @@ import GeoMath from "./GeoMath";
 import Mesh from "./Mesh";
 import MeshBuffer from "./MeshBuffer";
 import Texture from "./Texture";
+import B3dNative from "./B3dNative";
 
 
 /**
@@ -76,6 +77,11 @@ class B3dBinary {
     /**
      * @summary B3dBinary インスタンスを生成
      *
+     * @desc
+     * <p>buffer の VECDATA 部は {@link mapray.B3dNative#addBinary} により wasm の
+     *    メモリーに 1 回複製される。buffer 自体は B3dProvider から受け取ったもの
+     *    なので、受信中のデータを wasm のメモリーに直接書き込むことはしない。</p>
+     *
      * @param {mapray.GLEnv}      glenv  WebGL 環境
      * @param {mapray.B3dNative} native  シーンの B3dNative インスタンス
      * @param {ArrayBuffer}      buffer  タイルのバイナリーデータ
@@ -264,73 +270,231 @@ class B3dBinary {
         let mesh = null;
 
         this._native.clip( this._handle, origin, size, (num_vertices, num_triangles, buffer, byte_offset) => {
+            mesh = this._createClipMesh( num_vertices, num_triangles, buffer, byte_offset );
+        } );
 
-            if ( num_triangles == 0 ) {
-                // 幾何が存在しない
-                return;
-            }
+        return mesh;
+    }
 
-            // NUM_VERTICES の値が 2^16 より大きいとき UINT32 型、それ以外のとき UINT16 型
-            const triArrayType = (num_vertices > 65536) ? Uint32Array : Uint16Array;
 
-            let pointer = byte_offset;
+    /**
+     * @summary 切り取ったメッシュを少しずつ生成
+     *
+     * @desc
+     *
+     * <p>clip() と同じメッシュを、複数回に分けて生成するためのジョブを返す。</p>
+     *
+     * <p>ジョブの step() を処理が完了するまで (またはフレームの時間の範囲で) 呼び出し、
+     *    finish() でメッシュを取得する。取得しないときは cancel() を呼び出す。
+     *    ジョブが完了するまで、このオブジェクトを dispose() してはならない。</p>
+     *
+     * @param {mapray.Vector3} origin  クリップ立方体の原点 (ALCS)
+     * @param {number}         size    クリップ立方体の寸法 (ALCS)
+     *
+     * @return {mapray.B3dBinary.ClipJob}  クリップ処理のジョブ
+     *
+     * @see {@link mapray.B3dBinary#clip}
+     */
+    clipBegin( origin, size )
+    {
+        return new ClipJob( this, this._native.clipBegin( this._handle, origin, size ) );
+    }
 
-            const positions = new Uint16Array( buffer, pointer, 3 * num_vertices );
-            pointer += align4( positions.byteLength );
 
-            const triangles = new triArrayType( buffer, pointer, 3 * num_triangles );
-            pointer += align4( triangles.byteLength );
+    /**
+     * @summary 8 分割した領域ごとに切り取ったメッシュを取得
+     *
+     * @desc
+     *
+     * <p>origin, size の立方体を各軸で 2 等分した 8 個の子の立方体ごとに、タイル
+     *    を切り取ったメッシュを返す。</p>
+     *
+     * <p>配列のインデックス u + 2v + 4w の要素は、原点が origin + (u, v, w) * size / 2
+     *    で寸法が size / 2 の立方体に対する clip() の結果と同じメッシュになる
+     *    (三角形の順序は異なることがある)。</p>
+     *
+     * @param {mapray.Vector3} origin  親の立方体の原点 (ALCS)
+     * @param {number}         size    親の立方体の寸法 (ALCS)
+     *
+     * @return {Array.<?mapray.Mesh>}  8 個のメッシュまたは null の配列
+     *
+     * @see {@link mapray.B3dBinary#clip}
+     */
+    clipOctants( origin, size )
+    {
+        const meshes = new Array( 8 ).fill( null );
 
-            let n_array = null;
-            if ( (this._contents & B3dBinary.CONTENTS_MASK_N_ARRAY) != 0 ) {
-                n_array = new Int8Array( buffer, pointer, 3 * num_vertices );
-                pointer += align4( n_array.byteLength );
-            }
+        this._native.clipOctants( this._handle, origin, size, (index, num_vertices, num_triangles, buffer, byte_offset) => {
+            meshes[index] = this._createClipMesh( num_vertices, num_triangles, buffer, byte_offset );
+        } );
 
-            let tc_array = null;
-            if ( (this._contents & B3dBinary.CONTENTS_MASK_TC_ARRAY) != 0 ) {
-                tc_array = new Uint16Array( buffer, pointer, 2 * num_vertices );
-                pointer += align4( tc_array.byteLength );
-            }
+        return meshes;
+    }
 
-            //
-            const mesh_init = new Mesh.Initializer( Mesh.DrawMode.TRIANGLES, num_vertices );
 
-            // 頂点インデックス
-            const itype = (num_vertices > 65536) ?
-                Mesh.ComponentType.UNSIGNED_INT : Mesh.ComponentType.UNSIGNED_SHORT;
+    /**
+     * @summary クリップ結果からメッシュを生成
+     *
+     * 幾何が存在しないときは null を返す。
+     *
+     * @param {number}  num_vertices
+     * @param {number} num_triangles
+     * @param {ArrayBuffer}   buffer
+     * @param {number}   byte_offset
+     *
+     * @return {?mapray.Mesh}  メッシュまたは null
+     *
+     * @private
+     */
+    _createClipMesh( num_vertices, num_triangles, buffer, byte_offset )
+    {
+        if ( num_triangles == 0 ) {
+            // 幾何が存在しない
+            return null;
+        }
+
+        if ( this._native.clipVertexFormat == B3dNative.CLIP_VERTEX_FORMAT_INTERLEAVED ) {
+            return this._createInterleavedClipMesh( num_vertices, num_triangles, buffer, byte_offset );
+        }
+
+        // NUM_VERTICES の値が 2^16 より大きいとき UINT32 型、それ以外のとき UINT16 型
+        const triArrayType = (num_vertices > 65536) ? Uint32Array : Uint16Array;
+
+        let pointer = byte_offset;
 
-            mesh_init.addIndex( new MeshBuffer( this._glenv, triangles, { target: MeshBuffer.Target.INDEX } ),
-                                triangles.length,  // num_indices
-                                itype );
+        const positions = new Uint16Array( buffer, pointer, 3 * num_vertices );
+        pointer += align4( positions.byteLength );
 
-            // 頂点属性
-            mesh_init.addAttribute( "a_position",
-                                    new MeshBuffer( this._glenv, positions ),
+        const triangles = new triArrayType( buffer, pointer, 3 * num_triangles );
+        pointer += align4( triangles.byteLength );
+
+        let n_array = null;
+        if ( (this._contents & B3dBinary.CONTENTS_MASK_N_ARRAY) != 0 ) {
+            n_array = new Int8Array( buffer, pointer, 3 * num_vertices );
+            pointer += align4( n_array.byteLength );
+        }
+
+        let tc_array = null;
+        if ( (this._contents & B3dBinary.CONTENTS_MASK_TC_ARRAY) != 0 ) {
+            tc_array = new Uint16Array( buffer, pointer, 2 * num_vertices );
+            pointer += align4( tc_array.byteLength );
+        }
+
+        //
+        const mesh_init = new Mesh.Initializer( Mesh.DrawMode.TRIANGLES, num_vertices );
+
+        // 頂点インデックス
+        const itype = (num_vertices > 65536) ?
+            Mesh.ComponentType.UNSIGNED_INT : Mesh.ComponentType.UNSIGNED_SHORT;
+
+        mesh_init.addIndex( new MeshBuffer( this._glenv, triangles, { target: MeshBuffer.Target.INDEX } ),
+                            triangles.length,  // num_indices
+                            itype );
+
+        // 頂点属性
+        mesh_init.addAttribute( "a_position",
+                                new MeshBuffer( this._glenv, positions ),
+                                3,  // num_components
+                                Mesh.ComponentType.UNSIGNED_SHORT,
+                                { normalized: true } );
+
+        if ( n_array !== null ) {
+            mesh_init.addAttribute( "a_normal",
+                                    new MeshBuffer( this._glenv, n_array ),
                                     3,  // num_components
+                                    Mesh.ComponentType.BYTE,
+                                    { normalized: true } );
+        }
+
+        if ( tc_array !== null ) {
+            mesh_init.addAttribute( "a_texcoord",
+                                    new MeshBuffer( this._glenv, tc_array ),
+                                    2,  // num_components
                                     Mesh.ComponentType.UNSIGNED_SHORT,
                                     { normalized: true } );
+        }
 
-            if ( n_array !== null ) {
-                mesh_init.addAttribute( "a_normal",
-                                        new MeshBuffer( this._glenv, n_array ),
-                                        3,  // num_components
-                                        Mesh.ComponentType.BYTE,
-                                        { normalized: true } );
-            }
+        return new Mesh( this._glenv, mesh_init );
+    }
 
-            if ( tc_array !== null ) {
-                mesh_init.addAttribute( "a_texcoord",
-                                        new MeshBuffer( this._glenv, tc_array ),
-                                        2,  // num_components
-                                        Mesh.ComponentType.UNSIGNED_SHORT,
-                                        { normalized: true } );
-            }
 
-            mesh = new Mesh( this._glenv, mesh_init );
-        } );
+    /**
+     * @summary 頂点属性をまとめたクリップ結果からメッシュを生成
+     *
+     * _createClipMesh() で B3dNative.CLIP_VERTEX_FORMAT_INTERLEAVED のときに使う。
+     * 頂点属性は 1 つの MeshBuffer を共有する。
+     *
+     * @param {number}  num_vertices
+     * @param {number} num_triangles
+     * @param {ArrayBuffer}   buffer
+     * @param {number}   byte_offset
+     *
+     * @return {mapray.Mesh}  メッシュ
+     *
+     * @private
+     */
+    _createInterleavedClipMesh( num_vertices, num_triangles, buffer, byte_offset )
+    {
+        const has_n_array  = (this._contents & B3dBinary.CONTENTS_MASK_N_ARRAY)  != 0;
+        const has_tc_array = (this._contents & B3dBinary.CONTENTS_MASK_TC_ARRAY) != 0;
 
-        return mesh;
+        // 頂点内の各属性のオフセット (Tile::ClipVertexFormat::INTERLEAVED)
+        let stride = 8;  // POSITIONS
+
+        const n_offset = stride;
+        if ( has_n_array ) {
+            stride += 4;
+        }
+
+        const tc_offset = stride;
+        if ( has_tc_array ) {
+            stride += 4;
+        }
+
+        const vertices = new Uint8Array( buffer, byte_offset, stride * num_vertices );
+
+        // NUM_VERTICES の値が 2^16 より大きいとき UINT32 型、それ以外のとき UINT16 型
+        const triArrayType = (num_vertices > 65536) ? Uint32Array : Uint16Array;
+
+        const triangles = new triArrayType( buffer, byte_offset + vertices.byteLength, 3 * num_triangles );
+
+        //
+        const mesh_init = new Mesh.Initializer( Mesh.DrawMode.TRIANGLES, num_vertices );
+
+        // 頂点インデックス
+        const itype = (num_vertices > 65536) ?
+            Mesh.ComponentType.UNSIGNED_INT : Mesh.ComponentType.UNSIGNED_SHORT;
+
+        mesh_init.addIndex( new MeshBuffer( this._glenv, triangles, { target: MeshBuffer.Target.INDEX } ),
+                            triangles.length,  // num_indices
+                            itype );
+
+        // 頂点属性
+        const vertex_buffer = new MeshBuffer( this._glenv, vertices );
+
+        mesh_init.addAttribute( "a_position",
+                                vertex_buffer,
+                                3,  // num_components
+                                Mesh.ComponentType.UNSIGNED_SHORT,
+                                { normalized: true, byte_stride: stride, byte_offset: 0 } );
+
+        if ( has_n_array ) {
+            mesh_init.addAttribute( "a_normal",
+                                    vertex_buffer,
+                                    3,  // num_components
+                                    Mesh.ComponentType.BYTE,
+                                    { normalized: true, byte_stride: stride, byte_offset: n_offset } );
+        }
+
+        if ( has_tc_array ) {
+            mesh_init.addAttribute( "a_texcoord",
+                                    vertex_buffer,
+                                    2,  // num_components
+                                    Mesh.ComponentType.UNSIGNED_SHORT,
+                                    { normalized: true, byte_stride: stride, byte_offset: tc_offset } );
+        }
+
+        return new Mesh( this._glenv, mesh_init );
     }
 
 
@@ -359,6 +523,47 @@ class B3dBinary {
     }
 
 
+    /**
+     * @summary レイがタイル内の三角形で遮蔽されるかを判定
+     *
+     * getRayIntersection() が null 以外を返すときに true を返す。ただし交差の
+     * 詳細は求めないので高速である。
+     */
+    testRayOccluded( ray, limit, rect_origin, rect_size )
+    {
+        return this._native.testRayOccluded( this._handle,
+                                             ray, limit, rect_origin, rect_size );
+    }
+
+
+    /**
+     * @summary タイル内の三角形とレイとのすべての交点を探す
+     *
+     * getRayIntersection() と同じ条件で交差するすべての三角形の交点を、近い
+     * 順に最大 max_hits 個返す。各要素は distance, triangle (三角形インデッ
+     * クス), feature_id をプロパティに持つ。
+     */
+    getRayHits( ray, limit, rect_origin, rect_size, max_hits )
+    {
+        const RAY_HIT_NUM_ELEMS = 4;  // Tile::RAY_HIT_NUM_ELEMS
+
+        const array = this._native.findRayHits( this._handle,
+                                                ray, limit, rect_origin, rect_size,
+                                                max_hits );
+        const hits = [];
+
+        for ( let i = 0; i < array.length; i += RAY_HIT_NUM_ELEMS ) {
+            hits.push( {
+                distance:   array[i],
+                triangle:   array[i + 1],
+                feature_id: [array[i + 2], array[i + 3]]
+            } );
+        }
+
+        return hits;
+    }
+
+
     /**
      * @summary インスタンスを破棄
      *
@@ -378,6 +583,80 @@ class B3dBinary {
 }
 
 
+/**
+ * @summary 再開可能なクリップ処理
+ *
+ * @classdesc
+ * <p>{@link mapray.B3dBinary#clipBegin} が返すオブジェクトである。</p>
+ *
+ * @memberof mapray.B3dBinary
+ * @private
+ */
+class ClipJob {
+
+    /**
+     * @param {mapray.B3dBinary} binary  クリップ対象
+     * @param {number}              job  ジョブのハンドル
+     */
+    constructor( binary, job )
+    {
+        this._binary = binary;
+        this._job    = job;
+    }
+
+
+    /**
+     * @summary 処理を進める
+     *
+     * @param {number} max_triangles  処理する最大の三角形数
+     *
+     * @return {boolean}  残りの処理が finish() だけになったとき true
+     */
+    step( max_triangles )
+    {
+        return this._binary._native.clipStep( this._job, max_triangles );
+    }
+
+
+    /**
+     * @summary 処理を完了してメッシュを取得
+     *
+     * @desc
+     * <p>step() が true を返す前に呼び出したときは、残りの処理をすべて行う。</p>
+     * <p>この後、このオブジェクトは使用できない。</p>
+     *
+     * @return {?mapray.Mesh}  メッシュまたは null
+     */
+    finish()
+    {
+        const binary = this._binary;
+        let     mesh = null;
+
+        binary._native.clipFinish( this._job, (num_vertices, num_triangles, buffer, byte_offset) => {
+            mesh = binary._createClipMesh( num_vertices, num_triangles, buffer, byte_offset );
+        } );
+
+        this._job = 0;
+
+        return mesh;
+    }
+
+
+    /**
+     * @summary 処理を中止
+     *
+     * @desc
+     * <p>この後、このオブジェクトは使用できない。</p>
+     */
+    cancel()
+    {
+        this._binary._native.clipCancel( this._job );
+        this._job = 0;
+    }
+
+}
+
+
 /**
  * @summary 4 バイトアライン
  *
@@ -22,6 +22,10 @@ class B3dNative {
         this._clip_result = null;  // クリッピング結果を受け取る関数 (mapray.B3dNative.ClipResult)
         this._ray_result  = null;  // レイ判定結果を受け取る関数 (mapray.B3dNative.findRayDistance)
 
+        // findRayDistanceMany() などで使う wasm 側の領域
+        this._ray_buffer      = 0;  // ポインタ (buffer_create() で確保)
+        this._ray_buffer_size = 0;  // バイト数
+
         // 関数登録: Tile.hpp の binary_copy_func_t を参照
         const binary_copy = em_module.addFunction( (dst_begin) => {
             this._emod.HEAPU8.set( this._src_binary, dst_begin );
@@ -29,13 +33,15 @@ class B3dNative {
         }, "vi" );
 
         // 関数登録: Tile.hpp の clip_result_func_t を参照
+        // (fn_result が this._clip_result を再設定できるように先に null にする)
         const clip_result = em_module.addFunction( (num_vertices, num_triangles, data) => {
-            this._clip_result.call( null,
-                                    num_vertices,
-                                    num_triangles,
-                                    this._emod.HEAPU8.buffer,
-                                    data );
+            const fn_result = this._clip_result;
             this._clip_result = null;
+            fn_result.call( null,
+                            num_vertices,
+                            num_triangles,
+                            this._emod.HEAPU8.buffer,
+                            data );
         }, "viii" );
 
         // 関数登録: Tile.hpp の ray_result_func_t を参照
@@ -46,20 +52,121 @@ class B3dNative {
 
         // b3dtile インスタンスを初期化
         em_module._initialize( binary_copy, clip_result, ray_result );
+
+        // クリップ結果の頂点属性は 1 つのバッファにまとめる
+        this._clip_vertex_format = B3dNative.CLIP_VERTEX_FORMAT_SEPARATE;
+        this.setClipVertexFormat( B3dNative.CLIP_VERTEX_FORMAT_INTERLEAVED );
+    }
+
+
+    /**
+     * @summary クリップ結果の頂点属性の形式
+     *
+     * @type {number}
+     *
+     * @see {@link mapray.B3dNative#setClipVertexFormat}
+     * @readonly
+     */
+    get clipVertexFormat()
+    {
+        return this._clip_vertex_format;
+    }
+
+
+    /**
+     * @summary クリップ結果の頂点属性の形式を設定
+     *
+     * @desc
+     * <p>clip() などが fn_result に渡すデータの配置を設定する。</p>
+     *
+     * <p>format は B3dNative.CLIP_VERTEX_FORMAT_SEPARATE (頂点属性ごとの配列) または
+     *    B3dNative.CLIP_VERTEX_FORMAT_INTERLEAVED (頂点属性をまとめた配列) である。
+     *    配置の詳細は Tile.hpp の ClipVertexFormat を参照のこと。</p>
+     *
+     * @param {number} format  頂点属性の形式
+     */
+    setClipVertexFormat( format )
+    {
+        this._emod._set_clip_vertex_format( format );
+        this._clip_vertex_format = format;
     }
 
 
     /**
      * @summary バイナリデータを追加
      *
+     * @desc
+     * <p>binary を wasm のメモリーに 1 回複製する。</p>
+     *
+     * <p>B3dProvider はタイルデータ全体を ArrayBuffer で渡すので、B3dBinary はこ
+     *    のメソッドを使う。受信したデータを分割して直接 wasm のメモリーに書き込む
+     *    ときは reserveBinary(), getBinaryWriteArray(), commitBinary() を使う。</p>
+     *
      * @param {Uint8Array} binary  タイルデータのバイナリデータ
      *
      * @return {number}  オブジェクトハンドル
      */
     addBinary( binary )
     {
-        this._src_binary = binary;  // 次の呼び出しから間接的に参照される
-        return this._emod._tile_create( binary.byteLength );
+        const handle = this.reserveBinary( binary.byteLength );
+
+        this.getBinaryWriteArray( handle, binary.byteLength ).set( binary );
+        this.commitBinary( handle );
+
+        return handle;
+    }
+
+
+    /**
+     * @summary データを書き込む前のバイナリデータを追加
+     *
+     * @desc
+     * <p>size バイトの領域を wasm のメモリーに確保する。</p>
+     *
+     * <p>呼び出し側は getBinaryWriteArray() で得た配列にタイルデータを書き込み、
+     *    その後に commitBinary() を呼び出す。それまでは他のメソッドにハンドルを
+     *    与えることはできない (removeBinary() を除く)。</p>
+     *
+     * <p>受信したデータを JavaScript 側に保持せず、直接 wasm のメモリーに書き込む
+     *    ために使うことができる。</p>
+     *
+     * @param {number} size  タイルデータのバイト数
+     *
+     * @return {number}  オブジェクトハンドル
+     */
+    reserveBinary( size )
+    {
+        return this._emod._tile_reserve( size );
+    }
+
+
+    /**
+     * @summary バイナリデータの書き込み先を取得
+     *
+     * @desc
+     * <p>返される配列は wasm のメモリーを参照している。wasm のメモリーが拡張され
+     *    ると無効になるので、書き込みが終わるまでの間だけ使うこと。</p>
+     *
+     * @param {number} handle  reserveBinary() が返したハンドル
+     * @param {number}   size  reserveBinary() に与えたバイト数
+     *
+     * @return {Uint8Array}  書き込み先
+     */
+    getBinaryWriteArray( handle, size )
+    {
+        const position = this._emod._tile_get_write_position( handle );
+        return new Uint8Array( this._emod.HEAPU8.buffer, position, size );
+    }
+
+
+    /**
+     * @summary バイナリデータの書き込みを完了
+     *
+     * @param {number} handle  reserveBinary() が返したハンドル
+     */
+    commitBinary( handle )
+    {
+        this._emod._tile_commit( handle );
     }
 
 
@@ -108,6 +215,171 @@ class B3dNative {
     }
 
 
+    /**
+     * @summary クリップ結果のバイト数を計算
+     *
+     * @desc
+     * <p>clip() の結果を呼び出し側が用意した wasm 側の領域に書き込むための前半の処理である。</p>
+     * <p>続けて clipWrite() を呼び出して結果を書き込む。</p>
+     *
+     * @param {number}         handle  オブジェクトハンドル
+     * @param {mapray.Vector3} origin  クリップ立方体の原点 (ALCS)
+     * @param {number}         size    クリップ立方体の寸法 (ALCS)
+     *
+     * @return {number}  結果のバイト数
+     */
+    clipPrepare( handle, origin, size )
+    {
+        const x = origin[0];
+        const y = origin[1];
+        const z = origin[2];
+
+        return this._emod._tile_clip_prepare( handle, x, y, z, size );
+    }
+
+
+    /**
+     * @summary clipPrepare() で準備したクリップ結果を書き込む
+     *
+     * @desc
+     * <p>buffer から clipPrepare() が返したバイト数の領域に結果を書き込み、fn_result を呼び出す。</p>
+     * <p>fn_result に渡される byte_offset は buffer と同じ値になる。</p>
+     *
+     * @param {number} handle  オブジェクトハンドル
+     * @param {number} buffer  出力先のポインタ (createBuffer() で確保)
+     * @param {mapray.B3dNative.ClipResult} fn_result  結果を受け取る関数
+     */
+    clipWrite( handle, buffer, fn_result )
+    {
+        this._clip_result = fn_result;
+        this._emod._tile_clip_write( handle, buffer );
+    }
+
+
+    /**
+     * @summary 再開可能なクリップ処理を開始
+     *
+     * @desc
+     * <p>clip() と同じ処理を clipStep() で少しずつ進め、clipFinish() で結果を受け取る。</p>
+     * <p>返したジョブは clipFinish() または clipCancel() で破棄しなければならない。それまで
+     *    handle のオブジェクトは破棄してはならない。</p>
+     *
+     * @param {number}         handle  オブジェクトハンドル
+     * @param {mapray.Vector3} origin  クリップ立方体の原点 (ALCS)
+     * @param {number}         size    クリップ立方体の寸法 (ALCS)
+     *
+     * @return {number}  ジョブのハンドル
+     */
+    clipBegin( handle, origin, size )
+    {
+        const x = origin[0];
+        const y = origin[1];
+        const z = origin[2];
+
+        return this._emod._tile_clip_begin( handle, x, y, z, size );
+    }
+
+
+    /**
+     * @summary クリップ処理を進める
+     *
+     * @param {number}           job  ジョブのハンドル (clipBegin() で取得)
+     * @param {number} max_triangles  処理する最大の三角形数
+     *
+     * @return {boolean}  残りの処理が clipFinish() だけになったとき true
+     */
+    clipStep( job, max_triangles )
+    {
+        return this._emod._tile_clip_step( job, max_triangles ) != 0;
+    }
+
+
+    /**
+     * @summary クリップ処理を完了
+     *
+     * @desc
+     * <p>残りの処理を行って fn_result を呼び出し、job を破棄する。</p>
+     *
+     * @param {number} job  ジョブのハンドル (clipBegin() で取得)
+     * @param {mapray.B3dNative.ClipResult} fn_result  結果を受け取る関数
+     */
+    clipFinish( job, fn_result )
+    {
+        this._clip_result = fn_result;
+        this._emod._tile_clip_finish( job );
+    }
+
+
+    /**
+     * @summary クリップ処理を中止
+     *
+     * @desc
+     * <p>結果を受け取らずに job を破棄する。</p>
+     *
+     * @param {number} job  ジョブのハンドル (clipBegin() で取得)
+     */
+    clipCancel( job )
+    {
+        this._emod._tile_clip_cancel( job );
+    }
+
+
+    /**
+     * @summary wasm 側の領域を確保
+     *
+     * @param {number} size  バイト数
+     *
+     * @return {number}  領域のポインタ
+     *
+     * @see {@link mapray.B3dNative#destroyBuffer}
+     */
+    createBuffer( size )
+    {
+        return this._emod._buffer_create( size );
+    }
+
+
+    /**
+     * @summary createBuffer() で確保した領域を解放
+     *
+     * @param {number} buffer  領域のポインタ
+     */
+    destroyBuffer( buffer )
+    {
+        this._emod._buffer_destroy( buffer );
+    }
+
+
+    /**
+     * @see {@link mapray.B3dBinary#clipOctants}
+     *
+     * @param {number}         handle  オブジェクトハンドル
+     * @param {mapray.Vector3} origin  親の立方体の原点 (ALCS)
+     * @param {number}         size    親の立方体の寸法 (ALCS)
+     * @param {mapray.B3dNative.OctantClipResult} fn_result  結果を受け取る関数
+     */
+    clipOctants( handle, origin, size, fn_result )
+    {
+        const x = origin[0];
+        const y = origin[1];
+        const z = origin[2];
+
+        // 子の順 (u + 2v + 4w) に 8 回呼び出される
+        let index = 0;
+
+        const fn_child = (num_vertices, num_triangles, buffer, byte_offset) => {
+            if ( index < 7 ) {
+                this._clip_result = fn_child;
+            }
+            fn_result( index++, num_vertices, num_triangles, buffer, byte_offset );
+        };
+
+        this._clip_result = fn_child;
+        this._emod._tile_clip_octants( handle, x, y, z, size );
+        this._clip_result = null;
+    }
+
+
     /**
      * @see {@link mapray.B3dBinary#findRayDistance}
      *
@@ -141,6 +413,203 @@ class B3dNative {
                                             rect_size );
     }
 
+
+    /**
+     * @summary 複数のレイとタイル内の三角形との交点を探す
+     *
+     * @desc
+     * <p>rays には 1 本のレイごとに次の 11 個の要素を並べる。</p>
+     *
+     * <pre>
+     *   ray.position[0..2], ray.direction[0..2], limit, rect_origin[0..2], rect_size
+     * </pre>
+     *
+     * <p>結果は 1 本のレイごとに distance, id_0, id_1 の 3 個の要素が並んだ配列である。
+     *    それぞれの意味は findRayDistance() の fn_result のパラメータと同じである。</p>
+     *
+     * <p>詳細は Tile.hpp の find_ray_distance_many() を参照のこと。</p>
+     *
+     * @param {number}       handle  オブジェクトハンドル
+     * @param {number}     num_rays  レイの数
+     * @param {Float64Array}   rays  レイ配列
+     *
+     * @return {Float64Array}  結果配列
+     */
+    findRayDistanceMany( handle, num_rays, rays )
+    {
+        const RAY_NUM_ELEMS        = 11;  // Tile::RAY_NUM_ELEMS
+        const RAY_RESULT_NUM_ELEMS = 3;   // Tile::RAY_RESULT_NUM_ELEMS
+
+        const  rays_size = Float64Array.BYTES_PER_ELEMENT * RAY_NUM_ELEMS        * num_rays;
+        const  rslt_size = Float64Array.BYTES_PER_ELEMENT * RAY_RESULT_NUM_ELEMS * num_rays;
+
+        const rays_ptr = this._writeRays( num_rays, rays, rslt_size );
+        const rslt_ptr = rays_ptr + rays_size;
+
+        this._emod._tile_find_ray_distance_many( handle, num_rays, rays_ptr, rslt_ptr );
+
+        // wasm のメモリーが拡張されても無効にならないように複製して返す
+        return new Float64Array( this._emod.HEAPU8.buffer, rslt_ptr, RAY_RESULT_NUM_ELEMS * num_rays ).slice();
+    }
+
+
+    /**
+     * @summary レイがタイル内の三角形で遮蔽されるかを判定
+     *
+     * @desc
+     * <p>findRayDistance() で交差が見つかるかどうかだけを判定する。最初に見つかった交差で処理を終了し、
+     *    feature ID も求めないので findRayDistance() より高速である。</p>
+     *
+     * @param {number} handle  オブジェクトハンドル
+     *
+     * @return {boolean}  遮蔽されるとき true
+     */
+    testRayOccluded( handle,
+                     // [[[
+                     // B3dBinary#getRayIntersection() と同じ引数
+                     ray, limit, rect_origin, rect_size
+                     // ]]]
+                   )
+    {
+        const result = this._emod._tile_test_ray_occluded( handle,
+
+                                                           ray.position[0],
+                                                           ray.position[1],
+                                                           ray.position[2],
+
+                                                           ray.direction[0],
+                                                           ray.direction[1],
+                                                           ray.direction[2],
+
+                                                           limit,
+
+                                                           rect_origin[0],
+                                                           rect_origin[1],
+                                                           rect_origin[2],
+                                                           rect_size );
+        return result !== 0;
+    }
+
+
+    /**
+     * @summary 複数のレイがタイル内の三角形で遮蔽されるかを判定
+     *
+     * @desc
+     * <p>rays の形式は findRayDistanceMany() と同じである。</p>
+     *
+     * <p>結果は 1 本のレイごとに、遮蔽されるとき 1, それ以外は 0 となる配列である。</p>
+     *
+     * @param {number}       handle  オブジェクトハンドル
+     * @param {number}     num_rays  レイの数
+     * @param {Float64Array}   rays  レイ配列
+     *
+     * @return {Int32Array}  結果配列
+     */
+    testRayOccludedMany( handle, num_rays, rays )
+    {
+        const RAY_NUM_ELEMS = 11;  // Tile::RAY_NUM_ELEMS
+
+        const  rays_size = Float64Array.BYTES_PER_ELEMENT * RAY_NUM_ELEMS * num_rays;
+        const  rslt_size = Int32Array.BYTES_PER_ELEMENT * num_rays;
+
+        const rays_ptr = this._writeRays( num_rays, rays, rslt_size );
+        const rslt_ptr = rays_ptr + rays_size;
+
+        this._emod._tile_test_ray_occluded_many( handle, num_rays, rays_ptr, rslt_ptr );
+
+        // wasm のメモリーが拡張されても無効にならないように複製して返す
+        return new Int32Array( this._emod.HEAPU8.buffer, rslt_ptr, num_rays ).slice();
+    }
+
+
+    /**
+     * @summary レイとタイル内の三角形とのすべての交点を探す
+     *
+     * @desc
+     * <p>結果は 1 つの交点ごとに distance, triangle, id_0, id_1 の 4 個の要素が並んだ配列である。
+     *    交点は近い順に並び、最も近い max_hits 個までが含まれる。</p>
+     *
+     * <p>交点までの距離は findRayDistance() と同じく 0 より大きく limit より小さ
+     *    い範囲であり、距離が limit と等しい交点は含まれない。</p>
+     *
+     * <p>詳細は Tile.hpp の find_ray_hits() を参照のこと。</p>
+     *
+     * @param {number}  handle    オブジェクトハンドル
+     * @param {number}  max_hits  交点の最大数
+     *
+     * @return {Float64Array}  交点配列
+     */
+    findRayHits( handle,
+                 // [[[
+                 // B3dBinary#getRayIntersection() と同じ引数
+                 ray, limit, rect_origin, rect_size,
+                 // ]]]
+                 max_hits )
+    {
+        const RAY_NUM_ELEMS     = 11;  // Tile::RAY_NUM_ELEMS
+        const RAY_HIT_NUM_ELEMS = 4;   // Tile::RAY_HIT_NUM_ELEMS
+
+        const rays = new Float64Array( [ray.position[0],
+                                        ray.position[1],
+                                        ray.position[2],
+                                        ray.direction[0],
+                                        ray.direction[1],
+                                        ray.direction[2],
+                                        limit,
+                                        rect_origin[0],
+                                        rect_origin[1],
+                                        rect_origin[2],
+                                        rect_size] );
+
+        const  rays_size = Float64Array.BYTES_PER_ELEMENT * RAY_NUM_ELEMS;
+        const  rslt_size = Float64Array.BYTES_PER_ELEMENT * RAY_HIT_NUM_ELEMS * max_hits;
+
+        const rays_ptr = this._writeRays( 1, rays, rslt_size );
+        const rslt_ptr = rays_ptr + rays_size;
+
+        const num_hits = this._emod._tile_find_ray_hits( handle, rays_ptr, max_hits, rslt_ptr );
+        const num_outs = Math.min( num_hits, max_hits );
+
+        // wasm のメモリーが拡張されても無効にならないように複製して返す
+        return new Float64Array( this._emod.HEAPU8.buffer, rslt_ptr, RAY_HIT_NUM_ELEMS * num_outs ).slice();
+    }
+
+
+    /**
+     * @summary レイ配列を wasm 側の領域に書き込む
+     *
+     * @desc
+     * <p>wasm 側の領域はレイ配列と、その直後の rslt_size バイトの結果配列を格納できる大きさに拡張される。</p>
+     *
+     * @param {number}     num_rays   レイの数
+     * @param {Float64Array}   rays   レイ配列
+     * @param {number}     rslt_size  結果配列のバイト数
+     *
+     * @return {number}  wasm 側のレイ配列のポインタ
+     *
+     * @private
+     */
+    _writeRays( num_rays, rays, rslt_size )
+    {
+        const RAY_NUM_ELEMS = 11;  // Tile::RAY_NUM_ELEMS
+
+        const rays_size = Float64Array.BYTES_PER_ELEMENT * RAY_NUM_ELEMS * num_rays;
+
+        // wasm 側の領域を確保 (足りないときだけ拡張)
+        if ( this._ray_buffer_size < rays_size + rslt_size ) {
+            if ( this._ray_buffer !== 0 ) {
+                this._emod._buffer_destroy( this._ray_buffer );
+            }
+            this._ray_buffer_size = rays_size + rslt_size;
+            this._ray_buffer      = this._emod._buffer_create( this._ray_buffer_size );
+        }
+
+        const heap = this._emod.HEAPU8.buffer;
+        new Float64Array( heap, this._ray_buffer, RAY_NUM_ELEMS * num_rays ).set( rays.subarray( 0, RAY_NUM_ELEMS * num_rays ) );
+
+        return this._ray_buffer;
+    }
+
 }
 
 
@@ -161,4 +630,27 @@ class B3dNative {
  */
 
 
+/**
+ * @summary 8 分割のクリッピング結果を受け取る関数の型
+ *
+ * @desc
+ * <p>mapray.B3dNative.ClipResult の引数の前に子のインデックス (u + 2v + 4w)
+ *    を加えた関数である。</p>
+ *
+ * @param {number}         index
+ * @param {number}  num_vertices
+ * @param {number} num_triangles
+ * @param {ArrayBuffer}   buffer
+ * @param {number}   byte_offset
+ *
+ * @callback OctantClipResult
+ * @memberof mapray.B3dNative
+ */
+
+
+// Tile::ClipVertexFormat
+B3dNative.CLIP_VERTEX_FORMAT_SEPARATE    = 0;
+B3dNative.CLIP_VERTEX_FORMAT_INTERLEAVED = 1;
+
+
 export default B3dNative;
@@ -52,6 +52,16 @@ const NODE_CACHE_REDUCE_UPPER = 3.0;  // > NODE_CACHE_REDUCE_LOWER
 const NODE_CACHE_REDUCE_LOWER = 2.0;  // > 1.0
 
 
+/**
+ * 共有の Converter インスタンスで変換する被覆率画像の画素数の上限
+ *
+ * これより大きい画像は一時的な Converter インスタンスで変換する。共有
+ * のインスタンスの領域は縮小されないので、まれな大きい画像のために多く
+ * のメモリーを保持し続けないようにする。
+ */
+const SHARED_CONVERTER_MAX_PIXELS = 1024 * 256;
+
+
 /**
  * 表示できる縁取り幅の限界値
  *
@@ -329,7 +339,7 @@ abstract class SdfImageCache {
 
         cfa_assert( sdfield_module ); // ここに到達するときには設定されると想定
 
-        const conv = sdfield_module._converter_create( cov_width, cov_height, sdf_ext );
+        const conv = acquire_converter( cov_width, cov_height, sdf_ext );
         try {
             // 被覆率画像を sdfield_module に渡す
             const num_cov_pixels = cov_width * cov_height;
@@ -352,7 +362,7 @@ abstract class SdfImageCache {
                      sdf_width, sdf_height );
         }
         finally {
-            sdfield_module._converter_destroy( conv );
+            release_converter( conv );
         }
     }
 
@@ -1253,3 +1263,54 @@ export interface ImageInfo {
     anchor_upper_y: number;
 
 }
+
+
+/**
+ * 共有の Converter インスタンス (未生成のときは 0)
+ *
+ * 画像ごとに Converter インスタンスを生成・破棄する代わりに、
+ * `converter_reset` で寸法を変えながら再利用する。
+ */
+let shared_converter = 0;
+
+
+/**
+ * Converter インスタンスを取得
+ *
+ * パラメータは `converter_create` と同じである。
+ *
+ * 使い終わったインスタンスは [[release_converter]] に渡さなければならない。
+ */
+function acquire_converter( cov_width:  number,
+                            cov_height: number,
+                            sdf_ext:    number ): number
+{
+    cfa_assert( sdfield_module );
+
+    if ( cov_width * cov_height > SHARED_CONVERTER_MAX_PIXELS ) {
+        // 大きい画像は一時的なインスタンスで変換
+        return sdfield_module._converter_create( cov_width, cov_height, sdf_ext ) as number;
+    }
+
+    if ( shared_converter === 0 ) {
+        shared_converter = sdfield_module._converter_create( cov_width, cov_height, sdf_ext ) as number;
+    }
+    else {
+        sdfield_module._converter_reset( shared_converter, cov_width, cov_height, sdf_ext );
+    }
+
+    return shared_converter;
+}
+
+
+/**
+ * [[acquire_converter]] で取得した Converter インスタンスを返却
+ */
+function release_converter( conv: number ): void
+{
+    cfa_assert( sdfield_module );
+
+    if ( conv !== shared_converter ) {
+        sdfield_module._converter_destroy( conv );
+    }
+}
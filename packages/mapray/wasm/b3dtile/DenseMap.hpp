@@ -0,0 +1,146 @@
+﻿#pragma once
+
+#include <vector>
+#include <algorithm>  // for fill()
+#include <limits>
+#include <utility>    // for pair
+#include <cassert>
+#include <cstdint>    // for uint32_t
+#include <cstddef>    // for size_t
+
+
+namespace b3dtile {
+
+/** @brief 密な配列による キー/値 の辞書
+ *
+ *  キーの範囲が [0, capacity()) に限られるときに HashMap の代わりに使う。
+ *
+ *  - キーをそのまま配列のインデックスとして使う
+ *  - 各要素に世代番号を持たせ、clear() は世代番号を進めるだけで配列を初期化
+ *    しない
+ *  - 削除操作なし
+ *  - 反復子なし
+ *
+ *  そのため、clear() を挟んで同じインスタンスを繰り返し使うことを想定している。
+ *
+ *  @tparam ValueType  値の型
+ */
+template<typename ValueType>
+class DenseMap {
+
+    using size_t = std::size_t;
+    using  gen_t = std::uint32_t;
+
+  public:
+    /** @brief キーの型
+     */
+    using key_t = std::size_t;
+
+
+    /** @brief 値の型
+     */
+    using value_t = ValueType;
+
+
+  public:
+    /** @brief 初期化
+     *
+     *  capacity() は 0 になる。
+     */
+    DenseMap() = default;
+
+
+    /** @brief キーの範囲の上限
+     */
+    size_t
+    capacity() const
+    {
+        return entries_.size();
+    }
+
+
+    /** @brief 要素数
+     */
+    size_t
+    size() const
+    {
+        return num_entries_;
+    }
+
+
+    /** @brief キーの範囲を拡張
+     *
+     *  capacity() が capacity 未満のときだけ拡張する。要素の登録状態は変わら
+     *  ない。
+     */
+    void
+    reserve( size_t capacity )
+    {
+        if ( entries_.size() < capacity ) {
+            entries_.resize( capacity, Entry{ NO_ENTRY_GEN, value_t{} } );
+        }
+    }
+
+
+    /** @brief すべての要素を削除
+     *
+     *  世代番号を進めるだけなので、通常は配列に触れない。
+     */
+    void
+    clear()
+    {
+        if ( generation_ == std::numeric_limits<gen_t>::max() ) {
+            // 世代番号が一周するので、すべての要素を未登録に戻す
+            std::fill( entries_.begin(), entries_.end(), Entry{ NO_ENTRY_GEN, value_t{} } );
+            generation_ = NO_ENTRY_GEN;
+        }
+
+        ++generation_;
+        num_entries_ = 0;
+    }
+
+
+    /** @brief 辞書に要素を挿入
+     *
+     *  HashMap::insert() と同じ仕様である。
+     *
+     *  @pre key < capacity()
+     */
+    std::pair<value_t, bool>
+    insert( key_t            key,
+            const value_t& value )
+    {
+        assert( key < entries_.size() );
+
+        auto& entry = entries_[key];
+
+        if ( entry.generation != generation_ ) {
+            entry = Entry{ generation_, value };
+            ++num_entries_;
+            return { value, true };
+        }
+        else {
+            return { entry.value, false };
+        }
+    }
+
+
+  private:
+    // entries_ の未登録の要素の世代番号
+    static constexpr gen_t NO_ENTRY_GEN = 0;
+
+
+    struct Entry {
+        gen_t generation;
+        value_t    value;
+    };
+
+
+  private:
+    std::vector<Entry> entries_;
+    gen_t           generation_ = NO_ENTRY_GEN + 1;
+    size_t         num_entries_ = 0;
+
+};
+
+} // namespace b3dtile
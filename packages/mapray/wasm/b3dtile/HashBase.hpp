@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include <vector>
+#include <algorithm>  // for fill()
 #include <limits>
 #include <cmath>    // for ceil()
 #include <cassert>
@@ -36,8 +37,7 @@ class HashBase {
   private:
     using size_t = std::size_t;
 
-    static constexpr size_t INITIAL_POW     = 1;     // n >= 1
-    static constexpr size_t INITIAL_SIZE    = 1u << INITIAL_POW;  // 初期バケット数 (2^n)
+    static constexpr size_t INITIAL_POW     = 1;     // 最小バケット数 2^n (n >= 1)
     static constexpr auto   MAX_LOAD_FACTOR = 0.75;  // <= 1
     static constexpr auto   NO_ENTRY_KEY    = static_cast<key_t>( -1 );
 
@@ -47,13 +47,20 @@ class HashBase {
 
   protected:
     /** @brief 初期化
+     *
+     *  capacity 個の要素をバケットの拡大なしに登録できるようにバケット数を決め
+     *  る。
      */
-    HashBase() :
-        buckets_{ INITIAL_SIZE, Bucket{ NO_ENTRY_KEY } },
-        mum_entries_{ 0 },
-        shift_{ MAX_BITS - INITIAL_POW },
-        thresh_{ static_cast<size_t>( std::ceil( INITIAL_SIZE * MAX_LOAD_FACTOR ) ) }
-    {}
+    explicit
+    HashBase( size_t capacity = 0 ) :
+        mum_entries_{ 0 }
+    {
+        const size_t pow = get_bucket_pow( capacity );
+
+        buckets_.assign( size_t{ 1 } << pow, Bucket{ NO_ENTRY_KEY } );
+        shift_  = MAX_BITS - pow;
+        thresh_ = get_thresh( pow );
+    }
 
 
     /** @brief 要素数
@@ -65,6 +72,41 @@ class HashBase {
     }
 
 
+    /** @brief バケットを拡大せずに登録できる要素数
+     */
+    std::size_t
+    capacity() const
+    {
+        return thresh_;
+    }
+
+
+    /** @brief 要素数 capacity まではバケットを拡大しないようにする
+     *
+     *  capacity() が capacity 未満のときだけ、バケット配列を一度だけ再構築す
+     *  る。
+     */
+    void
+    reserve( size_t capacity )
+    {
+        if ( capacity > thresh_ ) {
+            resize_buckets( get_bucket_pow( capacity ) );
+        }
+    }
+
+
+    /** @brief すべての要素を削除
+     *
+     *  バケット配列の領域は解放せずに再利用する。
+     */
+    void
+    clear()
+    {
+        std::fill( buckets_.begin(), buckets_.end(), Bucket{ NO_ENTRY_KEY } );
+        mum_entries_ = 0;
+    }
+
+
     /** @brief insert() 実装用のメソッド
      *
      *  key に対応するバケットへの参照を返す。
@@ -116,6 +158,32 @@ class HashBase {
 
 
   private:
+    /** @brief バケット数 2^pow のときの拡大の閾値
+     */
+    static size_t
+    get_thresh( size_t pow )
+    {
+        return static_cast<size_t>( std::ceil( (size_t{ 1 } << pow) * MAX_LOAD_FACTOR ) );
+    }
+
+
+    /** @brief capacity 個の要素を登録できるバケット数 2^pow の pow を取得
+     */
+    static size_t
+    get_bucket_pow( size_t capacity )
+    {
+        size_t pow = INITIAL_POW;
+
+        while ( get_thresh( pow ) < capacity ) {
+            ++pow;
+        }
+
+        assert( pow <= MAX_BITS );
+
+        return pow;
+    }
+
+
     /** @brief ハッシュ関数
      */
     size_t
@@ -132,8 +200,17 @@ class HashBase {
     void
     extend_buckets()
     {
-        const size_t new_size = 2 * buckets_.size();
-        assert( new_size >= mum_entries_ );
+        resize_buckets( MAX_BITS - shift_ + 1 );
+    }
+
+
+    /** @brief バケット数を 2^pow にしてすべての要素を再登録
+     */
+    void
+    resize_buckets( size_t pow )
+    {
+        const size_t new_size = size_t{ 1 } << pow;
+        assert( new_size > buckets_.size() );
 
         // buckets_ を長さ new_size の未登録の配列にクリアし、以前の配列を
         // old_buckets に設定する
@@ -141,8 +218,8 @@ class HashBase {
         buckets_.swap( old_buckets );
 
         // サイズ関連のプロパティを更新
-        shift_ -= 1;
-        thresh_ = static_cast<size_t>( std::ceil( new_size * MAX_LOAD_FACTOR ) );
+        shift_  = MAX_BITS - pow;
+        thresh_ = get_thresh( pow );
         assert( mum_entries_ < thresh_ );
 
         // old_buckets のすべての登録バケットを buckets_ に挿入
@@ -53,7 +53,34 @@ class HashMap : HashBase< impl_::HashMapBucket<ValueType> > {
     using base_t::size;
 
 
+    /** @brief すべての要素を削除
+     *
+     *  バケット配列の領域は解放せずに再利用する。
+     */
+    using base_t::clear;
+
+
+    /** @brief バケットを拡大せずに登録できる要素数
+     */
+    using base_t::capacity;
+
+
+    /** @brief 要素数 capacity まではバケットを拡大しないようにする
+     */
+    using base_t::reserve;
+
+
   public:
+    /** @brief 初期化
+     *
+     *  @param capacity  バケットを拡大せずに登録できる要素数
+     */
+    explicit
+    HashMap( std::size_t capacity = 0 )
+        : base_t{ capacity }
+    {}
+
+
     /** @brief 辞書に要素を挿入
      *
      *  辞書にキー key の要素が登録されていなければ、そのキーで値 value を辞書に
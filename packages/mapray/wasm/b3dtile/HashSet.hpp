@@ -41,7 +41,34 @@ class HashSet : HashBase< impl_::HashSetBucket > {
     using base_t::size;
 
 
+    /** @brief すべての要素を削除
+     *
+     *  バケット配列の領域は解放せずに再利用する。
+     */
+    using base_t::clear;
+
+
+    /** @brief バケットを拡大せずに登録できる要素数
+     */
+    using base_t::capacity;
+
+
+    /** @brief 要素数 capacity まではバケットを拡大しないようにする
+     */
+    using base_t::reserve;
+
+
   public:
+    /** @brief 初期化
+     *
+     *  @param capacity  バケットを拡大せずに登録できる要素数
+     */
+    explicit
+    HashSet( std::size_t capacity = 0 )
+        : base_t{ capacity }
+    {}
+
+
     /** @brief 集合に値を挿入
      *
      *  集合に値 value が登録されていなければ、value を集合に追加する。そして
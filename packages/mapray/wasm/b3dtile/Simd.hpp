@@ -0,0 +1,261 @@
+﻿#pragma once
+
+#if defined( __wasm_simd128__ )
+#  include <wasm_simd128.h>
+#else
+#  include <array>
+#  include <cmath>  // for fabs()
+#endif
+
+
+namespace b3dtile {
+
+/** @brief f32x4 の要素ごとの比較結果
+ *
+ *  wasm SIMD128 (-msimd128) が有効なときは v128_t を使い、それ以外のときは
+ *  ビット集合で表現する。
+ */
+class m32x4 {
+
+  public:
+#if defined( __wasm_simd128__ )
+    explicit
+    m32x4( v128_t v )
+        : v_{ v } {}
+#else
+    explicit
+    m32x4( unsigned bits )
+        : bits_{ bits } {}
+#endif
+
+
+    /** @brief 要素ごとの論理和
+     */
+    friend m32x4
+    operator|( const m32x4& a,
+               const m32x4& b )
+    {
+#if defined( __wasm_simd128__ )
+        return m32x4{ wasm_v128_or( a.v_, b.v_ ) };
+#else
+        return m32x4{ a.bits_ | b.bits_ };
+#endif
+    }
+
+
+    /** @brief 要素ごとの論理積
+     */
+    friend m32x4
+    operator&( const m32x4& a,
+               const m32x4& b )
+    {
+#if defined( __wasm_simd128__ )
+        return m32x4{ wasm_v128_and( a.v_, b.v_ ) };
+#else
+        return m32x4{ a.bits_ & b.bits_ };
+#endif
+    }
+
+
+    /** @brief ビット集合に変換
+     *
+     *  要素 i が真のとき、ビット i を 1 とした整数を返す。
+     */
+    unsigned
+    to_bits() const
+    {
+#if defined( __wasm_simd128__ )
+        return ((wasm_i32x4_extract_lane( v_, 0 ) != 0) ? 0b0001u : 0u) |
+               ((wasm_i32x4_extract_lane( v_, 1 ) != 0) ? 0b0010u : 0u) |
+               ((wasm_i32x4_extract_lane( v_, 2 ) != 0) ? 0b0100u : 0u) |
+               ((wasm_i32x4_extract_lane( v_, 3 ) != 0) ? 0b1000u : 0u);
+#else
+        return bits_;
+#endif
+    }
+
+
+  private:
+#if defined( __wasm_simd128__ )
+    v128_t v_;
+#else
+    unsigned bits_;
+#endif
+
+};
+
+
+/** @brief 単精度浮動小数点数の 4 要素ベクトル
+ *
+ *  wasm SIMD128 (-msimd128) が有効なときは v128_t を使い、それ以外のときは
+ *  要素ごとに処理する。
+ */
+class f32x4 {
+
+  public:
+    /** @brief すべての要素を s で初期化
+     */
+    explicit
+    f32x4( float s )
+#if defined( __wasm_simd128__ )
+        : v_{ wasm_f32x4_splat( s ) } {}
+#else
+        : v_{ s, s, s, s } {}
+#endif
+
+
+    /** @brief 要素ごとに初期化
+     */
+    f32x4( float e0,
+           float e1,
+           float e2,
+           float e3 )
+#if defined( __wasm_simd128__ )
+        : v_{ wasm_f32x4_make( e0, e1, e2, e3 ) } {}
+#else
+        : v_{ e0, e1, e2, e3 } {}
+#endif
+
+
+    /** @brief p から連続する 4 要素を読み込む
+     */
+    static f32x4
+    load( const float* p )
+    {
+#if defined( __wasm_simd128__ )
+        return f32x4{ wasm_v128_load( p ) };
+#else
+        return f32x4{ p[0], p[1], p[2], p[3] };
+#endif
+    }
+
+
+    /** @brief p から連続する 4 要素に書き込む
+     */
+    void
+    store( float* p ) const
+    {
+#if defined( __wasm_simd128__ )
+        wasm_v128_store( p, v_ );
+#else
+        for ( int i = 0; i < 4; ++i ) {
+            p[i] = v_[i];
+        }
+#endif
+    }
+
+
+    friend f32x4
+    operator+( const f32x4& a,
+               const f32x4& b )
+    {
+#if defined( __wasm_simd128__ )
+        return f32x4{ wasm_f32x4_add( a.v_, b.v_ ) };
+#else
+        return f32x4{ a.v_[0] + b.v_[0], a.v_[1] + b.v_[1], a.v_[2] + b.v_[2], a.v_[3] + b.v_[3] };
+#endif
+    }
+
+
+    friend f32x4
+    operator-( const f32x4& a,
+               const f32x4& b )
+    {
+#if defined( __wasm_simd128__ )
+        return f32x4{ wasm_f32x4_sub( a.v_, b.v_ ) };
+#else
+        return f32x4{ a.v_[0] - b.v_[0], a.v_[1] - b.v_[1], a.v_[2] - b.v_[2], a.v_[3] - b.v_[3] };
+#endif
+    }
+
+
+    friend f32x4
+    operator*( const f32x4& a,
+               const f32x4& b )
+    {
+#if defined( __wasm_simd128__ )
+        return f32x4{ wasm_f32x4_mul( a.v_, b.v_ ) };
+#else
+        return f32x4{ a.v_[0] * b.v_[0], a.v_[1] * b.v_[1], a.v_[2] * b.v_[2], a.v_[3] * b.v_[3] };
+#endif
+    }
+
+
+    /** @brief 要素ごとの a < b
+     */
+    friend m32x4
+    operator<( const f32x4& a,
+               const f32x4& b )
+    {
+#if defined( __wasm_simd128__ )
+        return m32x4{ wasm_f32x4_lt( a.v_, b.v_ ) };
+#else
+        unsigned bits = 0;
+        for ( int i = 0; i < 4; ++i ) {
+            if ( a.v_[i] < b.v_[i] ) bits |= 1u << i;
+        }
+        return m32x4{ bits };
+#endif
+    }
+
+
+    /** @brief 要素ごとの a > b
+     */
+    friend m32x4
+    operator>( const f32x4& a,
+               const f32x4& b )
+    {
+        return b < a;
+    }
+
+
+    /** @brief 要素ごとの絶対値
+     */
+    friend f32x4
+    abs( const f32x4& a )
+    {
+#if defined( __wasm_simd128__ )
+        return f32x4{ wasm_f32x4_abs( a.v_ ) };
+#else
+        return f32x4{ std::fabs( a.v_[0] ), std::fabs( a.v_[1] ), std::fabs( a.v_[2] ), std::fabs( a.v_[3] ) };
+#endif
+    }
+
+
+    /** @brief 要素ごとの最大値
+     *
+     *  a と b の要素に NaN はないものとする。
+     */
+    friend f32x4
+    max( const f32x4& a,
+         const f32x4& b )
+    {
+#if defined( __wasm_simd128__ )
+        return f32x4{ wasm_f32x4_max( a.v_, b.v_ ) };
+#else
+        return f32x4{ a.v_[0] < b.v_[0] ? b.v_[0] : a.v_[0],
+                      a.v_[1] < b.v_[1] ? b.v_[1] : a.v_[1],
+                      a.v_[2] < b.v_[2] ? b.v_[2] : a.v_[2],
+                      a.v_[3] < b.v_[3] ? b.v_[3] : a.v_[3] };
+#endif
+    }
+
+
+  private:
+#if defined( __wasm_simd128__ )
+    explicit
+    f32x4( v128_t v )
+        : v_{ v } {}
+#endif
+
+
+  private:
+#if defined( __wasm_simd128__ )
+    v128_t v_;
+#else
+    std::array<float, 4> v_;
+#endif
+
+};
+
+} // namespace b3dtile
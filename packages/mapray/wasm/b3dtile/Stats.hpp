@@ -0,0 +1,155 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+
+namespace b3dtile {
+
+/** @brief 性能計測用の統計
+ *
+ *  B3DTILE_ENABLE_STATS が真のときだけ add() や Timer で値が加算される。偽
+ *  のときは何も行わないので、計測のための負荷はない。
+ *
+ *  時間の値の単位はナノ秒である。
+ *
+ *  値はベンチマーク (wasm/bench/) で参照する。
+ */
+struct Stats {
+
+    /** @brief 統計が有効か？
+     */
+#if B3DTILE_ENABLE_STATS
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+
+    /** @brief 値を加算
+     *
+     *  instance の member に value を加算する。
+     */
+    static void
+    add( uint64_t Stats::* member,
+         uint64_t           value )
+    {
+        if constexpr ( enabled ) {
+            instance.*member += value;
+        }
+    }
+
+
+    /** @brief 区間の経過時間を加算
+     *
+     *  構築から破棄までの経過時間を instance の member に加算する。
+     */
+    class Timer {
+
+        using clock_t = std::chrono::steady_clock;
+
+      public:
+        explicit
+        Timer( uint64_t Stats::* member )
+            : member_{ member },
+              start_{ now() }
+        {}
+
+
+        ~Timer()
+        {
+            add( member_, now() - start_ );
+        }
+
+
+        Timer( const Timer& ) = delete;
+        void operator=( const Timer& ) = delete;
+
+
+      private:
+        /** @brief 現在の時刻 (統計が無効のときは 0)
+         */
+        static uint64_t
+        now()
+        {
+            if constexpr ( enabled ) {
+                const auto time = clock_t::now().time_since_epoch();
+                return std::chrono::duration_cast<std::chrono::nanoseconds>( time ).count();
+            }
+            else {
+                return 0;
+            }
+        }
+
+
+      private:
+        uint64_t Stats::* const member_;
+        const uint64_t           start_;
+
+    };
+
+
+    /** @brief すべての値を 0 にする
+     */
+    static void
+    reset()
+    {
+        instance = Stats{};
+    }
+
+
+    /** @brief レイ判定で処理したツリーのノード数
+     */
+    uint64_t ray_nodes = 0;
+
+    /** @brief レイ判定で処理した三角形ブロックに含まれる三角形の数
+     */
+    uint64_t ray_triangles = 0;
+
+    /** @brief レイ判定で倍精度の交差判定を行った三角形の数
+     */
+    uint64_t ray_exact_tests = 0;
+
+    /** @brief クリップ処理 (Clipper::run()) の回数
+     */
+    uint64_t clip_calls = 0;
+
+    /** @brief クリップ処理で収集した三角形ブロックの数
+     */
+    uint64_t clip_tblocks = 0;
+
+    /** @brief クリップ処理で判定した三角形の数
+     */
+    uint64_t clip_triangles = 0;
+
+    /** @brief クリップ処理で切り取った多角形の数
+     */
+    uint64_t clip_polygons = 0;
+
+    /** @brief クリップ結果のバイト数
+     */
+    uint64_t clip_output_bytes = 0;
+
+    /** @brief BCollector::run() の時間
+     */
+    uint64_t clip_bcollect_time = 0;
+
+    /** @brief Clipper::collect_polygons() の時間
+     */
+    uint64_t clip_polygons_time = 0;
+
+    /** @brief Clipper::Result の時間
+     */
+    uint64_t clip_result_time = 0;
+
+
+    /** @brief 唯一のインスタンス
+     */
+    static Stats instance;
+
+};
+
+
+inline Stats Stats::instance;
+
+} // namespace b3dtile
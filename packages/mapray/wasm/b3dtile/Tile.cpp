@@ -2,8 +2,13 @@
 #include "Tile/Base.hpp"
 #include "Tile/Analyzer.hpp"
 #include "Tile/DescDepth.hpp"
+#include "Tile/TriTree.hpp"
 #include "Tile/Clipper.hpp"
+#include "Tile/ClipJob.hpp"
 #include "Tile/RaySolver.hpp"
+#include <memory>  // for make_unique()
+#include <array>
+#include <cstring>  // for memcpy()
 #include <cassert>
 
 
@@ -14,6 +19,17 @@ Tile::Tile( size_t size )
 {
     // バイナリデータをコピー (JS の ArrayBuffer から data_ へ)
     binary_copy_( data_ );
+
+    commit();
+}
+
+
+Tile::Tile( size_t size,
+            deferred_copy_t )
+    : data_{ new byte_t[size] }
+{
+    // クライアントが get_write_position() の位置にデータを書き込んだ後に
+    // commit() を呼び出す
 }
 
 
@@ -23,6 +39,22 @@ Tile::~Tile()
 }
 
 
+void
+Tile::commit()
+{
+    assert( !adata_ );
+
+    // ヘッダーを解析して、その結果をすべての問い合わせで使う
+    adata_ = std::make_unique<const Analyzer>( data_ );
+
+    // 三角形ツリーを展開して、その結果をすべての問い合わせで使う
+    tri_tree_ = std::make_unique<const TriTree>( *adata_ );
+
+    // レイ問い合わせの作業領域を確保しておく
+    ray_solver_ = std::make_unique<RaySolver>( *adata_, *tri_tree_ );
+}
+
+
 int
 Tile::get_descendant_depth( double  x,
                             double  y,
@@ -44,19 +76,137 @@ Tile::clip( float    x,
 
     const auto clip_rect = Base::rect_t::create_cube( { x, y, z }, size );
 
-    const Analyzer analyzer{ data_ };
+    if ( clip_rect.includes( Base::TILE_RECT ) ) {
+        /* タイルは clip_rect に包含される */
+        // タイル全体を返す (最適化)
+        clip_whole_tile();
+    }
+    else {
+        /* タイルは clip_rect からはみ出している */
+        // クリッピング結果を返す
+        Clipper{ *adata_, *tri_tree_, clip_rect }.run( clip_arena_ );
+    }
+}
+
+
+size_t
+Tile::clip_prepare( float    x,
+                    float    y,
+                    float    z,
+                    float size ) const
+{
+    assert( size > 0 );
+
+    const auto clip_rect = Base::rect_t::create_cube( { x, y, z }, size );
+
+    clip_pending_exists_ = true;
 
     if ( clip_rect.includes( Base::TILE_RECT ) ) {
-        /* タイルは clip_rect に包含されている */
-        // タイルのデータをそのまま返す (最適化)
-        clip_result_( static_cast<wasm_i32_t>( analyzer.num_vertices ),
-                      static_cast<wasm_i32_t>( analyzer.num_triangles ),
-                      analyzer.positions );
+        /* タイルは clip_rect に包含される */
+        // タイル全体を返す
+        clip_pending_.reset();
+        clip_pending_format_ = clip_vertex_format_;
+        return get_whole_tile_size( clip_pending_format_ );
+    }
+    else {
+        /* タイルは clip_rect からはみ出している */
+        clip_pending_ = std::make_unique<Clipper>( *adata_, *tri_tree_, clip_rect );
+        return clip_pending_->prepare();
+    }
+}
+
+
+void
+Tile::clip_write( void* buffer ) const
+{
+    assert( clip_pending_exists_ );
+    clip_pending_exists_ = false;
+
+    if ( clip_pending_ ) {
+        clip_pending_->write( static_cast<byte_t*>( buffer ) );
+        clip_pending_.reset();
     }
     else {
+        // タイル全体を書き込む
+        write_whole_tile( clip_pending_format_, buffer );
+    }
+}
+
+
+void
+Tile::clip_octants( float    x,
+                    float    y,
+                    float    z,
+                    float size ) const
+{
+    assert( size > 0 );
+
+    const auto clip_rect = Base::rect_t::create_cube( { x, y, z }, size );
+
+    // 子の立方体
+    constexpr size_t num_octants = 1u << DIM;
+
+    std::array<Base::rect_t, num_octants> octant_rects;
+
+    bool includes_tile = false;
+
+    for ( size_t oi = 0; oi < num_octants; ++oi ) {
+        octant_rects[oi] = Base::get_child_rect( clip_rect, oi );
+        includes_tile = includes_tile || octant_rects[oi].includes( Base::TILE_RECT );
+    }
+
+    if ( includes_tile ) {
+        // タイル全体を返す子が存在するので、子ごとに処理 (まれなケース)
+        for ( const auto& rect : octant_rects ) {
+            clip( rect.lower[0], rect.lower[1], rect.lower[2], rect.upper[0] - rect.lower[0] );
+        }
+    }
+    else {
+        // すべての子をまとめて処理
+        Clipper{ *adata_, *tri_tree_, clip_rect }.run_octants( clip_arena_ );
+    }
+}
+
+
+Tile::ClipJob::ClipJob( const Tile& tile,
+                        float          x,
+                        float          y,
+                        float          z,
+                        float       size )
+    : tile_{ tile }
+{
+    assert( size > 0 );
+
+    const auto clip_rect = rect_t::create_cube( { x, y, z }, size );
+
+    if ( !clip_rect.includes( TILE_RECT ) ) {
         /* タイルは clip_rect からはみ出している */
+        clipper_ = std::make_unique<Clipper>( *tile.adata_, *tile.tri_tree_, clip_rect, Clipper::resumable_t{} );
+    }
+}
+
+
+Tile::ClipJob::~ClipJob() = default;
+
+
+bool
+Tile::ClipJob::step( size_t max_triangles )
+{
+    return clipper_ ? clipper_->step( max_triangles ) : true;
+}
+
+
+void
+Tile::ClipJob::finish()
+{
+    if ( clipper_ ) {
         // クリッピング結果を返す
-        Clipper{ analyzer, clip_rect }.run();
+        clipper_->run( tile_.clip_arena_ );
+        clipper_.reset();
+    }
+    else {
+        // タイル全体を返す
+        tile_.clip_whole_tile();
     }
 }
 
@@ -67,9 +217,104 @@ Tile::find_ray_distance( const coords_t<double, DIM>& ray_pos,
                          double                         limit,
                          const Rect<float, DIM>&        lrect ) const
 {
-    const Analyzer analyzer{ data_ };
+    const auto result = ray_solver_->run( ray_pos, ray_dir, limit, lrect );
+
+    // 結果を JavaScript 側に通知
+    ray_result_( static_cast<wasm_f64_t>( result.distance ),
+                 static_cast<wasm_f64_t>( result.feature_id[0] ),
+                 static_cast<wasm_f64_t>( result.feature_id[1] ) );
+}
+
+
+void
+Tile::find_ray_distance_many( size_t            num_rays,
+                              const wasm_f64_t*     rays,
+                              wasm_f64_t*        results ) const
+{
+    ray_solver_->run_many( num_rays, rays, results );
+}
+
+
+bool
+Tile::test_ray_occluded( const coords_t<double, DIM>& ray_pos,
+                         const coords_t<double, DIM>& ray_dir,
+                         double                         limit,
+                         const Rect<float, DIM>&        lrect ) const
+{
+    return ray_solver_->test_occluded( ray_pos, ray_dir, limit, lrect );
+}
+
+
+void
+Tile::test_ray_occluded_many( size_t            num_rays,
+                              const wasm_f64_t*     rays,
+                              wasm_i32_t*        results ) const
+{
+    ray_solver_->test_occluded_many( num_rays, rays, results );
+}
+
+
+size_t
+Tile::find_ray_hits( const wasm_f64_t* ray,
+                     size_t       max_hits,
+                     wasm_f64_t*      hits ) const
+{
+    return ray_solver_->find_hits( ray, max_hits, hits );
+}
+
 
-    RaySolver{ analyzer, ray_pos, ray_dir, limit, lrect }.run();
+void
+Tile::clip_whole_tile() const
+{
+    const Analyzer& analyzer = *adata_;
+
+    if ( clip_vertex_format_ == ClipVertexFormat::SEPARATE ) {
+        // 結果はタイルデータと同じ形式なので、そのまま返す
+        clip_result_( static_cast<wasm_i32_t>( analyzer.num_vertices ),
+                      static_cast<wasm_i32_t>( analyzer.num_triangles ),
+                      analyzer.positions );
+    }
+    else {
+        // タイルの配列を clip_arena_ にまとめて返す
+        const size_t buffer_size = Clipper::get_tile_interleaved_size( analyzer );
+
+        if ( clip_arena_.size() < buffer_size ) {
+            clip_arena_.resize( buffer_size );
+        }
+
+        Clipper::write_tile_interleaved( analyzer, clip_arena_.data() );
+    }
+}
+
+
+size_t
+Tile::get_whole_tile_size( ClipVertexFormat format ) const
+{
+    const Analyzer& analyzer = *adata_;
+
+    return (format == ClipVertexFormat::SEPARATE) ?
+           Clipper::get_tile_buffer_size( analyzer ) :
+           Clipper::get_tile_interleaved_size( analyzer );
+}
+
+
+void
+Tile::write_whole_tile( ClipVertexFormat format,
+                        void*            buffer ) const
+{
+    const Analyzer& analyzer = *adata_;
+
+    if ( format == ClipVertexFormat::SEPARATE ) {
+        // タイルのデータをそのままコピー
+        std::memcpy( buffer, analyzer.positions, Clipper::get_tile_buffer_size( analyzer ) );
+
+        clip_result_( static_cast<wasm_i32_t>( analyzer.num_vertices ),
+                      static_cast<wasm_i32_t>( analyzer.num_triangles ),
+                      buffer );
+    }
+    else {
+        Clipper::write_tile_interleaved( analyzer, static_cast<byte_t*>( buffer ) );
+    }
 }
 
 } // namespace b3dtile
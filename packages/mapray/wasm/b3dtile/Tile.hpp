@@ -3,6 +3,8 @@
 #include "Rect.hpp"
 #include "wasm_types.hpp"
 #include <array>
+#include <vector>
+#include <memory>   // for unique_ptr
 #include <limits>
 #include <cstddef>  // for size_t
 
@@ -26,6 +28,8 @@ class Tile {
     class Analyzer;
     class BCollector;
     class Clipper;
+    class ClipJob;
+    class TriTree;
     class TriNode;
     class RaySolver;
 
@@ -35,6 +39,81 @@ class Tile {
     static constexpr int DIM = 3;
 
 
+    /** @brief 構築子でデータをコピーしないことを指定する型
+     *
+     *  @see Tile( size_t, deferred_copy_t )
+     */
+    struct deferred_copy_t {};
+
+
+    /** @brief find_ray_distance_many() のレイ配列における 1 本のレイの要素数
+     *
+     *  レイ配列は 1 本のレイごとに次の順序で要素が並ぶ。
+     *
+     *  { ray_px, ray_py, ray_pz, ray_dx, ray_dy, ray_dz, limit,
+     *    lrect_ox, lrect_oy, lrect_oz, lrect_size }
+     *
+     *  各要素の意味は b3dtile.cpp の tile_find_ray_distance() の同名パラメー
+     *  タと同じである。
+     */
+    static constexpr size_t RAY_NUM_ELEMS = 11;
+
+
+    /** @brief find_ray_distance_many() の結果配列における 1 つの結果の要素数
+     *
+     *  結果配列は 1 本のレイごとに次の順序で要素が並ぶ。
+     *
+     *  { distance, id_0, id_1 }
+     *
+     *  各要素の意味は ray_result_func_t の同名パラメータと同じである。
+     */
+    static constexpr size_t RAY_RESULT_NUM_ELEMS = 3;
+
+
+    /** @brief find_ray_hits() の交点配列における 1 つの交点の要素数
+     *
+     *  交点配列は 1 つの交点ごとに次の順序で要素が並ぶ。
+     *
+     *  { distance, triangle, id_0, id_1 }
+     *
+     *  triangle は交差した三角形のインデックスである。その他の要素の意味は
+     *  ray_result_func_t の同名パラメータと同じである。
+     */
+    static constexpr size_t RAY_HIT_NUM_ELEMS = 4;
+
+
+    /** @brief clip() の結果の頂点属性の形式
+     *
+     *  @see set_clip_vertex_format()
+     */
+    enum class ClipVertexFormat {
+
+        /** @brief 頂点属性ごとの配列
+         *
+         *  { POSITIONS, TRIANGLES, N_ARRAY, TC_ARRAY } の順に並ぶ。
+         */
+        SEPARATE = 0,
+
+        /** @brief 頂点属性をまとめた配列
+         *
+         *  { VERTICES, TRIANGLES } の順に並ぶ。VERTICES は 1 頂点ごとに
+         *  POSITIONS, N_ARRAY, TC_ARRAY の要素を並べた配列で、各属性は 4 バ
+         *  イト境界に揃える (詰め物は 0)。
+         *
+         *  属性のオフセットと頂点のバイト数 (ストライド) は CONTENTS の値で決
+         *  まる。
+         *
+         *  - position: オフセット 0 (uint16 x 3 + 詰め物 2 バイト)
+         *  - normal:   N_ARRAY が存在するとき position の後 (int8 x 3 + 詰め物 1 バイト)
+         *  - texcoord: TC_ARRAY が存在するとき最後 (uint16 x 2)
+         *
+         *  1 つの GPU バッファとしてそのまま転送できる。
+         */
+        INTERLEAVED = 1,
+
+    };
+
+
   public:
     /** @brief タイルデータをコピーする関数の型
      *
@@ -58,7 +137,11 @@ class Tile {
      *  の部分と同じ形式で格納されている。ただし、存在するデータは CONTENTS の値
      *  に従う。
      *
-     *  この関数から出たあとは data のメモリーが解放される可能性がある。
+     *  set_clip_vertex_format() で ClipVertexFormat::INTERLEAVED を指定したと
+     *  きは、その形式で格納されている。
+     *
+     *  この関数から出たあとは data のメモリーが解放または再利用される可能性が
+     *  ある。
      *
      *  @param num_vertices   頂点数
      *  @param num_triangles  三角形数
@@ -105,21 +188,72 @@ class Tile {
     }
 
 
+    /** @brief clip() の結果の頂点属性の形式を設定
+     *
+     *  すべてのインスタンスの clip() などの結果に適用される。既定値は
+     *  ClipVertexFormat::SEPARATE である。
+     */
+    static void
+    set_clip_vertex_format( ClipVertexFormat format )
+    {
+        clip_vertex_format_ = format;
+    }
+
+
     /** @brief 初期化
      *
      *  コピー処理は binary_copy() を呼び出して行う。
      *
+     *  コピーしたデータはここで解析され、その結果は各問い合わせで共有される。
+     *
      *  @param size  バイナリデータのバイト数
      */
     explicit
     Tile( size_t size );
 
 
+    /** @brief 初期化 (データは後で書き込む)
+     *
+     *  size バイトの領域を確保するが binary_copy() は呼び出さない。
+     *
+     *  クライアントは get_write_position() で得たアドレスにタイルのバイナリデー
+     *  タを書き込み、その後に commit() を呼び出さなければならない。
+     *
+     *  commit() を呼び出すまでは、このクラスの他のメソッドを呼び出すことはでき
+     *  ない。ただし、デストラクタはいつでも呼び出すことができる。
+     *
+     *  @param size  バイナリデータのバイト数
+     */
+    Tile( size_t size,
+          deferred_copy_t );
+
+
     /** @brief 後処理
      */
     ~Tile();
 
 
+    /** @brief バイナリデータの書き込み位置を取得
+     *
+     *  Tile( size_t, deferred_copy_t ) で構築したときに、データを書き込むため
+     *  の領域 (size バイト) の先頭アドレスを返す。
+     */
+    byte_t*
+    get_write_position() { return data_; }
+
+
+    /** @brief 書き込みを完了
+     *
+     *  get_write_position() の領域に書き込まれたバイナリデータを解析して、タイ
+     *  ルを使用可能な状態にする。
+     *
+     *  @pre Tile( size_t, deferred_copy_t ) で構築され、commit() は呼び出され
+     *       ていない
+     */
+    void
+    commit();
+
+
     /** @brief 子孫の最大深度を取得
      *
      *  パラメータは基本的に B3dBinary#getDescendantDepth() と同等である。
@@ -153,6 +287,58 @@ class Tile {
           float size ) const;
 
 
+    /** @brief 指定領域で切り取った結果のバイト数を計算
+     *
+     *  clip() を呼び出し側が用意した領域に出力するための前半の処理である。続
+     *  けて clip_write() を呼び出して結果を書き込む。
+     *
+     *  パラメータは clip() と同じである。
+     *
+     *  @return clip_result() に渡すデータのバイト数
+     *
+     *  @pre size > 0
+     */
+    size_t
+    clip_prepare( float    x,
+                  float    y,
+                  float    z,
+                  float size ) const;
+
+
+    /** @brief clip_prepare() で準備した結果を書き込む
+     *
+     *  buffer から clip_prepare() が返したバイト数の領域に結果を書き込み、
+     *  clip_result() に buffer を渡して返す。
+     *
+     *  clip() と違い、結果は buffer 以外の領域を経由しない。
+     *
+     *  @param buffer  出力先 (4 バイト境界に揃っていること)
+     *
+     *  @pre 直前に clip_prepare() を呼び出し、その後 clip_write() を呼び出し
+     *       ていない
+     */
+    void
+    clip_write( void* buffer ) const;
+
+
+    /** @brief 指定領域を 8 分割した領域ごとに切り取る
+     *
+     *  指定領域を各軸の中央で分割した 8 個の立方体ごとに clip() と同じ処理を
+     *  行う。ただしタイルの三角形の収集と内外判定は 1 回だけ行う。
+     *
+     *  結果は子の立方体ごとに、子インデックス u + 2v + 4w (u, v, w は各軸の
+     *  下半分のとき 0, 上半分のとき 1) の順に clip_result() を 8 回呼び出して
+     *  返す。各結果は三角形の順序を除いて clip() と同じである。
+     *
+     *  @pre size > 0
+     */
+    void
+    clip_octants( float    x,
+                  float    y,
+                  float    z,
+                  float size ) const;
+
+
     /** @brief タイル内の三角形とレイとの交点を探す
      *
      *  パラメータの座標系は ALCS を想定している。
@@ -166,17 +352,154 @@ class Tile {
                        const Rect<float, DIM>&      lrect ) const;
 
 
+    /** @brief レイがタイル内の三角形で遮蔽されるかを判定
+     *
+     *  パラメータは find_ray_distance() と同じである。
+     *
+     *  find_ray_distance() で交差が見つかるときに true を返す。ただし最初に見
+     *  つかった交差で処理を終了し、feature ID も求めないので高速である。
+     *
+     *  ray_result() は呼び出されない。
+     */
+    bool
+    test_ray_occluded( const coords_t<double, DIM>& ray_pos,
+                       const coords_t<double, DIM>& ray_dir,
+                       double                       limit,
+                       const Rect<float, DIM>&      lrect ) const;
+
+
+    /** @brief 複数のレイに対して test_ray_occluded() を実行
+     *
+     *  rays に格納された num_rays 本のレイに対して test_ray_occluded() と同じ
+     *  処理を行い、その結果 (遮蔽されるとき 1, それ以外は 0) を results に格納
+     *  する。
+     *
+     *  @param num_rays  レイの数
+     *  @param rays      レイ配列 (形式は find_ray_distance_many() と同じ)
+     *  @param results   結果配列 (要素数 num_rays)
+     */
+    void
+    test_ray_occluded_many( size_t            num_rays,
+                            const wasm_f64_t*     rays,
+                            wasm_i32_t*        results ) const;
+
+
+    /** @brief 複数のレイに対して find_ray_distance() を実行
+     *
+     *  rays に格納された num_rays 本のレイに対して find_ray_distance() と同じ
+     *  処理を行い、その結果を results に格納する。
+     *
+     *  ray_result() は呼び出されない。
+     *
+     *  レイは最大 16 本ずつのパケットにまとめて処理される。パケット内で同じ葉
+     *  ノードを通過するレイは三角形の読み込みを共有するので、近接したレイを連
+     *  続して格納すると効率が良い。結果は find_ray_distance() と同じである。
+     *
+     *  @param num_rays  レイの数
+     *  @param rays      レイ配列 (要素数 RAY_NUM_ELEMS * num_rays)
+     *  @param results   結果配列 (要素数 RAY_RESULT_NUM_ELEMS * num_rays)
+     */
+    void
+    find_ray_distance_many( size_t            num_rays,
+                            const wasm_f64_t*     rays,
+                            wasm_f64_t*        results ) const;
+
+
+    /** @brief レイとタイル内の三角形とのすべての交点を探す
+     *
+     *  ray に格納された 1 本のレイと交差するすべての三角形を、交点が近い順に
+     *  hits に格納する。ただし格納するのは最も近い max_hits 個までである。
+     *
+     *  交差の判定は find_ray_distance() と同じである。したがって格納される交
+     *  点の距離 t は 0 < t < limit の範囲であり、t == limit の交点は含まれな
+     *  い。複数の三角形ブロックから参照される三角形は 1 回だけ格納される。
+     *
+     *  交点までの距離が同じときは三角形インデックスの順に格納される。
+     *
+     *  先頭の交点は find_ray_distance() の結果と一致するとは限らない。
+     *  find_ray_distance() はツリーをレイに沿って辿り、交点が見つかった最初の
+     *  葉で探索を終えるので、後の葉にある三角形のほうが近いことがあるからであ
+     *  る。このとき find_ray_distance() の交点は hits の 2 番目以降に含まれ、先
+     *  頭の交点の距離はそれ以下になる。
+     *
+     *  @param ray       レイ (要素数 RAY_NUM_ELEMS, 形式は find_ray_distance_many() と同じ)
+     *  @param max_hits  格納する交点の最大数
+     *  @param hits      交点配列 (要素数 RAY_HIT_NUM_ELEMS * max_hits)
+     *
+     *  @return 交点の総数 (max_hits より大きいことがある)
+     */
+    size_t
+    find_ray_hits( const wasm_f64_t* ray,
+                   size_t       max_hits,
+                   wasm_f64_t*      hits ) const;
+
+
     Tile( const Tile& ) = delete;
     void operator=( const Tile& ) = delete;
 
 
+  private:
+    /** @brief タイル全体をクリップ結果として返す
+     *
+     *  クリップ直方体がタイル全体を包含するときの clip() の処理である。三角形
+     *  の内外判定は行わない (Clipper を使わない)。
+     *
+     *  ClipVertexFormat::SEPARATE のときはタイルのデータをそのまま返し、
+     *  ClipVertexFormat::INTERLEAVED のときはタイルの配列を clip_arena_ にま
+     *  とめて返す。clip_arena_ はすべてのタイルで共有するので、タイルごとに
+     *  データの複製が残ることはない。
+     */
+    void
+    clip_whole_tile() const;
+
+
+    /** @brief タイル全体のクリップ結果のバイト数
+     *
+     *  format の形式で write_whole_tile() が書き込むバイト数である。
+     */
+    size_t
+    get_whole_tile_size( ClipVertexFormat format ) const;
+
+
+    /** @brief タイル全体のクリップ結果を書き込む
+     *
+     *  clip_whole_tile() と同じだが、buffer から get_whole_tile_size() バイト
+     *  の領域に format の形式で書き込み、buffer を clip_result() に渡す。
+     */
+    void
+    write_whole_tile( ClipVertexFormat format,
+                      void*            buffer ) const;
+
+
   private:
     byte_t* const data_;  // タイルデータのバイト列
 
+    // data_ の解析結果 (データが揃ったときに一度だけ解析する)
+    std::unique_ptr<const Analyzer> adata_;
+
+    // adata_ の三角形ツリーを展開したもの (adata_ と同時に構築する)
+    std::unique_ptr<const TriTree> tri_tree_;
+
+    // レイ問い合わせの処理 (作業領域を問い合わせ間で再利用する)
+    std::unique_ptr<RaySolver> ray_solver_;
+
+    // clip_prepare() で準備したクリップ処理 (タイル全体のときは null)
+    mutable std::unique_ptr<Clipper> clip_pending_;
+    mutable bool            clip_pending_exists_ = false;
+    mutable ClipVertexFormat clip_pending_format_;  // タイル全体のときの形式
+
     static inline binary_copy_func_t* binary_copy_;
     static inline clip_result_func_t* clip_result_;
     static inline ray_result_func_t*   ray_result_;
 
+    static inline ClipVertexFormat clip_vertex_format_ = ClipVertexFormat::SEPARATE;
+
+    // clip() の結果の出力先 (すべてのタイルのクリップで再利用する)
+    //
+    // 結果は clip_result() の中で消費されるので、モジュールで 1 つあればよい。
+    // タイルごとに持つと、キャッシュされたタイルの数だけクリップ結果が残る。
+    static inline std::vector<byte_t> clip_arena_;
+
     // ES6 の Uint8Array との一致を確認
     static_assert( std::numeric_limits<byte_t>::digits == 8 );
 
@@ -2,6 +2,7 @@
 
 #include "Base.hpp"
 #include "Analyzer.hpp"
+#include "TriNode.hpp"
 #include "../HashSet.hpp"
 #include <vector>
 #include <cassert>
@@ -14,7 +15,7 @@ namespace b3dtile {
  *  clip_rect と交差するノードの三角形ブロックを収集する。
  *
  *  run() を実行した後に、以下のメンバー変数にアクセスできる。ただし構築子に
- *  与えた adata の参照先は存続していなければならない。
+ *  与えた adata と tri_tree の参照先は存続していなければならない。
  *
  *   - num_tblocks
  *   - tblock_table
@@ -32,11 +33,13 @@ class Tile::BCollector : Base {
   public:
     /** @brief 初期化
      *
-     *  adata は参照のみを保持すること注意すること。
+     *  adata と tri_tree は参照のみを保持すること注意すること。
      */
     BCollector( const Analyzer&   adata,
+                const TriTree& tri_tree,
                 const rect_t& clip_rect )
         : adata_{ adata },
+          tri_tree_{ tri_tree },
           clip_rect_{ clip_rect },
           num_tblocks{ 0 },
           tblock_table{ nullptr }
@@ -59,7 +62,7 @@ class Tile::BCollector : Base {
             /* ツリーが存在する */
 
             // トラバース
-            traverse_branch( adata_.root_node, TILE_RECT );
+            traverse_branch( TriNode{ tri_tree_ }, TILE_RECT );
 
             // 本来のブロックを使う
             num_tblocks  = adata_.num_tblocks;
@@ -93,108 +96,52 @@ class Tile::BCollector : Base {
   private:
     /** @brief 枝ノードをトラバース
      */
-    const byte_t*
-    traverse_branch( const byte_t* node_data,
+    void
+    traverse_branch( const TriNode& tri_node,
                      const rect_t& node_rect )
     {
-        // 三角形ツリーのノード種類
-        enum class NodeType {
-            NONE   = 0,
-            BRANCH = 1,
-            LEAF   = 2,
-        };
-
-        const byte_t* cursor = node_data;
-
-        // TREE_SIZE
-        size_t tree_size = read_value<uint16_t>( cursor );
-
-        // CHILDREN
-        const unsigned children = read_value<uint16_t>( cursor );
-
-        if ( tree_size == 0 ) {
-            // TREE_SIZE_EX
-            tree_size = read_value<uint32_t>( cursor );
-        }
-
         for ( int w = 0; w < 2; ++w ) {
             for ( int v = 0; v < 2; ++v ) {
                 for ( int u = 0; u < 2; ++u ) {
-                    const int child_index = u + 2*v + 4*w;
-                    const auto  node_type = static_cast<NodeType>( (children >> (2 * child_index)) & 0b11u );
-
-                    if ( node_type == NodeType::BRANCH ) {
-                        const auto child_rect = get_child_rect( node_rect, { u, v, w } );
-                        if ( child_rect.is_cross( clip_rect_ ) ) {
-                            cursor = traverse_branch( cursor, child_rect );
-                        }
-                        else {
-                            cursor = skip_branch( cursor );
-                        }
+                    const auto child_node = tri_node.get_child( u + 2*v + 4*w );
+
+                    if ( child_node.is_none() ) {
+                        // 子ノードがないときは何もしない
+                        continue;
                     }
-                    else if ( node_type == NodeType::LEAF ) {
-                        const auto child_rect = get_child_rect( node_rect, { u, v, w } );
-                        if ( child_rect.is_cross( clip_rect_ ) ) {
-                            cursor = traverse_leaf( cursor );
-                        }
-                        else {
-                            cursor = skip_leaf( cursor );
-                        }
+
+                    const auto child_rect = get_child_rect( node_rect, { u, v, w } );
+
+                    if ( !child_rect.is_cross( clip_rect_ ) ) {
+                        // clip_rect と交差しない子ノードは無視
+                        continue;
+                    }
+
+                    if ( child_node.is_branch_type() ) {
+                        traverse_branch( child_node, child_rect );
                     }
                     else {
-                        assert( node_type == NodeType::NONE );
-                        // 子ノードがないときは何もしない
+                        assert( child_node.is_leaf_type() );
+                        traverse_leaf( child_node );
                     }
                 }
             }
         }
-
-        assert( cursor == node_data + WORD_SIZE * tree_size );
-        return cursor;
-    }
-
-
-    /** @brief 枝ノードを読み飛ばし
-     */
-    const byte_t*
-    skip_branch( const byte_t* node_data ) const
-    {
-        const byte_t* cursor = node_data;
-
-        // TREE_SIZE
-        size_t tree_size = read_value<uint16_t>( cursor );
-
-        // CHILDREN
-        read_value<uint16_t>( cursor );
-
-        if ( tree_size == 0 ) {
-            // TREE_SIZE_EX
-            tree_size = read_value<uint32_t>( cursor );
-        }
-
-        return node_data + WORD_SIZE * tree_size;
     }
 
 
     /** @brief 葉ノードをトラバース
      */
-    const byte_t*
-    traverse_leaf( const byte_t* node_data )
+    void
+    traverse_leaf( const TriNode& tri_node )
     {
-        const byte_t* cursor = node_data;
-
-        // NUM_BLOCKS
-        const size_t num_blocks = read_value<uint32_t>( cursor );
-
         // BLOCK_INDICES
         if ( adata_.bindex_size == sizeof( uint16_t ) ) {
-            cursor = get_tblock_indices<uint16_t>( cursor, num_blocks );
+            get_tblock_indices<uint16_t>( tri_node );
         }
         else {
-            cursor = get_tblock_indices<uint32_t>( cursor, num_blocks );
+            get_tblock_indices<uint32_t>( tri_node );
         }
-
-        return cursor;
     }
 
 
@@ -202,18 +149,14 @@ class Tile::BCollector : Base {
      *
      *  @tparam BiType  三角形ブロックインデックスの型
      *
-     *  @param bindices_data  TBLOCK インデックス配列の開始ポインタ
-     *  @param num_blocks     配列の要素数
-     *
-     *  @return 次の読み込みポインタ
+     *  @param tri_node  葉ノード
      */
     template<typename BiType>
-    const byte_t*
-    get_tblock_indices( const byte_t* bindices_data,
-                        size_t           num_blocks )
+    void
+    get_tblock_indices( const TriNode& tri_node )
     {
-        const auto begin = get_pointer<BiType>( bindices_data );
-        const auto   end = begin + num_blocks;
+        const auto begin = tri_node.get_tblock_indices<BiType>();
+        const auto   end = begin + tri_node.num_tblocks();
 
         for ( auto it = begin; it != end; ++it ) {
             const size_t bindex = *it;
@@ -221,30 +164,12 @@ class Tile::BCollector : Base {
                 collected_tblocks.push_back( bindex );
             }
         }
-
-        return bindices_data + get_aligned<4>( sizeof( BiType ) * num_blocks );
-    }
-
-
-    /** @brief 葉ノードをトラバース
-     */
-    const byte_t*
-    skip_leaf( const byte_t* node_data ) const
-    {
-        const byte_t* cursor = node_data;
-
-        // NUM_BLOCKS
-        const size_t num_blocks = read_value<uint32_t>( cursor );
-
-        // BLOCK_INDICES
-        cursor += get_aligned<4>( adata_.bindex_size * num_blocks );
-
-        return cursor;
     }
 
 
   private:
     const Analyzer&  adata_;
+    const TriTree& tri_tree_;
     const rect_t clip_rect_;
 
     // 三角形ブロックの重複を除去するための一時情報
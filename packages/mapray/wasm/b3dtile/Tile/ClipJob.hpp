@@ -0,0 +1,76 @@
+﻿#pragma once
+
+#include "Base.hpp"
+#include <memory>  // for unique_ptr
+
+
+namespace b3dtile {
+
+/** @brief 再開可能なクリップ処理
+ *
+ *  Tile::clip() と同じ処理を、step() で三角形数を制限しながら少しずつ進め、
+ *  finish() で結果を clip_result() に通知する。大きなタイルのクリップを複数
+ *  のフレームに分けて処理するために使う。
+ *
+ *  クリップ直方体がタイル全体を包含するときは step() で処理することはない。
+ *
+ *  インスタンスを破棄するまで、構築に使った Tile インスタンスは破棄してはな
+ *  らない。
+ */
+class Tile::ClipJob : Base {
+
+  public:
+    /** @brief 初期化
+     *
+     *  パラメータは Tile::clip() と同じである。
+     *
+     *  クリップ直方体と交差する三角形ブロックの収集も最初の step() で行うの
+     *  で、構築は軽い処理である。
+     *
+     *  @pre size > 0
+     */
+    ClipJob( const Tile& tile,
+             float          x,
+             float          y,
+             float          z,
+             float       size );
+
+
+    ~ClipJob();
+
+
+    /** @brief 処理を進める
+     *
+     *  最大 max_triangles 個の三角形を処理する。
+     *
+     *  @return  残りの処理が finish() だけになったとき true, それ以外のとき
+     *           false
+     */
+    bool
+    step( size_t max_triangles );
+
+
+    /** @brief 処理を完了
+     *
+     *  残りの処理を行い、結果を clip_result() で通知する。step() が true を返
+     *  す前に呼び出してもよい。
+     *
+     *  finish() を呼び出した後は、このインスタンスを破棄することしかできない。
+     */
+    void
+    finish();
+
+
+    ClipJob( const ClipJob& ) = delete;
+    void operator=( const ClipJob& ) = delete;
+
+
+  private:
+    const Tile& tile_;
+
+    // クリップ処理 (タイル全体のときは null)
+    std::unique_ptr<Clipper> clipper_;
+
+};
+
+} // namespace b3dtile
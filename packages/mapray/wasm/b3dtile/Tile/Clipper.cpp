@@ -1,5 +1,7 @@
 ﻿#include "Clipper.hpp"
+#include <algorithm>  // for clamp(), fill(), copy_n()
 #include <limits>
+#include <cmath>      // for ceil()
 
 
 namespace b3dtile {
@@ -8,44 +10,315 @@ using Clipper = Tile::Clipper;
 
 
 Clipper::Clipper( const Analyzer&   adata,
+                  const TriTree& tri_tree,
                   const rect_t& clip_rect )
     : adata_{ adata },
-      bcollect_{ adata, clip_rect },
-      index_map_A_{ adata.num_vertices }
+      bcollect_{ adata, tri_tree, clip_rect },
+      alcs_clip_rect_{ clip_rect },
+      clip_rect_{ get_u16_clip_rect( clip_rect ) },
+      clip_irect_{ get_int_clip_rect( clip_rect_ ) },
+      parts_{ adata.num_vertices }
 {
-    bcollect_.run();
+    collect_tblocks();
+}
+
+
+Clipper::Clipper( const Analyzer&   adata,
+                  const TriTree& tri_tree,
+                  const rect_t& clip_rect,
+                  resumable_t )
+    : adata_{ adata },
+      bcollect_{ adata, tri_tree, clip_rect },
+      alcs_clip_rect_{ clip_rect },
+      clip_rect_{ get_u16_clip_rect( clip_rect ) },
+      clip_irect_{ get_int_clip_rect( clip_rect_ ) },
+      parts_{ adata.num_vertices, true }
+{
+    // 三角形ブロックの収集は最初の step() または prepare() で行う
+}
 
-    // clip_rect_ の座標系の変換と境界調整
-    for ( size_t i = 0; i < DIM; ++i ) {
-        clip_rect_.lower[i] = ALCS_TO_U16<> * clip_rect.lower[i];
-        clip_rect_.upper[i] = (clip_rect.upper[i] < 1) ?
-                              (ALCS_TO_U16<> * clip_rect.upper[i]) :
-                              ALCS_TO_U16<> * (1 + std::numeric_limits<real_t>::epsilon());
 
-        // タイル生成時の最後の数値丸めにより clip_rect.upper[x] == 1 の面に張り
-        // 付いている三角形が存在することがある。もともと開区間のタイル内に入っ
-        // ていたはずなので、タイル内に存在するように見せるための調整をしている
+void
+Clipper::run( std::vector<byte_t>& arena )
+{
+    const size_t buffer_size = prepare();
+
+    if ( arena.size() < buffer_size ) {
+        arena.resize( buffer_size );
     }
+
+    write( arena.data() );
 }
 
 
 void
-Clipper::run()
+Clipper::run_octants( std::vector<byte_t>& arena )
+{
+    Stats::add( &Stats::clip_calls, NUM_OCTANTS );
+
+    for ( size_t oi = 0; oi < NUM_OCTANTS; ++oi ) {
+        octant_rects_[oi]  = get_u16_clip_rect( get_child_rect( alcs_clip_rect_, oi ) );
+        octant_irects_[oi] = get_int_clip_rect( octant_rects_[oi] );
+    }
+
+    std::vector<Parts> octant_parts( NUM_OCTANTS, Parts{ adata_.num_vertices } );
+
+    {
+        Stats::Timer timer{ &Stats::clip_polygons_time };
+
+        if ( adata_.vindex_size == sizeof( uint16_t ) ) {
+            if ( adata_.tindex_size == sizeof( uint16_t ) )
+                collect_octant_polygons<uint16_t, uint16_t>( octant_parts );
+            else
+                collect_octant_polygons<uint16_t, uint32_t>( octant_parts );
+        }
+        else {
+            if ( adata_.tindex_size == sizeof( uint16_t ) )
+                collect_octant_polygons<uint32_t, uint16_t>( octant_parts );
+            else
+                collect_octant_polygons<uint32_t, uint32_t>( octant_parts );
+        }
+    }
+
+    for ( const auto& parts : octant_parts ) {
+        Stats::add( &Stats::clip_polygons, parts.polygons_B.size() );
+    }
+
+    {
+        Stats::Timer timer{ &Stats::clip_result_time };
+
+        for ( const auto& parts : octant_parts ) {
+            Result result{ adata_, parts };
+
+            if ( arena.size() < result.buffer_size() ) {
+                arena.resize( result.buffer_size() );
+            }
+
+            result.run( arena.data() );
+        }
+    }
+}
+
+
+bool
+Clipper::step( size_t max_triangles )
 {
+    if ( !tblocks_collected_ ) {
+        // 最初の呼び出しでは三角形ブロックの収集だけを行う
+        collect_tblocks();
+        return false;
+    }
+
+    Stats::Timer timer{ &Stats::clip_polygons_time };
+
     if ( adata_.vindex_size == sizeof( uint16_t ) ) {
         if ( adata_.tindex_size == sizeof( uint16_t ) )
-            collect_polygons<uint16_t, uint16_t>();
+            return collect_polygons_step<uint16_t, uint16_t>( max_triangles );
         else
-            collect_polygons<uint16_t, uint32_t>();
+            return collect_polygons_step<uint16_t, uint32_t>( max_triangles );
     }
     else {
         if ( adata_.tindex_size == sizeof( uint16_t ) )
-            collect_polygons<uint32_t, uint16_t>();
+            return collect_polygons_step<uint32_t, uint16_t>( max_triangles );
         else
-            collect_polygons<uint32_t, uint32_t>();
+            return collect_polygons_step<uint32_t, uint32_t>( max_triangles );
+    }
+}
+
+
+size_t
+Clipper::prepare()
+{
+    Stats::add( &Stats::clip_calls, 1 );
+
+    if ( !tblocks_collected_ ) {
+        // step() を呼び出さずに resumable_t で構築したとき
+        collect_tblocks();
+    }
+
+    if ( step_started_ ) {
+        // step() の残りの三角形を収集
+        step( std::numeric_limits<size_t>::max() );
+    }
+    else {
+        Stats::Timer timer{ &Stats::clip_polygons_time };
+
+        if ( adata_.vindex_size == sizeof( uint16_t ) ) {
+            if ( adata_.tindex_size == sizeof( uint16_t ) )
+                collect_polygons<uint16_t, uint16_t>();
+            else
+                collect_polygons<uint16_t, uint32_t>();
+        }
+        else {
+            if ( adata_.tindex_size == sizeof( uint16_t ) )
+                collect_polygons<uint32_t, uint16_t>();
+            else
+                collect_polygons<uint32_t, uint32_t>();
+        }
     }
 
-    Result{ *this }.run();
+    Stats::add( &Stats::clip_polygons, parts_.polygons_B.size() );
+
+    result_.emplace( adata_, parts_ );
+
+    return result_->buffer_size();
+}
+
+
+void
+Clipper::collect_tblocks()
+{
+    assert( !tblocks_collected_ );
+
+    {
+        Stats::Timer timer{ &Stats::clip_bcollect_time };
+        bcollect_.run();
+    }
+
+    Stats::add( &Stats::clip_tblocks, bcollect_.collected_tblocks.size() );
+
+    tblocks_collected_ = true;
+}
+
+
+void
+Clipper::write( byte_t* buffer )
+{
+    assert( result_ );
+
+    Stats::Timer timer{ &Stats::clip_result_time };
+    result_->run( buffer );
+}
+
+
+size_t
+Clipper::get_tile_buffer_size( const Analyzer& adata )
+{
+    const Layout layout{ adata, adata.num_vertices, adata.num_triangles, ClipVertexFormat::SEPARATE };
+
+    // タイルデータの配置と一致することを確認
+    assert( adata.vindex_size == layout.vindex_size );
+    assert( adata.triangles == get_tile_pointer( adata, layout.offset_triangles ) );
+    assert( !adata.n_array  || adata.n_array  == get_tile_pointer( adata, layout.offset_n_array ) );
+    assert( !adata.tc_array || adata.tc_array == get_tile_pointer( adata, layout.offset_tc_array ) );
+
+    return layout.buffer_size;
+}
+
+
+size_t
+Clipper::get_tile_interleaved_size( const Analyzer& adata )
+{
+    const Layout layout{ adata, adata.num_vertices, adata.num_triangles, ClipVertexFormat::INTERLEAVED };
+
+    return layout.buffer_size;
+}
+
+
+void
+Clipper::write_tile_interleaved( const Analyzer& adata,
+                                 byte_t*        buffer )
+{
+    assert( reinterpret_cast<uintptr_t>( buffer ) % 4 == 0 );
+
+    const size_t num_vertices = adata.num_vertices;
+    const Layout layout{ adata, num_vertices, adata.num_triangles, ClipVertexFormat::INTERLEAVED };
+
+    // 頂点インデックスの型はタイルデータと同じ
+    assert( layout.vindex_size == adata.vindex_size );
+
+    // 詰め物を 0 にする (頂点内の属性間の詰め物を含む)
+    std::fill( buffer, buffer + layout.offset_triangles, byte_t{ 0 } );
+
+    for ( size_t i = 0; i < layout.num_paddings; ++i ) {
+        const auto& padding = layout.paddings[i];
+        std::fill( buffer + padding.first, buffer + padding.second, byte_t{ 0 } );
+    }
+
+    // VERTICES
+    const auto copy_array = [&]( const auto* src_array,
+                                 size_t       num_elems,
+                                 size_t      dst_offset ) {
+        const size_t elem_size = sizeof( *src_array );
+        const auto         src = reinterpret_cast<const byte_t*>( src_array );
+        auto               dst = buffer + dst_offset;
+
+        for ( size_t vi = 0; vi < num_vertices; ++vi ) {
+            std::copy_n( src + num_elems * elem_size * vi, num_elems * elem_size, dst );
+            dst += layout.vertex_stride;
+        }
+    };
+
+    copy_array( adata.positions, DIM, layout.offset_positions );
+
+    if ( adata.n_array ) {
+        copy_array( adata.n_array, DIM, layout.offset_n_array );
+    }
+
+    if ( adata.tc_array ) {
+        copy_array( adata.tc_array, NUM_TEXCOORD_COMPOS, layout.offset_tc_array );
+    }
+
+    // TRIANGLES
+    std::copy_n( static_cast<const byte_t*>( adata.triangles ),
+                 NUM_TRI_CORNERS * layout.vindex_size * adata.num_triangles,
+                 buffer + layout.offset_triangles );
+
+    // 結果を返す
+    clip_result_( static_cast<wasm_i32_t>( num_vertices ),
+                  static_cast<wasm_i32_t>( adata.num_triangles ),
+                  buffer );
+}
+
+
+Clipper::rect_t
+Clipper::get_u16_clip_rect( const rect_t& rect )
+{
+    rect_t u16_rect;
+
+    // 座標系の変換と境界調整
+    for ( size_t i = 0; i < DIM; ++i ) {
+        u16_rect.lower[i] = ALCS_TO_U16<> * rect.lower[i];
+        u16_rect.upper[i] = (rect.upper[i] < 1) ?
+                            (ALCS_TO_U16<> * rect.upper[i]) :
+                            ALCS_TO_U16<> * (1 + std::numeric_limits<real_t>::epsilon());
+
+        // タイル生成時の最後の数値丸めにより rect.upper[x] == 1 の面に張り付い
+        // ている三角形が存在することがある。もともと開区間のタイル内に入ってい
+        // たはずなので、タイル内に存在するように見せるための調整をしている
+    }
+
+    return u16_rect;
+}
+
+
+Clipper::irect_t
+Clipper::get_int_clip_rect( const rect_t& rect )
+{
+    // 整数 p と実数 x に対して p < x と p < ceil( x ) は同値
+    // (範囲外の値は、すべての頂点座標に対して同じ判定になる値に制限する)
+    constexpr real_t max_bound = std::numeric_limits<p_elem_t>::max() + 1;
+
+    const auto to_int = [max_bound]( real_t x ) {
+        return static_cast<uint32_t>( std::clamp( std::ceil( x ), real_t{ 0 }, max_bound ) );
+    };
+
+    irect_t irect;
+
+    for ( size_t i = 0; i < DIM; ++i ) {
+        irect.lower[i] = to_int( rect.lower[i] );
+        irect.upper[i] = to_int( rect.upper[i] );
+    }
+
+    return irect;
+}
+
+
+const void*
+Clipper::get_tile_pointer( const Analyzer& adata,
+                           size_t         offset )
+{
+    return reinterpret_cast<const byte_t*>( adata.positions ) + offset;
 }
 
 } // namespace b3dtile
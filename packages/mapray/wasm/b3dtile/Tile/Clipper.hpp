@@ -4,12 +4,20 @@
 #include "Analyzer.hpp"
 #include "Base.hpp"
 #include "../HashMap.hpp"
+#include "../DenseMap.hpp"
 #include "../Vector.hpp"
+#include "../Simd.hpp"
+#include "../Stats.hpp"
+#if B3DTILE_USE_THREADS
+#  include "../WorkerPool.hpp"
+#endif
 #include <vector>
 #include <array>
-#include <algorithm>  // for min(), max(), transform()
-#include <utility>    // for move()
+#include <algorithm>  // for min(), max(), transform(), fill(), copy_n()
+#include <utility>    // for move(), pair
+#include <optional>
 #include <cmath>      // for round()
+#include <cstdint>    // for uintptr_t
 #include <cassert>
 
 
@@ -19,21 +27,62 @@ namespace b3dtile {
  */
 class Tile::Clipper : Base {
 
+    /** @brief run_octants() の子の直方体の数
+     */
+    static constexpr size_t NUM_OCTANTS = 1u << DIM;
+
+
+    /** @brief 正規化 uint16 座標の整数直方体
+     *
+     *  三角形の頂点座標は整数なので、内外判定は整数の比較で行う。
+     */
+    using irect_t = Rect<uint32_t, DIM>;
+
+
+    /** @brief 各軸の下半分 (0) と上半分 (1) に属する子のマスク
+     *
+     *  ビット oi が子 oi に対応する。
+     */
+    static constexpr unsigned HALF_OCTANTS[DIM][2] = {
+        { 0x55, 0xAA },  // x 軸
+        { 0x33, 0xCC },  // y 軸
+        { 0x0F, 0xF0 },  // z 軸
+    };
+
+
     /** @brief 頂点索引辞書
+     *
+     *  旧頂点数が DENSE_MAX_VERTICES 以下のときは、旧頂点索引から新頂点索引へ
+     *  の変換に DenseMap を使い、それ以外のときは HashMap を使う。
+     *
+     *  DenseMap は同じスレッドで構築したすべてのインスタンスで共有し、クリッ
+     *  プ間で再利用する。そのため、同じスレッドで構築した複数のインスタンスで
+     *  交互に new_index() を呼び出してはならない。
+     *
+     *  ただし owns_dense_map が真のときは、インスタンスごとに DenseMap を確保
+     *  する。step() で他のクリップと交互に処理するときに使う。
      */
     class IndexHashMap {
 
       public:
         explicit
-        IndexHashMap( size_t /*max_vertices*/ ) {}
+        IndexHashMap( size_t   max_vertices,
+                      bool   owns_dense_map = false )
+            : dense_mode_{ (max_vertices > DENSE_MAX_VERTICES) ? DenseMode::NONE :
+                           owns_dense_map ? DenseMode::OWNED : DenseMode::SHARED }
+        {
+            if ( auto dense_map = get_dense_map() ) {
+                dense_map->reserve( max_vertices );
+            }
+        }
 
         /** @brief 頂点数を取得
          */
         size_t
         num_vertices() const
         {
-            assert( old_to_new_.size() == new_to_old_.size() );
-            return old_to_new_.size();
+            assert( dense_mode_ != DenseMode::NONE || old_to_new_.size() == new_to_old_.size() );
+            return new_to_old_.size();
         }
 
         /** @brief 旧頂点索引を新頂点索引に変換
@@ -43,7 +92,9 @@ class Tile::Clipper : Base {
         {
             const size_t new_index_candidate = num_vertices();
 
-            const auto& result = old_to_new_.insert( old_index, new_index_candidate );
+            const auto& result = (dense_mode_ != DenseMode::NONE) ?
+                                 insert_dense( old_index, new_index_candidate ) :
+                                 old_to_new_.insert( old_index, new_index_candidate );
 
             const size_t new_index_actual = result.first;
 
@@ -66,14 +117,87 @@ class Tile::Clipper : Base {
             return new_to_old_[new_index];
         }
 
+        /** @brief 頂点数 count までは領域を拡大しないようにする
+         *
+         *  count は見積りでよい。超えたときは通常どおり拡大する。
+         */
+        void
+        reserve( size_t count )
+        {
+            if ( dense_mode_ == DenseMode::NONE ) {
+                old_to_new_.reserve( count );
+            }
+
+            new_to_old_.reserve( count );
+        }
+
+      private:
+        // DenseMap の使い方
+        enum class DenseMode {
+            NONE,    // HashMap を使う
+            SHARED,  // shared_dense_map_ を使う
+            OWNED,   // owned_dense_map_ を使う
+        };
+
+
+        /** @brief 使用する DenseMap を取得
+         *
+         *  DenseMap を使わないときは nullptr を返す。
+         *
+         *  インスタンスの複写や移動に対応するため、ポインタは保持しない。
+         */
+        DenseMap<uint32_t>*
+        get_dense_map()
+        {
+            switch ( dense_mode_ ) {
+            case DenseMode::SHARED: return &shared_dense_map_;
+            case DenseMode::OWNED:  return &owned_dense_map_;
+            default:                return nullptr;
+            }
+        }
+
+
+        /** @brief DenseMap に挿入
+         *
+         *  最初の挿入のときに DenseMap を空にする。
+         */
+        std::pair<size_t, bool>
+        insert_dense( size_t old_index,
+                      size_t new_index )
+        {
+            auto dense_map = get_dense_map();
+
+            if ( new_index == 0 ) {
+                dense_map->clear();
+            }
+
+            // 他のインスタンスが途中で使っていないことを確認
+            assert( dense_map->size() == new_index );
+
+            const auto result = dense_map->insert( old_index, static_cast<uint32_t>( new_index ) );
+
+            return { result.first, result.second };
+        }
+
       private:
-        HashMap<size_t>     old_to_new_;
-        std::vector<size_t> new_to_old_;
+        // DenseMap を使う最大の旧頂点数
+        static constexpr size_t DENSE_MAX_VERTICES = 65536;
+
+        // 同じスレッドのすべてのインスタンスで共有する DenseMap
+        static inline thread_local DenseMap<uint32_t> shared_dense_map_;
+
+        DenseMode           dense_mode_;
+        DenseMap<uint32_t> owned_dense_map_;  // DenseMode::OWNED のとき
+        HashMap<size_t>         old_to_new_;  // DenseMode::NONE のとき
+        std::vector<size_t>     new_to_old_;
 
     };
 
 
     /** @brief 凸多角形 (重心座標)
+     *
+     *  頂点座標は固定長の配列に成分ごとに格納する (SoA)。三角形を 6 つの平面
+     *  で切り取ると頂点は最大 9 個なので、ヒープ割り当ては発生しない。
      */
     class Polygon {
 
@@ -82,24 +206,40 @@ class Tile::Clipper : Base {
         using      vec_t = typename MatchedVector<position_t>::type;
 
 
+        /** @brief 頂点数の上限
+         *
+         *  三角形を切り取る平面は最大 2 * DIM 個で、1 回の切り取りで頂点は最大
+         *  1 個しか増えない。
+         */
+        static constexpr size_t MAX_VERTICES = 3 + 2 * DIM;
+
+
       public:
         /** @brief 初期化
          */
         explicit
         Polygon( size_t tid )
-            : vertices_{ { 0, 0 },
-                         { 1, 0 },
-                         { 0, 1 } },
+            : xs_{ 0, 1, 0 },
+              ys_{ 0, 0, 1 },
+              num_vertices_{ 3 },
               tid_{ tid }
         {}
 
 
-        /** @brief 頂点座標の配列を参照
+        /** @brief 頂点数
          */
-        const std::vector<position_t>&
-        vertices() const
+        size_t num_vertices() const { return num_vertices_; }
+
+
+        /** @brief 頂点座標
+         *
+         *  @pre vi < num_vertices()
+         */
+        position_t
+        vertex( size_t vi ) const
         {
-            return vertices_;
+            assert( vi < num_vertices_ );
+            return { xs_[vi], ys_[vi] };
         }
 
 
@@ -113,7 +253,7 @@ class Tile::Clipper : Base {
         size_t
         num_triangles() const
         {
-            return vertices_.size() - 2;
+            return num_vertices_ - 2;
         }
 
 
@@ -127,30 +267,12 @@ class Tile::Clipper : Base {
         trim_by_plane( const vec_t& n,
                        real_t       d )
         {
-            const size_t num_vertices = vertices_.size();
+            const size_t num_vertices = num_vertices_;
             assert( num_vertices >= 3 );
 
-            auto dist_min = dot( n, vec_t{ vertices_[0] } ) + d;
-            auto dist_max = dist_min;
-
-            for ( size_t i = 1; i < num_vertices; ++i ) {
-                const auto dist = dot( n, vec_t{ vertices_[i] } ) + d;
-                dist_min = std::min( dist, dist_min );
-                dist_max = std::max( dist, dist_max );
-            }
-
-            if ( dist_min >= 0 ) {
-                // 多角形のすべてが半空間に含まれるので、切り取る必要はない
-                return true;
-            }
-            else if ( dist_max <= 0 ) {
-                // 多角形と半空間との重なりの面積が 0 なので空になった
-                return false;
-            }
-
-            // 少なくとも 1 つの頂点が半空間の内側
-            // 少なくとも 1 つの頂点が半空間の外側
-            assert( (dist_min < 0) && (dist_max > 0) );
+            // 各頂点の境界からの符号付き距離 dot( n, v ) + d
+            dists_t dists;
+            compute_distances( n, d, dists );
 
             // アルゴリズム
             //
@@ -175,98 +297,143 @@ class Tile::Clipper : Base {
             //
             //   3. 稜線 E と境界の交点を V に加える。
             //
+            //  頂点の内外判定と稜線 S, E の検索は dists の 1 回の走査で行う。
+            //
 
-            // 始点が半空間の外部で終点が半空間の非外部の稜線 S を見つける
-            size_t S_edge = num_vertices;  // 稜線 S のインデックス
+            bool   has_outside = false;         // 半空間の外部の頂点がある
+            bool    has_inside = false;         // 半空間の内部の頂点がある
+            size_t      S_edge = num_vertices;  // 稜線 S のインデックス
+            size_t      E_edge = num_vertices;  // 稜線 E のインデックス
 
             for ( size_t eid = 0; eid < num_vertices; ++eid ) {
-                const size_t vi0 = edge_start_vertex_index( eid );
-                const size_t vi1 = edge_end_vertex_index( eid );
-
-                const vec_t v0 = vertices_[vi0];  // 始点
-                const vec_t v1 = vertices_[vi1];  // 終点
-
-                if ( (dot( n, v0 ) + d < 0) && (dot( n, v1 ) + d >= 0) ) {
-                    // 稜線 S を見つけた
-                    S_edge = eid;
-                    break;
+                const real_t dist0 = dists[edge_start_vertex_index( eid )];  // 始点
+                const real_t dist1 = dists[edge_end_vertex_index( eid )];    // 終点
+
+                if ( dist0 < 0 ) {
+                    has_outside = true;
+                    if ( (dist1 >= 0) && (S_edge == num_vertices) ) {
+                        // 稜線 S を見つけた
+                        S_edge = eid;
+                    }
+                }
+                else if ( dist0 > 0 ) {
+                    has_inside = true;
+                    if ( (dist1 <= 0) && (E_edge == num_vertices) ) {
+                        // 稜線 E を見つけた
+                        E_edge = eid;
+                    }
                 }
             }
 
-            if ( S_edge == num_vertices ) {
-                // おそらく不変条件を満たさない多角形
-                return false;
+            if ( !has_outside ) {
+                // 多角形のすべてが半空間に含まれるので、切り取る必要はない
+                return true;
             }
-
-            // 始点が半空間の内部で終点が半空間の非内部の稜線 E を見つける
-            size_t E_edge = num_vertices;  // 稜線 E のインデックス
-
-            for ( size_t eid = 0; eid < num_vertices; ++eid ) {
-                const size_t vi0 = edge_start_vertex_index( eid );
-                const size_t vi1 = edge_end_vertex_index( eid );
-
-                const vec_t v0 = vertices_[vi0];  // 始点
-                const vec_t v1 = vertices_[vi1];  // 終点
-
-                if ( (dot( n, v0 ) + d > 0) && (dot( n, v1 ) + d <= 0) ) {
-                    // 稜線 E を見つけた
-                    E_edge = eid;
-                    break;
-                }
+            else if ( !has_inside ) {
+                // 多角形と半空間との重なりの面積が 0 なので空になった
+                return false;
             }
 
-            if ( E_edge == num_vertices ) {
+            if ( S_edge == num_vertices || E_edge == num_vertices ) {
                 // おそらく不変条件を満たさない多角形
                 return false;
             }
 
             // 新しい頂点配列
-            std::vector<position_t> new_vertices;
-            new_vertices.reserve( num_vertices + 1 );
+            coords_t new_xs;
+            coords_t new_ys;
+            size_t   new_num_vertices = 0;
+
+            const auto add_vertex = [&]( const position_t& pos ) {
+                new_xs[new_num_vertices] = pos[0];
+                new_ys[new_num_vertices] = pos[1];
+                ++new_num_vertices;
+            };
 
             // S_edge の終点が境界上でなければ、S_edge と境界の交点を追加
-            if ( dot( n, vec_t{ vertices_[edge_end_vertex_index( S_edge )] } ) + d != 0 ) {
-                new_vertices.push_back( get_cross_point( n, d, S_edge ) );
+            if ( dists[edge_end_vertex_index( S_edge )] != 0 ) {
+                add_vertex( get_cross_point( n, dists, S_edge ) );
             }
 
             // S_edge の次の稜線の始点から E_edge の始点までの頂点を追加
             for ( size_t vi = edge_start_vertex_index( next_edge_index( S_edge ) ) ;; vi = next_vertex_index( vi ) ) {
-                new_vertices.push_back( vertices_[vi] );
+                add_vertex( vertex( vi ) );
                 if ( vi == edge_start_vertex_index( E_edge ) ) break;
             }
 
             // E_edge と境界の交点を追加
-            new_vertices.push_back( get_cross_point( n, d, E_edge ) );
+            add_vertex( get_cross_point( n, dists, E_edge ) );
 
             // 頂点を更新
-            assert( (new_vertices.size() >= 3) && (new_vertices.size() <= num_vertices + 1) );
-            vertices_.swap( new_vertices );
+            assert( (new_num_vertices >= 3) && (new_num_vertices <= num_vertices + 1) );
+            std::copy_n( new_xs.begin(), new_num_vertices, xs_.begin() );
+            std::copy_n( new_ys.begin(), new_num_vertices, ys_.begin() );
+            num_vertices_ = new_num_vertices;
 
             return true;
         }
 
 
       private:
+        // 頂点座標の成分の配列の長さ (SIMD で 4 要素単位に処理できる長さ)
+        static constexpr size_t COORDS_SIZE = (MAX_VERTICES + 3) / 4 * 4;
+
+        using coords_t = std::array<real_t, COORDS_SIZE>;
+        using  dists_t = std::array<real_t, COORDS_SIZE>;
+
+
+        /** @brief すべての頂点の符号付き距離を計算
+         *
+         *  dists[i] に頂点 i の dot( n, v ) + d を格納する。
+         *
+         *  B3DTILE_SIMD が真のときは 4 頂点ずつ計算する。演算の順序は dot() と
+         *  同じなので、結果はスカラー計算と一致する。
+         */
+        void
+        compute_distances( const vec_t& n,
+                           real_t       d,
+                           dists_t& dists ) const
+        {
+#if B3DTILE_SIMD
+            const f32x4 n0{ n[0] };
+            const f32x4 n1{ n[1] };
+            const f32x4 d4{ d };
+
+            for ( size_t i = 0; i < num_vertices_; i += 4 ) {
+                const auto xs = f32x4::load( &xs_[i] );
+                const auto ys = f32x4::load( &ys_[i] );
+                (n0 * xs + n1 * ys + d4).store( &dists[i] );
+            }
+#else
+            for ( size_t i = 0; i < num_vertices_; ++i ) {
+                dists[i] = n[0] * xs_[i] + n[1] * ys_[i] + d;
+            }
+#endif
+        }
+
+
         /** @brief 境界と稜線の交点を計算
+         *
+         *  dists は compute_distances() で計算した距離である。
          *
          *  @pre 稜線の長さは 0 より大きく、境界と稜線は平行ではない
          */
         position_t
-        get_cross_point( const vec_t& n,
-                         real_t       d ,
-                         size_t     eid ) const
+        get_cross_point( const vec_t&     n,
+                         const dists_t& dists,
+                         size_t           eid ) const
         {
             const size_t vi0 = edge_start_vertex_index( eid );
             const size_t vi1 = edge_end_vertex_index( eid );
 
             // Q は始点、V は方向
-            const vec_t Q_ = vertices_[vi0];
-            const auto  V_ = vec_t{ vertices_[vi1] } - Q_;
+            const vec_t Q_ = vertex( vi0 );
+            const auto  V_ = vec_t{ vertex( vi1 ) } - Q_;
 
             assert( norm( V_ ) > 0 );  // 事前条件
 
             // t = -(n . Q + d) / (n . V)
-            const auto t_ = -(dot( n, Q_ ) + d) / dot( n, V_ );
+            const auto t_ = -dists[vi0] / dot( n, V_ );
 
             return Q_ + t_*V_;
         }
@@ -282,21 +449,21 @@ class Tile::Clipper : Base {
         size_t
         edge_end_vertex_index( size_t eid ) const
         {
-            return (eid == vertices_.size() - 1) ? 0 : eid + 1;
+            return (eid == num_vertices_ - 1) ? 0 : eid + 1;
         }
 
 
         size_t
         next_vertex_index( size_t vid ) const
         {
-            return (vid == vertices_.size() - 1) ? 0 : vid + 1;
+            return (vid == num_vertices_ - 1) ? 0 : vid + 1;
         }
 
 
         size_t
         next_edge_index( size_t eid ) const
         {
-            return (eid == vertices_.size() - 1) ? 0 : eid + 1;
+            return (eid == num_vertices_ - 1) ? 0 : eid + 1;
         }
 
 
@@ -305,7 +472,11 @@ class Tile::Clipper : Base {
         // - すべての頂点が同一平面上にある凸多角形 (内角 180 度未満)
         // - 頂点は 3 個以上で、順序は前面から見て反時計回り
         // - すべての稜線は 0 より長く、面積は 0 より大きい
-        std::vector<position_t> vertices_;
+        //
+        // xs_, ys_ の num_vertices_ 以降の要素は未使用 (値は不定ではない)
+        coords_t          xs_;
+        coords_t          ys_;
+        size_t  num_vertices_;
 
         // 三角形インデックス
         size_t tid_;
@@ -313,64 +484,194 @@ class Tile::Clipper : Base {
     };
 
 
-    /** @brief クリップ結果の生成
+    /** @brief 1 つのクリップ結果の構成要素
      */
-    class Result {
+    struct Parts {
 
-        using triangle_t  = std::array<size_t, NUM_TRI_CORNERS>;
-        using mu_coords_t = std::array<real_t, NUM_TRI_CORNERS>;
+        explicit
+        Parts( size_t   max_vertices,
+               bool   owns_dense_map = false )
+            : index_map_A{ max_vertices, owns_dense_map }
+        {}
 
+        // クリッピングなし部分の情報
+        IndexHashMap          index_map_A;  // 旧頂点索引 <-> 新頂点索引
+        std::vector<size_t> tri_indices_A;  // 新頂点索引による三角形リスト
 
-      public:
-        explicit
-        Result( const Clipper& clipper )
-            : clipper_{ clipper },
-              adata_{ clipper.adata_ }
-        {
-            // 新しい頂点数と三角形数
-            num_vertices_  = clipper_.index_map_A_.num_vertices();
-            num_triangles_ = clipper_.tri_indices_A_.size() / NUM_TRI_CORNERS;
+        // クリッピングあり部分の情報
+        std::vector<Polygon> polygons_B;  // 重心座標で表現した凸多角形
 
-            for ( const auto& polygon : clipper_.polygons_B_ ) {
-                num_vertices_  += polygon.vertices().size();
-                num_triangles_ += polygon.num_triangles();
-            }
+    };
+
+
+    /** @brief クリップ結果のバッファ内の配置
+     */
+    struct Layout {
 
+        /** @brief 初期化
+         *
+         *  format は Tile::ClipVertexFormat を参照
+         */
+        Layout( const Analyzer&     adata,
+                size_t       num_vertices,
+                size_t      num_triangles,
+                ClipVertexFormat   format )
+        {
             // 新しい頂点インデックス型のバイト数
-            vindex_size_ = get_index_size( num_vertices_ );
+            vindex_size = get_index_size( num_vertices );
+
+            // 各頂点属性の 1 頂点あたりのバイト数
+            const size_t positions_size = DIM * sizeof( p_elem_t );
+            const size_t   n_array_size = DIM * sizeof( n_elem_t );
+            const size_t  tc_array_size = NUM_TEXCOORD_COMPOS * sizeof( tc_elem_t );
+
+            if ( format == ClipVertexFormat::INTERLEAVED ) {
+                // 頂点内の各属性の位置 (それぞれ 4 バイト境界に揃える)
+                vertex_stride = get_aligned<4>( positions_size );
+
+                if ( adata.n_array ) {
+                    offset_n_array = vertex_stride;
+                    vertex_stride += get_aligned<4>( n_array_size );
+                }
 
-            size_t buffer_size = 0;
+                if ( adata.tc_array ) {
+                    offset_tc_array = vertex_stride;
+                    vertex_stride  += get_aligned<4>( tc_array_size );
+                }
 
-            // 位置配列 (POSITIONS)
-            offset_positions_ = buffer_size;
-            buffer_size += get_aligned<4>( DIM * sizeof( p_elem_t ) * num_vertices_ );
+                // 頂点配列 (VERTICES)
+                offset_vertices   = add_array( vertex_stride * num_vertices );
+                offset_positions  = offset_vertices;
+                offset_n_array   += offset_vertices;
+                offset_tc_array  += offset_vertices;
 
-            // 三角形配列 (TRIANGLES)
-            offset_triangles_ = buffer_size;
-            buffer_size += get_aligned<4>( NUM_TRI_CORNERS * vindex_size_ * num_triangles_ );
+                stride_positions = vertex_stride;
+                stride_n_array   = vertex_stride;
+                stride_tc_array  = vertex_stride;
 
-            // 法線配列 (N_ARRAY)
-            offset_n_array_ = buffer_size;
-            if ( adata_.n_array ) {
-                buffer_size += get_aligned<4>( DIM * sizeof( n_elem_t ) * num_vertices_ );
+                // 三角形配列 (TRIANGLES)
+                offset_triangles = add_array( NUM_TRI_CORNERS * vindex_size * num_triangles );
             }
+            else {
+                // 位置配列 (POSITIONS)
+                offset_positions = add_array( positions_size * num_vertices );
+
+                // 三角形配列 (TRIANGLES)
+                offset_triangles = add_array( NUM_TRI_CORNERS * vindex_size * num_triangles );
 
-            // テクスチャ座標配列 (TC_ARRAY)
-            offset_tc_array_ = buffer_size;
-            if ( adata_.tc_array ) {
-                buffer_size += get_aligned<4>( NUM_TEXCOORD_COMPOS * sizeof( tc_elem_t ) * num_vertices_ );
+                // 法線配列 (N_ARRAY)
+                offset_n_array = adata.n_array ?
+                                 add_array( n_array_size * num_vertices ) : buffer_size;
+
+                // テクスチャ座標配列 (TC_ARRAY)
+                offset_tc_array = adata.tc_array ?
+                                  add_array( tc_array_size * num_vertices ) : buffer_size;
+
+                stride_positions = positions_size;
+                stride_n_array   = n_array_size;
+                stride_tc_array  = tc_array_size;
             }
+        }
+
+        size_t vindex_size;  // 頂点インデックス型のバイト数
+
+        size_t offset_positions = 0;
+        size_t offset_triangles = 0;
+        size_t offset_n_array   = 0;
+        size_t offset_tc_array  = 0;
+
+        // 各頂点属性の頂点間のバイト数
+        size_t stride_positions = 0;
+        size_t stride_n_array   = 0;
+        size_t stride_tc_array  = 0;
+
+        // 頂点配列 (VERTICES) のオフセットと 1 頂点のバイト数 (INTERLEAVED のときだけ)
+        size_t offset_vertices = 0;
+        size_t vertex_stride   = 0;
 
-            // バッファを確保
-            buffer_.resize( buffer_size );
+        size_t buffer_size = 0;  // バッファ全体のバイト数
+
+        // 配列の後の 4 バイト境界までの詰め物の範囲 [first, second)
+        std::array<std::pair<size_t, size_t>, 4> paddings;
+        size_t                               num_paddings = 0;
+
+
+      private:
+        /** @brief 配列を末尾に追加し、そのオフセットを返す
+         */
+        size_t
+        add_array( size_t bytes )
+        {
+            const size_t offset = buffer_size;
+
+            buffer_size += get_aligned<4>( bytes );
+            paddings[num_paddings++] = { offset + bytes, buffer_size };
+
+            return offset;
+        }
+
+    };
+
+
+    /** @brief クリップ結果の生成
+     *
+     *  コンストラクタで結果のバイト数を決め、run() で呼び出し側が用意した領域
+     *  に結果を書き込む。
+     */
+    class Result {
+
+        using triangle_t  = std::array<size_t, NUM_TRI_CORNERS>;
+        using mu_coords_t = std::array<real_t, NUM_TRI_CORNERS>;
+
+
+      public:
+        Result( const Analyzer& adata,
+                const Parts&    parts )
+            : parts_{ parts },
+              adata_{ adata },
+              num_vertices_{ count_vertices( parts ) },
+              num_triangles_{ count_triangles( parts ) },
+              layout_{ adata, num_vertices_, num_triangles_, clip_vertex_format_ }
+        {
+            Stats::add( &Stats::clip_output_bytes, layout_.buffer_size );
+        }
+
+
+        /** @brief 結果のバイト数
+         */
+        size_t
+        buffer_size() const
+        {
+            return layout_.buffer_size;
         }
 
 
         /** @brief 処理を実行
+         *
+         *  buffer から buffer_size() バイトの領域に結果を書き込み、その領域を
+         *  clip_result() に渡す。
+         *
+         *  @param buffer  出力先 (4 バイト境界に揃っていること)
          */
         void
-        run()
+        run( byte_t* buffer )
         {
+            assert( reinterpret_cast<uintptr_t>( buffer ) % 4 == 0 );
+
+            buffer_ = buffer;
+
+            // 詰め物を 0 にする (buffer は再利用された領域であることがある)
+            for ( size_t i = 0; i < layout_.num_paddings; ++i ) {
+                const auto& padding = layout_.paddings[i];
+                std::fill( buffer_ + padding.first, buffer_ + padding.second, byte_t{ 0 } );
+            }
+
+            if ( layout_.vertex_stride != 0 ) {
+                // 頂点内の属性間の詰め物も 0 にする
+                const auto vertices = buffer_ + layout_.offset_vertices;
+                std::fill( vertices, vertices + layout_.vertex_stride * num_vertices_, byte_t{ 0 } );
+            }
+
             // buffer に頂点属性を設定
             set_vertices_A();
 
@@ -382,7 +683,7 @@ class Tile::Clipper : Base {
             }
 
             // buffer に頂点インデックスを設定
-            if ( vindex_size_ == sizeof( uint16_t ) ) {
+            if ( layout_.vindex_size == sizeof( uint16_t ) ) {
                 set_indices_A<uint16_t>();
                 set_indices_B<uint16_t>();
             }
@@ -394,17 +695,47 @@ class Tile::Clipper : Base {
             // 結果を返す
             clip_result_( static_cast<wasm_i32_t>( num_vertices_ ),
                           static_cast<wasm_i32_t>( num_triangles_ ),
-                          buffer_.data() );
+                          buffer_ );
         }
 
 
       private:
+        /** @brief 新しい頂点数
+         */
+        static size_t
+        count_vertices( const Parts& parts )
+        {
+            size_t count = parts.index_map_A.num_vertices();
+
+            for ( const auto& polygon : parts.polygons_B ) {
+                count += polygon.num_vertices();
+            }
+
+            return count;
+        }
+
+
+        /** @brief 新しい三角形数
+         */
+        static size_t
+        count_triangles( const Parts& parts )
+        {
+            size_t count = parts.tri_indices_A.size() / NUM_TRI_CORNERS;
+
+            for ( const auto& polygon : parts.polygons_B ) {
+                count += polygon.num_triangles();
+            }
+
+            return count;
+        }
+
+
         /** @brief A の頂点属性を buffer に設定
          */
         void
         set_vertices_A()
         {
-            const auto& map = clipper_.index_map_A_;
+            const auto& map = parts_.index_map_A;
 
             for ( size_t new_index = 0; new_index < map.num_vertices(); ++new_index ) {
                 const size_t old_index = map.old_index( new_index );
@@ -412,14 +743,16 @@ class Tile::Clipper : Base {
                 // POSITIONS
                 copy_vertex_to_buffer<DIM>( adata_.positions,
                                             old_index,
-                                            offset_positions_,
+                                            layout_.offset_positions,
+                                            layout_.stride_positions,
                                             new_index );
 
                 // N_ARRAY
                 if ( adata_.n_array ) {
                     copy_vertex_to_buffer<DIM>( adata_.n_array,
                                                 old_index,
-                                                offset_n_array_,
+                                                layout_.offset_n_array,
+                                                layout_.stride_n_array,
                                                 new_index );
                 }
 
@@ -427,7 +760,8 @@ class Tile::Clipper : Base {
                 if ( adata_.tc_array ) {
                     copy_vertex_to_buffer<NUM_TEXCOORD_COMPOS>( adata_.tc_array,
                                                                 old_index,
-                                                                offset_tc_array_,
+                                                                layout_.offset_tc_array,
+                                                                layout_.stride_tc_array,
                                                                 new_index );
                 }
             }
@@ -442,27 +776,30 @@ class Tile::Clipper : Base {
         void
         set_vertices_B()
         {
-            size_t dst_vindex = clipper_.index_map_A_.num_vertices();
+            size_t dst_vindex = parts_.index_map_A.num_vertices();
 
-            for ( const auto& polygon : clipper_.polygons_B_ ) {
+            for ( const auto& polygon : parts_.polygons_B ) {
                 const auto triangle = adata_.get_triangle<ViType>( polygon.tid() );
 
-                for ( const auto& coord : polygon.vertices() ) {
+                for ( size_t vi = 0; vi < polygon.num_vertices(); ++vi ) {
                     // 三角形 triangle の各頂属性を、重心座標 mu で補間
 
+                    const auto coord = polygon.vertex( vi );
                     const mu_coords_t mu = { 1 - coord[0] - coord[1], coord[0], coord[1] };
 
                     // POSITIONS
                     interpolate_vertex_to_buffer<DIM>( triangle, mu,
                                                        adata_.positions,
-                                                       offset_positions_,
+                                                       layout_.offset_positions,
+                                                       layout_.stride_positions,
                                                        dst_vindex );
 
                     // N_ARRAY
                     if ( adata_.n_array ) {
                         interpolate_vertex_to_buffer<DIM>( triangle, mu,
                                                            adata_.n_array,
-                                                           offset_n_array_,
+                                                           layout_.offset_n_array,
+                                                           layout_.stride_n_array,
                                                            dst_vindex );
                     }
 
@@ -470,7 +807,8 @@ class Tile::Clipper : Base {
                     if ( adata_.tc_array ) {
                         interpolate_vertex_to_buffer<NUM_TEXCOORD_COMPOS>( triangle, mu,
                                                                            adata_.tc_array,
-                                                                           offset_tc_array_,
+                                                                           layout_.offset_tc_array,
+                                                                           layout_.stride_tc_array,
                                                                            dst_vindex );
                     }
 
@@ -488,8 +826,8 @@ class Tile::Clipper : Base {
         void
         set_indices_A()
         {
-            const auto& src = clipper_.tri_indices_A_;
-            const auto  dst = get_buffer_pointer<ViType>( offset_triangles_ );
+            const auto& src = parts_.tri_indices_A;
+            const auto  dst = get_buffer_pointer<ViType>( layout_.offset_triangles );
 
             std::transform( src.begin(), src.end(), dst,
                             []( size_t i ) { return static_cast<ViType>( i ); } );
@@ -504,13 +842,13 @@ class Tile::Clipper : Base {
         void
         set_indices_B()
         {
-            const size_t dst_start = clipper_.tri_indices_A_.size();
-            auto dst = get_buffer_pointer<ViType>( offset_triangles_ ) + dst_start;
+            const size_t dst_start = parts_.tri_indices_A.size();
+            auto dst = get_buffer_pointer<ViType>( layout_.offset_triangles ) + dst_start;
 
-            size_t vindex = clipper_.index_map_A_.num_vertices();
+            size_t vindex = parts_.index_map_A.num_vertices();
 
-            for ( const auto& polygon : clipper_.polygons_B_ ) {
-                const size_t num_corners = polygon.vertices().size();
+            for ( const auto& polygon : parts_.polygons_B ) {
+                const size_t num_corners = polygon.num_vertices();
 
                 for ( size_t ci = 2; ci < num_corners; ++ci ) {
                     *dst++ = static_cast<ViType>( vindex );
@@ -529,22 +867,26 @@ class Tile::Clipper : Base {
         EType*
         get_buffer_pointer( size_t byte_offset )
         {
-            void* const addr = buffer_.data() + byte_offset;
+            void* const addr = buffer_ + byte_offset;
             return static_cast<EType*>( addr );
         }
 
 
         /** @brief 頂点属性を buffer_ にコピー
+         *
+         *  dst_offset は出力先の属性の先頭、dst_stride は頂点間のバイト数で
+         *  ある。
          */
         template<size_t NumElems, typename EType>
         void
         copy_vertex_to_buffer( const EType* src_array,
                                size_t       src_index,
                                size_t       dst_offset,
+                               size_t       dst_stride,
                                size_t       dst_index )
         {
             const auto src = src_array + NumElems * src_index;
-            const auto dst = get_buffer_pointer<EType>( dst_offset ) + NumElems * dst_index;
+            const auto dst = get_buffer_pointer<EType>( dst_offset + dst_stride * dst_index );
 
             for ( size_t ei = 0; ei < NumElems; ++ei ) {
                 dst[ei] = src[ei];
@@ -553,6 +895,8 @@ class Tile::Clipper : Base {
 
 
         /** @brief 頂点属性を補間し buffer_ にコピー
+         *
+         *  dst_offset と dst_stride は copy_vertex_to_buffer() と同じである。
          */
         template<size_t NumElems, typename EType>
         void
@@ -560,11 +904,12 @@ class Tile::Clipper : Base {
                                       const mu_coords_t&      mu,
                                       const EType* src_array,
                                       size_t       dst_offset,
+                                      size_t       dst_stride,
                                       size_t       dst_index )
         {
             using std::round;
 
-            const auto dst = get_buffer_pointer<EType>( dst_offset ) + NumElems * dst_index;
+            const auto dst = get_buffer_pointer<EType>( dst_offset + dst_stride * dst_index );
 
             for ( size_t ei = 0; ei < NumElems; ++ei ) {
                 real_t value = 0;  // ei 要素の補間値
@@ -581,50 +926,170 @@ class Tile::Clipper : Base {
 
 
       private:
-        const Clipper& clipper_;
+        const Parts&     parts_;
         const Analyzer&  adata_;
 
-        size_t num_vertices_;
-        size_t num_triangles_;
-        size_t vindex_size_;
-
-        size_t offset_positions_;
-        size_t offset_triangles_;
-        size_t offset_n_array_;
-        size_t offset_tc_array_;
+        const size_t  num_vertices_;
+        const size_t num_triangles_;
+        const Layout        layout_;
 
-        std::vector<byte_t> buffer_;
+        byte_t* buffer_ = nullptr;  // run() の出力先
 
     };
 
 
+  public:
+    /** @brief 再開可能な構築の指定
+     *
+     *  @see Clipper( const Analyzer&, const TriTree&, const rect_t&, resumable_t )
+     */
+    struct resumable_t {};
+
+
   public:
     /** @brief 初期化
      *
-     *  adata は参照のみを保持すること注意すること。
+     *  adata と tri_tree は参照のみを保持すること注意すること。
      */
     Clipper( const Analyzer&   adata,
+             const TriTree& tri_tree,
              const rect_t& clip_rect );
 
 
+    /** @brief 再開可能な処理のための初期化
+     *
+     *  step() の呼び出しの間に、同じスレッドで他の Clipper インスタンスの処理
+     *  を行うことができる。そのため、頂点索引辞書はスレッドで共有する
+     *  DenseMap を使わない。
+     *
+     *  構築時には三角形ブロックの収集を行わず、最初の step() または prepare()
+     *  で行う。
+     *
+     *  それ以外は Clipper( const Analyzer&, const TriTree&, const rect_t& ) と
+     *  同じである。
+     */
+    Clipper( const Analyzer&   adata,
+             const TriTree& tri_tree,
+             const rect_t& clip_rect,
+             resumable_t );
+
+
     /** @brief クリップ処理を実行
      *
      *  タイルのポリゴンをクリッピングする。
      *
-     *  結果は setup_javascript_functions() の clip_result パラメータに指定した
-     *  関数を呼び出して通知する。
+     *  結果は arena に書き込み、setup_javascript_functions() の clip_result パ
+     *  ラメータに指定した関数を呼び出して通知する。arena は必要なときだけ拡張
+     *  する。
+     */
+    void run( std::vector<byte_t>& arena );
+
+
+    /** @brief 8 分割したクリップ処理を実行
+     *
+     *  クリップ直方体を各軸の中央で 8 個に分割した直方体ごとにクリップする。
+     *  結果は子の直方体ごとに、子インデックス (u + 2v + 4w) の順に通知する。
+     *
+     *  各三角形の内外判定は 1 回だけ行い、8 個の結果で共有する。それぞれの結
+     *  果は、子の直方体を指定して run() を実行したときと三角形の順序を除いて同
+     *  じである。
+     *
+     *  arena は run() と同じように結果の出力先として使う。
+     */
+    void run_octants( std::vector<byte_t>& arena );
+
+
+#if B3DTILE_USE_THREADS
+    /** @brief run() で並列処理を行う最小の三角形数
+     *
+     *  収集した三角形ブロックの三角形数がこの値以上のとき、三角形ブロックを
+     *  WorkerPool のスレッドに分配して処理する。結果は並列処理を行わないとき
+     *  と同じである。
+     *
+     *  単体テストでは小さい値に変更して並列処理を検査する。
+     */
+    static inline size_t parallel_min_triangles = 16384;
+#endif
+
+
+    /** @brief タイル全体をクリップ結果としたときのバイト数
+     *
+     *  タイルデータの POSITIONS から TC_ARRAY までの部分はクリップ結果と同じ
+     *  形式なので、その部分のバイト数になる。
+     */
+    static size_t
+    get_tile_buffer_size( const Analyzer& adata );
+
+
+    /** @brief タイル全体を INTERLEAVED 形式のクリップ結果としたときのバイト数
+     *
+     *  write_tile_interleaved() が書き込むバイト数である。
+     */
+    static size_t
+    get_tile_interleaved_size( const Analyzer& adata );
+
+
+    /** @brief タイル全体を INTERLEAVED 形式のクリップ結果として書き込む
+     *
+     *  クリップ直方体がタイル全体を包含するときの ClipVertexFormat::INTERLEAVED
+     *  の結果を、三角形の内外判定を行わずにタイルの配列から直接生成する。頂点と
+     *  三角形の順序はタイルデータと同じである。
+     *
+     *  buffer から get_tile_interleaved_size() バイトの領域に結果を書き込み、
+     *  clip_result() で通知する。
+     *
+     *  @param buffer  出力先 (4 バイト境界に揃っていること)
+     */
+    static void
+    write_tile_interleaved( const Analyzer& adata,
+                            byte_t*        buffer );
+
+
+    /** @brief 三角形の収集を進める
+     *
+     *  prepare() の前半の処理である三角形の収集を、最大 max_triangles 個の三
+     *  角形だけ進める。収集の途中から prepare() または run() を呼び出すと、残
+     *  りの三角形を収集する。結果は step() の呼び出し方に依存しない。
+     *
+     *  resumable_t で構築したときの最初の呼び出しは、三角形ブロックの収集だけ
+     *  を行って false を返す。
+     *
+     *  step() を使うときは並列処理を行わない。
+     *
+     *  @return  すべての三角形を収集したとき true, それ以外のとき false
+     */
+    bool step( size_t max_triangles );
+
+
+    /** @brief クリップ結果のバイト数を計算
+     *
+     *  run() の前半の処理を行い、結果のバイト数を返す。続けて write() を呼び出
+     *  して結果を書き込む。
+     */
+    size_t prepare();
+
+
+    /** @brief prepare() で準備した結果を書き込む
+     *
+     *  buffer から prepare() が返したバイト数の領域に結果を書き込み、
+     *  clip_result() で通知する。
+     *
+     *  @param buffer  出力先 (4 バイト境界に揃っていること)
      */
-    void run();
+    void write( byte_t* buffer );
 
 
   private:
-    /** @brief 基本情報を収集
+    /** @brief クリップ直方体と交差する三角形ブロックを収集
      *
-     *  以下のメンバー変数を設定する。
+     *  bcollect_ を実行する。
+     */
+    void collect_tblocks();
+
+
+    /** @brief 基本情報を収集
      *
-     *  - index_map_A_
-     *  - tri_indices_A_
-     *  - polygons_B_
+     *  parts_ を設定する。
      *
      *  @tparam ViType  旧データの頂点インデックス型
      *  @tparam TiType  旧データの三角形インデックス型
@@ -634,23 +1099,290 @@ class Tile::Clipper : Base {
     void
     collect_polygons()
     {
-        for ( const auto& bindex : bcollect_.collected_tblocks ) {
-            assert( bcollect_.num_tblocks >= 1 );
+        const size_t num_triangles = count_collected_triangles<TiType>();
+
+        Stats::add( &Stats::clip_triangles, num_triangles );
+
+#if B3DTILE_USE_THREADS
+        if ( num_triangles >= parallel_min_triangles ) {
+            collect_polygons_parallel<ViType, TiType>( num_triangles );
+            return;
+        }
+#endif
+
+        parts_.index_map_A.reserve( estimate_num_vertices( num_triangles ) );
+
+        collect_tblock_polygons<ViType, TiType>( 0, bcollect_.collected_tblocks.size(), parts_ );
+    }
+
+
+    /** @brief 基本情報の収集を進める
+     *
+     *  step() の実装である。step_tblock_ と step_tid_ の位置から最大
+     *  max_triangles 個の三角形を parts_ に追加する。
+     *
+     *  @tparam ViType  旧データの頂点インデックス型
+     *  @tparam TiType  旧データの三角形インデックス型
+     *
+     *  @return  すべての三角形を収集したとき true, それ以外のとき false
+     */
+    template<typename ViType,
+             typename TiType>
+    bool
+    collect_polygons_step( size_t max_triangles )
+    {
+        const auto& tblocks = bcollect_.collected_tblocks;
+
+        if ( !step_started_ ) {
+            // 最初の呼び出し
+            const size_t num_triangles = count_collected_triangles<TiType>();
+
+            Stats::add( &Stats::clip_triangles, num_triangles );
+
+            parts_.index_map_A.reserve( estimate_num_vertices( num_triangles ) );
+
+            if ( !tblocks.empty() ) {
+                step_tid_ = get_tblock_triangles<TiType>( tblocks[0] ).first;
+            }
+
+            step_started_ = true;
+        }
+
+        size_t count = 0;  // 追加した三角形数
+
+        while ( step_tblock_ < tblocks.size() ) {
+            const size_t e_tid = get_tblock_triangles<TiType>( tblocks[step_tblock_] ).second;
+
+            for ( ; step_tid_ != e_tid; ++step_tid_ ) {
+                if ( count == max_triangles ) {
+                    // 未収集の三角形が残っている
+                    return false;
+                }
+
+                add_triangle<ViType>( step_tid_, parts_ );
+                ++count;
+            }
 
-            const size_t b_tid = get_tblock_table_item<TiType>( bindex );
-            const size_t e_tid = (bindex == bcollect_.num_tblocks - 1) ?
-                                 adata_.num_triangles :
-                                 get_tblock_table_item<TiType>( bindex + 1 );
+            // 次の三角形ブロックへ
+            if ( ++step_tblock_ < tblocks.size() ) {
+                step_tid_ = get_tblock_triangles<TiType>( tblocks[step_tblock_] ).first;
+            }
+        }
+
+        return true;
+    }
 
-            assert( b_tid < e_tid );
+
+    /** @brief 三角形ブロックの範囲の基本情報を収集
+     *
+     *  collected_tblocks の [begin, end) の範囲の三角形ブロックの三角形を
+     *  parts に追加する。
+     *
+     *  @tparam ViType  旧データの頂点インデックス型
+     *  @tparam TiType  旧データの三角形インデックス型
+     */
+    template<typename ViType,
+             typename TiType>
+    void
+    collect_tblock_polygons( size_t begin,
+                             size_t   end,
+                             Parts& parts ) const
+    {
+        for ( size_t i = begin; i < end; ++i ) {
+            const auto [b_tid, e_tid] = get_tblock_triangles<TiType>( bcollect_.collected_tblocks[i] );
 
             for ( size_t tid = b_tid; tid != e_tid; ++tid ) {
-                add_triangle<ViType>( tid );
+                add_triangle<ViType>( tid, parts );
             }
         }
     }
 
 
+#if B3DTILE_USE_THREADS
+    /** @brief 基本情報を並列に収集
+     *
+     *  collect_polygons() と同じだが、collected_tblocks を三角形数がほぼ等し
+     *  い連続した範囲 (チャンク) に分割し、チャンクごとに WorkerPool のスレッ
+     *  ドで処理する。
+     *
+     *  チャンクの結果はチャンクの順に parts_ に統合する。チャンク内の新頂点索
+     *  引は三角形の順に初出の頂点から割り当てられているので、その順に
+     *  parts_.index_map_A に登録すると、逐次処理と同じ新頂点索引になる。
+     *
+     *  @tparam ViType  旧データの頂点インデックス型
+     *  @tparam TiType  旧データの三角形インデックス型
+     */
+    template<typename ViType,
+             typename TiType>
+    void
+    collect_polygons_parallel( size_t num_triangles )
+    {
+        auto& pool = WorkerPool::instance();
+
+        const auto& tblocks = bcollect_.collected_tblocks;
+
+        // チャンク ci は tblocks の [chunk_begins[ci], chunk_begins[ci + 1])
+        std::vector<size_t> chunk_begins{ 0 };
+        {
+            const size_t max_chunks = std::min( pool.num_threads(), tblocks.size() );
+            size_t        tri_count = 0;
+
+            for ( size_t i = 0; i < tblocks.size(); ++i ) {
+                const auto [b_tid, e_tid] = get_tblock_triangles<TiType>( tblocks[i] );
+                tri_count += e_tid - b_tid;
+
+                // 三角形数が均等になる位置でチャンクを区切る
+                const size_t num_chunks = chunk_begins.size();
+                if ( num_chunks < max_chunks && tri_count * max_chunks >= num_chunks * num_triangles ) {
+                    chunk_begins.push_back( i + 1 );
+                }
+            }
+
+            if ( chunk_begins.back() != tblocks.size() ) {
+                chunk_begins.push_back( tblocks.size() );
+            }
+        }
+
+        const size_t num_chunks = chunk_begins.size() - 1;
+
+        // Parts は IndexHashMap がスレッドごとの DenseMap を使うので、タスク
+        // を実行するスレッドで構築する
+        std::vector<std::optional<Parts>> chunk_parts( num_chunks );
+
+        pool.run( num_chunks, [&]( size_t ci ) {
+            auto& parts = chunk_parts[ci].emplace( adata_.num_vertices );
+            collect_tblock_polygons<ViType, TiType>( chunk_begins[ci], chunk_begins[ci + 1], parts );
+        } );
+
+        // チャンクの結果を順に統合
+        size_t num_tri_indices = 0;
+        size_t    num_polygons = 0;
+
+        for ( const auto& parts : chunk_parts ) {
+            num_tri_indices += parts->tri_indices_A.size();
+            num_polygons    += parts->polygons_B.size();
+        }
+
+        parts_.index_map_A.reserve( estimate_num_vertices( num_triangles ) );
+        parts_.tri_indices_A.reserve( num_tri_indices );
+        parts_.polygons_B.reserve( num_polygons );
+
+        std::vector<size_t> new_indices;  // チャンクの新頂点索引 -> parts_ の新頂点索引
+
+        for ( const auto& parts : chunk_parts ) {
+            const auto& map = parts->index_map_A;
+
+            new_indices.resize( map.num_vertices() );
+
+            for ( size_t i = 0; i < map.num_vertices(); ++i ) {
+                new_indices[i] = parts_.index_map_A.new_index( map.old_index( i ) );
+            }
+
+            for ( const auto index : parts->tri_indices_A ) {
+                parts_.tri_indices_A.push_back( new_indices[index] );
+            }
+
+            parts_.polygons_B.insert( parts_.polygons_B.end(), parts->polygons_B.begin(), parts->polygons_B.end() );
+        }
+    }
+#endif
+
+
+    /** @brief 8 分割の基本情報を収集
+     *
+     *  collect_polygons() と同じだが、octant_parts の各要素を設定する。
+     *
+     *  クリッピングなしの三角形は子ごとに三角形インデックスを溜めておき、最後
+     *  に子ごとにまとめて追加する。子の頂点索引辞書を交互に更新するより、1 つ
+     *  ずつ更新するほうがメモリーアクセスの局所性が高い。
+     *
+     *  @tparam ViType  旧データの頂点インデックス型
+     *  @tparam TiType  旧データの三角形インデックス型
+     */
+    template<typename ViType,
+             typename TiType>
+    void
+    collect_octant_polygons( std::vector<Parts>& octant_parts )
+    {
+        // 子ごとのクリッピングなし三角形のインデックス
+        std::array<std::vector<size_t>, NUM_OCTANTS> whole_tids;
+
+        for ( const auto& bindex : bcollect_.collected_tblocks ) {
+            const auto [b_tid, e_tid] = get_tblock_triangles<TiType>( bindex );
+
+            Stats::add( &Stats::clip_triangles, e_tid - b_tid );
+
+            for ( size_t tid = b_tid; tid != e_tid; ++tid ) {
+                add_octant_triangle<ViType>( tid, octant_parts, whole_tids );
+            }
+        }
+
+        for ( size_t oi = 0; oi < NUM_OCTANTS; ++oi ) {
+            octant_parts[oi].index_map_A.reserve( estimate_num_vertices( whole_tids[oi].size() ) );
+
+            for ( const auto tid : whole_tids[oi] ) {
+                add_whole_triangle( get_triangle<ViType>( tid ), octant_parts[oi] );
+            }
+        }
+    }
+
+
+    /** @brief 収集した三角形ブロックの三角形の総数
+     *
+     *  @tparam TiType  旧データの三角形インデックス型
+     */
+    template<typename TiType>
+    size_t
+    count_collected_triangles() const
+    {
+        size_t count = 0;
+
+        for ( const auto& bindex : bcollect_.collected_tblocks ) {
+            const auto [b_tid, e_tid] = get_tblock_triangles<TiType>( bindex );
+            count += e_tid - b_tid;
+        }
+
+        return count;
+    }
+
+
+    /** @brief 三角形ブロックの三角形インデックスの範囲
+     *
+     *  @tparam TiType  旧データの三角形インデックス型
+     *
+     *  @param bindex  ブロックインデックス
+     *
+     *  @return  範囲 [first, second)
+     */
+    template<typename TiType>
+    std::pair<size_t, size_t>
+    get_tblock_triangles( size_t bindex ) const
+    {
+        assert( bcollect_.num_tblocks >= 1 );
+
+        const size_t b_tid = get_tblock_table_item<TiType>( bindex );
+        const size_t e_tid = (bindex == bcollect_.num_tblocks - 1) ?
+                             adata_.num_triangles :
+                             get_tblock_table_item<TiType>( bindex + 1 );
+
+        assert( b_tid < e_tid );
+
+        return { b_tid, e_tid };
+    }
+
+
+    /** @brief num_triangles 個の三角形が参照する頂点数の見積り
+     *
+     *  三角形を共有する辺でつながったメッシュでは、頂点数は三角形数のおよそ半
+     *  分になる。旧データの頂点数は超えない。
+     */
+    size_t
+    estimate_num_vertices( size_t num_triangles ) const
+    {
+        return std::min( adata_.num_vertices, num_triangles / 2 + NUM_TRI_CORNERS );
+    }
+
+
     /** @brief tblock_table[index] を取得
      *
      *  @tparam ViType  旧データの三角形インデックス型
@@ -687,104 +1419,224 @@ class Tile::Clipper : Base {
      *
      *  @tparam ViType  旧データの頂点インデックス型
      *
-     *  @param tid  三角形インデックス
+     *  @param tid    三角形インデックス
+     *  @param parts  追加先
      */
     template<typename ViType>
     void
-    add_triangle( size_t tid )
+    add_triangle( size_t   tid,
+                  Parts& parts ) const
     {
         const Triangle triangle = get_triangle<ViType>( tid );
+        const irect_t    bounds = get_triangle_bounds( triangle );
 
-        if ( is_inside( triangle ) ) {
+        if ( is_inside( bounds, clip_irect_ ) ) {
             // triangle は完全に clip_rect_ の内側
-            for ( const auto& old_index : triangle.ref_corners() ) {
-                tri_indices_A_.emplace_back( index_map_A_.new_index( old_index ) );
-            }
+            add_whole_triangle( triangle, parts );
         }
         else {
-            if ( is_outside( triangle ) ) {
+            if ( is_outside( bounds, clip_irect_ ) ) {
                 // triangle は完全に clip_rect_ の外側
                 // (何も追加しない)
             }
             else {
                 // それ以外の三角形
-                add_clipped_polygon( triangle, tid );
+                add_clipped_polygon( triangle, tid, bounds, clip_rect_, clip_irect_, parts.polygons_B );
             }
         }
     }
 
 
-    /** @brief triangle が clip_rect_ の完全に内側か？
+    /** @brief 8 分割のそれぞれに三角形を追加
+     *
+     *  @tparam ViType  旧データの頂点インデックス型
+     *
+     *  @param tid           三角形インデックス
+     *  @param octant_parts  子ごとの基本情報
+     *  @param whole_tids    子ごとのクリッピングなし三角形のインデックス
+     *
+     *  三角形の座標範囲を軸ごとに下半分と上半分の範囲と比較する。子の直方体は
+     *  軸ごとの範囲の直積なので、子の内外判定は軸ごとの判定の組み合わせで決ま
+     *  る。
+     *
+     *  - 子の完全に外側 ⇔ いずれかの軸で、その半分の完全に外側
+     *  - 子の完全に内側 ⇔ すべての軸で、その半分の完全に内側
+     *
+     *  そのため、すべての軸で重なる半分の組み合わせの子だけを処理する。
      */
-    bool
-    is_inside( const Triangle& triangle ) const
+    template<typename ViType>
+    void
+    add_octant_triangle( size_t                                        tid,
+                         std::vector<Parts>&                  octant_parts,
+                         std::array<std::vector<size_t>, NUM_OCTANTS>& whole_tids )
     {
-        const auto corner_flags = get_corner_flags( triangle );
+        const Triangle triangle = get_triangle<ViType>( tid );
+        const irect_t    bounds = get_triangle_bounds( triangle );
 
-        auto flags = 0;  // 全ビット 0 で初期化
+        // 子の集合をビット oi が子 oi に対応するマスクで表す
+        unsigned overlap_mask = (1u << NUM_OCTANTS) - 1;  // 重なる子
+        unsigned  inside_mask = (1u << NUM_OCTANTS) - 1;  // 完全に内側の子
 
-        for ( size_t ci = 0; ci < NUM_TRI_CORNERS; ++ci ) {
-            flags |= corner_flags[ci];
+        for ( size_t ai = 0; ai < DIM; ++ai ) {
+            unsigned axis_overlap = 0;
+            unsigned  axis_inside = 0;
+
+            for ( size_t hi = 0; hi < 2; ++hi ) {
+                const auto& irect = octant_irects_[hi << ai];
+
+                // ai 軸の半分 hi に属する子のマスク
+                const unsigned half_mask = HALF_OCTANTS[ai][hi];
+
+                if ( !is_outside( bounds, irect, ai ) ) {
+                    axis_overlap |= half_mask;
+                }
+
+                if ( is_inside( bounds, irect, ai ) ) {
+                    axis_inside |= half_mask;
+                }
+            }
+
+            overlap_mask &= axis_overlap;
+            inside_mask  &= axis_inside;
+        }
+
+        for ( size_t oi = 0; overlap_mask != 0; ++oi, overlap_mask >>= 1, inside_mask >>= 1 ) {
+            if ( (overlap_mask & 1u) == 0 ) {
+                // triangle は完全に子 oi の外側
+                // (何も追加しない)
+            }
+            else if ( (inside_mask & 1u) != 0 ) {
+                // triangle は完全に子 oi の内側
+                whole_tids[oi].push_back( tid );
+            }
+            else {
+                // それ以外の三角形
+                add_clipped_polygon( triangle, tid, bounds, octant_rects_[oi], octant_irects_[oi], octant_parts[oi].polygons_B );
+            }
         }
+    }
+
 
-        // ビット論理和が 0 のとき、完全に内側
-        return flags == 0;
+    /** @brief クリッピングなしで三角形を追加
+     */
+    static void
+    add_whole_triangle( const Triangle& triangle,
+                        Parts&             parts )
+    {
+        for ( const auto& old_index : triangle.ref_corners() ) {
+            parts.tri_indices_A.emplace_back( parts.index_map_A.new_index( old_index ) );
+        }
     }
 
 
-    /** @brief triangle が clip_rect_ の完全に外側か？
+    /** @brief 三角形の座標範囲を取得
+     *
+     *  triangle の頂点座標 (正規化 uint16 座標) を含む最小の整数直方体を返す。
+     *  upper は最大座標 + 1 である。
      */
-    bool
-    is_outside( const Triangle& triangle ) const
+    irect_t
+    get_triangle_bounds( const Triangle& triangle ) const
     {
-        const auto corner_flags = get_corner_flags( triangle );
+        const auto pos0 = adata_.get_position<uint32_t>( triangle.get_vertex_index( 0 ) );
 
-        auto flags = static_cast<unsigned>( -1 );  // 全ビット 1 で初期化
+        irect_t bounds{ pos0, pos0 };
 
-        for ( size_t ci = 0; ci < NUM_TRI_CORNERS; ++ci ) {
-            flags &= corner_flags[ci];
+        for ( size_t ci = 1; ci < NUM_TRI_CORNERS; ++ci ) {
+            const auto pos = adata_.get_position<uint32_t>( triangle.get_vertex_index( ci ) );
+
+            for ( size_t ai = 0; ai < DIM; ++ai ) {
+                bounds.lower[ai] = std::min( bounds.lower[ai], pos[ai] );
+                bounds.upper[ai] = std::max( bounds.upper[ai], pos[ai] );
+            }
+        }
+
+        for ( size_t ai = 0; ai < DIM; ++ai ) {
+            bounds.upper[ai] += 1;
         }
 
-        // ビット論理積が 0 以外のとき、完全に外側
-        return flags != 0;
+        return bounds;
     }
 
 
-    /** @brief 三角形の内外判定フラグを取得
+    /** @brief 三角形が ai 軸について irect の範囲の完全に内側か？
      *
-     *  資料 LargeScale3DScene の「三角形の内外判定方法」を参照
+     *  @param bounds  三角形の座標範囲 (get_triangle_bounds())
      */
-    std::array<unsigned, NUM_TRI_CORNERS>
-    get_corner_flags( const Triangle& triangle ) const
+    static bool
+    is_inside( const irect_t& bounds,
+               const irect_t&  irect,
+               size_t             ai )
     {
-        std::array<unsigned, NUM_TRI_CORNERS> corner_flags;
+        return bounds.lower[ai] >= irect.lower[ai] && bounds.upper[ai] <= irect.upper[ai];
+    }
 
-        for ( size_t ci = 0; ci < NUM_TRI_CORNERS; ++ci ) {
-            const auto  vi = triangle.get_vertex_index( ci );
-            const auto pos = adata_.get_position<real_t>( vi );
 
-            unsigned flag = 0;
+    /** @brief 三角形が ai 軸について irect の範囲の完全に外側か？
+     *
+     *  @param bounds  三角形の座標範囲 (get_triangle_bounds())
+     */
+    static bool
+    is_outside( const irect_t& bounds,
+                const irect_t&  irect,
+                size_t             ai )
+    {
+        return bounds.upper[ai] <= irect.lower[ai] || bounds.lower[ai] >= irect.upper[ai];
+    }
 
-            for ( int ai = 0; ai < DIM; ++ai ) {
-                const unsigned lout = (pos[ai] <  clip_rect_.lower[ai]) ? 1 : 0;
-                const unsigned uout = (pos[ai] >= clip_rect_.upper[ai]) ? 2 : 0;
-                flag += (lout + uout) << (2 * ai);
+
+    /** @brief 三角形が irect の完全に内側か？
+     */
+    static bool
+    is_inside( const irect_t& bounds,
+               const irect_t&  irect )
+    {
+        for ( size_t ai = 0; ai < DIM; ++ai ) {
+            if ( !is_inside( bounds, irect, ai ) ) {
+                return false;
             }
+        }
 
-            corner_flags[ci] = flag;
+        return true;
+    }
+
+
+    /** @brief 三角形が irect の完全に外側か？
+     */
+    static bool
+    is_outside( const irect_t& bounds,
+                const irect_t&  irect )
+    {
+        for ( size_t ai = 0; ai < DIM; ++ai ) {
+            if ( is_outside( bounds, irect, ai ) ) {
+                return true;
+            }
         }
 
-        return corner_flags;
+        return false;
     }
 
 
     /** @brief クリッピングされた多角形を追加
+     *
+     *  triangle を rect (正規化 uint16 座標) で切り取った多角形を polygons に
+     *  追加する。
      *
      *  資料 LargeScale3DScene の「三角形のクリッピング」を参照
+     *
+     *  rect は軸に平行なので、各面の法線は座標軸の基底ベクトルになり、多角形
+     *  の平面の係数は三角形の頂点座標の 1 成分だけで決まる。また、三角形の座
+     *  標範囲 bounds が面の内側にあるときは、その面による切り取りを省略する。
+     *
+     *  @param bounds  triangle の座標範囲 (get_triangle_bounds())
+     *  @param irect   rect に対応する整数直方体 (get_int_clip_rect())
      */
     void
-    add_clipped_polygon( const Triangle& triangle,
-                         size_t               tid )
+    add_clipped_polygon( const Triangle&       triangle,
+                         size_t                     tid,
+                         const irect_t&          bounds,
+                         const rect_t&             rect,
+                         const irect_t&           irect,
+                         std::vector<Polygon>& polygons ) const
     {
         using vec3_t = Vector<real_t, DIM>;
         using vec2_t = Polygon::vec_t;
@@ -800,33 +1652,30 @@ class Tile::Clipper : Base {
         Polygon polygon{ tid };
 
         // 計算と変数名は資料を参照
-        for ( int ai = 0; ai < DIM; ++ai ) {
+        // (n = ±basis( ai ) なので、dot( v, n ) = ±v[ai] である)
+        for ( size_t ai = 0; ai < DIM; ++ai ) {
             const auto& a = tri_points;
 
-            { // クリップ ai 軸下限から正に向かう半空間により切り取る
-                const auto n =  vec3_t::basis( ai );
-                const auto d = -clip_rect_.lower[ai];
-
-                const auto n_ = vec2_t{ dot( a[1] - a[0], n ),
-                                        dot( a[2] - a[0], n ) };
+            if ( bounds.lower[ai] < irect.lower[ai] ) {
+                // クリップ ai 軸下限から正に向かう半空間により切り取る
+                const auto n_ = vec2_t{ a[1][ai] - a[0][ai],
+                                        a[2][ai] - a[0][ai] };
 
                 if ( n_ != vec2_t::zero() ) {
-                    const auto d_ = dot( n, a[0] ) + d;
+                    const auto d_ = a[0][ai] - rect.lower[ai];
                     if ( !polygon.trim_by_plane( n_, d_ ) ) {
                         return;
                     }
                 }
             }
 
-            { // クリップ ai 軸上限から負に向かう半空間により切り取る
-                const auto n = -vec3_t::basis( ai );
-                const auto d =  clip_rect_.upper[ai];
-
-                const auto n_ = vec2_t{ dot( a[1] - a[0], n ),
-                                        dot( a[2] - a[0], n ) };
+            if ( bounds.upper[ai] > irect.upper[ai] ) {
+                // クリップ ai 軸上限から負に向かう半空間により切り取る
+                const auto n_ = vec2_t{ a[0][ai] - a[1][ai],
+                                        a[0][ai] - a[2][ai] };
 
                 if ( n_ != vec2_t::zero() ) {
-                    const auto d_ = dot( n, a[0] ) + d;
+                    const auto d_ = rect.upper[ai] - a[0][ai];
                     if ( !polygon.trim_by_plane( n_, d_ ) ) {
                         return;
                     }
@@ -834,23 +1683,68 @@ class Tile::Clipper : Base {
             }
         }
 
-        polygons_B_.emplace_back( std::move( polygon ) );
+        polygons.emplace_back( std::move( polygon ) );
     }
 
 
+    /** @brief 正規化 uint16 座標のクリップ直方体を取得
+     *
+     *  ALCS の直方体 rect を、内外判定で使う座標系に変換する。
+     */
+    static rect_t
+    get_u16_clip_rect( const rect_t& rect );
+
+
+    /** @brief 内外判定に使う整数直方体を取得
+     *
+     *  get_u16_clip_rect() で変換した直方体 rect に対して、整数座標 p が
+     *  rect.lower[i] <= p < rect.upper[i] を満たすことと、返す整数直方体
+     *  irect に対して irect.lower[i] <= p < irect.upper[i] を満たすことが同
+     *  値になる。
+     */
+    static irect_t
+    get_int_clip_rect( const rect_t& rect );
+
+
+    /** @brief タイルデータの POSITIONS から offset バイトの位置のポインタ
+     */
+    static const void*
+    get_tile_pointer( const Analyzer& adata,
+                      size_t         offset );
+
+
   private:
     const Analyzer& adata_;
     BCollector   bcollect_;
 
+    // クリップ直方体 (ALCS)
+    const rect_t alcs_clip_rect_;
+
     // 変換済みクリップ直方体
-    rect_t clip_rect_;
+    const rect_t clip_rect_;
+
+    // clip_rect_ に対応する整数直方体
+    const irect_t clip_irect_;
+
+    // run() の結果の構成要素
+    Parts parts_;
+
+    // bcollect_ を実行した
+    bool tblocks_collected_ = false;
+
+    // step() の進行状況
+    bool   step_started_ = false;  // step() が呼び出された
+    size_t step_tblock_  = 0;      // 次に処理する collected_tblocks の位置
+    size_t step_tid_     = 0;      // 次に処理する三角形インデックス
+
+    // prepare() で準備した結果
+    std::optional<Result> result_;
 
-    // クリッピングなし部分の情報
-    IndexHashMap          index_map_A_;  // 旧頂点索引 <-> 新頂点索引
-    std::vector<size_t> tri_indices_A_;  // 新頂点索引による三角形リスト
+    // run_octants() で使う変換済みの子の直方体
+    std::array<rect_t, NUM_OCTANTS> octant_rects_;
 
-    // クリッピングあり部分の情報
-    std::vector<Polygon> polygons_B_;  // 重心座標で表現した凸多角形
+    // octant_rects_ に対応する整数直方体
+    std::array<irect_t, NUM_OCTANTS> octant_irects_;
 
 };
 
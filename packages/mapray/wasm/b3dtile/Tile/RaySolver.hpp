@@ -5,10 +5,14 @@
 #include "Base.hpp"
 #include "../Rect.hpp"
 #include "../Vector.hpp"
-#include "../HashSet.hpp"
+#include "../Simd.hpp"
+#include "../Stats.hpp"
 #include <vector>
 #include <array>
-#include <algorithm>  // for sort()
+#include <optional>
+#include <memory>     // for unique_ptr
+#include <bitset>
+#include <algorithm>  // for fill(), partial_sort()
 #include <limits>
 #include <cmath>      // for min(), max()
 #include <cassert>
@@ -16,7 +20,12 @@
 
 namespace b3dtile {
 
-/** @brief Tile::find_ray_distance() の処理
+/** @brief Tile::find_ray_distance() と Tile::test_ray_occluded() の処理
+ *
+ *  Tile::find_ray_hits() の処理 (find_hits()) も行う。
+ *
+ *  複数のレイをまとめて処理するとき (run_many(), test_occluded_many()) は、最
+ *  大 PACKET_SIZE 本のレイをパケットとしてトラバースする。
  */
 class Tile::RaySolver : Base {
 
@@ -25,227 +34,1059 @@ class Tile::RaySolver : Base {
     using feature_id_t = std::array<uint32_t, 2>;
 
 
-    /** @brief インデックスが登録済みのときの戻り値
+    /** @brief 割り当てなしを表すの feature ID
+     */
+    static constexpr feature_id_t UNASSIGNED_FEATURE_ID = { 0, 0 };
+
+
+  public:
+    /** @brief パケットのレイの最大数
+     */
+    static constexpr size_t PACKET_SIZE = 16;
+
+
+    /** @brief 交差判定の結果
+     */
+    struct Result {
+
+        /** @brief 交差した位置の距離 (交差がないときは limit)
+         */
+        double distance;
+
+        /** @brief 交差した三角形の feature ID (下位, 上位)
+         */
+        feature_id_t feature_id;
+
+    };
+
+
+  public:
+    /** @brief 初期化
+     *
+     *  adata と tri_tree は参照のみを保持すること注意すること。
+     *
+     *  1 つのインスタンスで run() を繰り返し呼び出すことができる。
+     *
+     *  run() で使う作業領域はここで確保するので、run() はヒープ割り当てを行わ
+     *  ない。
+     */
+    RaySolver( const Analyzer& adata,
+               const TriTree&  tri_tree )
+        : adata_{ adata },
+          tri_tree_{ tri_tree },
+          stack_( tri_tree.max_depth() ),
+          tblock_visited_( adata.num_tblocks, 0 )
+    {}
+
+
+    /** @brief 処理を実行
+     *
+     *  パラメータは Tile::find_ray_distance() と同じである。
+     */
+    Result
+    run( const coords_t<double, DIM>& ray_pos,
+         const coords_t<double, DIM>& ray_dir,
+         double                         limit,
+         const rect_t&                  lrect )
+    {
+        Ray ray{ ray_pos, ray_dir, limit, lrect, false };
+
+        const auto distance = find_ray_distance( ray );
+
+        const auto feature_id = (adata_.findex_size == sizeof( uint16_t )) ?
+                                get_feature_id<uint16_t>( ray.crossed_triangle ) :
+                                get_feature_id<uint32_t>( ray.crossed_triangle );
+
+        return { static_cast<double>( distance ), feature_id };
+    }
+
+
+    /** @brief 遮蔽判定を実行
+     *
+     *  パラメータは Tile::test_ray_occluded() と同じである。
+     *
+     *  最初に見つかった交差で処理を終了し、feature ID も求めないので run() よ
+     *  り高速である。
+     *
+     *  @return 交差があるとき true
+     */
+    bool
+    test_occluded( const coords_t<double, DIM>& ray_pos,
+                   const coords_t<double, DIM>& ray_dir,
+                   double                         limit,
+                   const rect_t&                  lrect )
+    {
+        Ray ray{ ray_pos, ray_dir, limit, lrect, true };
+
+        return find_ray_distance( ray ) != ray.limit;
+    }
+
+
+    /** @brief 複数のレイに対して run() を実行
+     *
+     *  パラメータは Tile::find_ray_distance_many() と同じである。
+     *
+     *  結果は run() をレイごとに実行したときと同じである。
+     */
+    void
+    run_many( size_t            num_rays,
+              const wasm_f64_t*     rays,
+              wasm_f64_t*        results )
+    {
+        for ( size_t first = 0; first < num_rays; first += PACKET_SIZE ) {
+            const size_t num_lanes = std::min( num_rays - first, PACKET_SIZE );
+
+            trace_packet( num_lanes, rays + RAY_NUM_ELEMS * first, false );
+
+            for ( size_t i = 0; i < num_lanes; ++i ) {
+                const auto&        lane = packet_->lanes[i];
+                wasm_f64_t* const   dst = results + RAY_RESULT_NUM_ELEMS * (first + i);
+
+                const auto feature_id = (adata_.findex_size == sizeof( uint16_t )) ?
+                                        get_feature_id<uint16_t>( lane.ray->crossed_triangle ) :
+                                        get_feature_id<uint32_t>( lane.ray->crossed_triangle );
+
+                dst[0] = static_cast<wasm_f64_t>( lane.distance );
+                dst[1] = static_cast<wasm_f64_t>( feature_id[0] );
+                dst[2] = static_cast<wasm_f64_t>( feature_id[1] );
+            }
+        }
+    }
+
+
+    /** @brief 複数のレイに対して test_occluded() を実行
+     *
+     *  パラメータは Tile::test_ray_occluded_many() と同じである。
+     */
+    void
+    test_occluded_many( size_t            num_rays,
+                        const wasm_f64_t*     rays,
+                        wasm_i32_t*        results )
+    {
+        for ( size_t first = 0; first < num_rays; first += PACKET_SIZE ) {
+            const size_t num_lanes = std::min( num_rays - first, PACKET_SIZE );
+
+            trace_packet( num_lanes, rays + RAY_NUM_ELEMS * first, true );
+
+            for ( size_t i = 0; i < num_lanes; ++i ) {
+                const auto& lane = packet_->lanes[i];
+                results[first + i] = (lane.distance != lane.ray->limit) ? 1 : 0;
+            }
+        }
+    }
+
+
+    /** @brief すべての交点を探す
+     *
+     *  パラメータと結果の形式は Tile::find_ray_hits() と同じである。
+     *
+     *  @return 交点の総数
+     */
+    size_t
+    find_hits( const wasm_f64_t* src,
+               size_t       max_hits,
+               wasm_f64_t*      hits )
+    {
+        Ray ray{ src, false };
+
+        hits_.clear();
+
+        // 前のレイで登録された三角形ブロックを消去
+        clear_tblock_visited();
+
+        if ( adata_.root_node ) {
+            // 三角形ツリーあり
+            if ( adata_.bindex_size == sizeof( uint16_t ) )
+                collect_hits_for_tree<uint16_t>( ray );
+            else
+                collect_hits_for_tree<uint32_t>( ray );
+        }
+        else {
+            // 三角形ツリーなし
+            Stats::add( &Stats::ray_triangles, adata_.num_triangles );
+
+            if ( adata_.vindex_size == sizeof( uint16_t ) )
+                collect_hits_for_triangles<uint16_t>( ray, 0, adata_.num_triangles );
+            else
+                collect_hits_for_triangles<uint32_t>( ray, 0, adata_.num_triangles );
+        }
+
+        // 近い順に max_hits 個を出力 (同じ距離のときは三角形インデックス順)
+        const size_t num_hits = hits_.size();
+        const size_t num_outs = std::min( num_hits, max_hits );
+
+        std::partial_sort( hits_.begin(), hits_.begin() + num_outs, hits_.end(),
+                           []( const HitItem& a, const HitItem& b ) {
+                               return (a.distance != b.distance) ?
+                                      (a.distance < b.distance) :
+                                      (a.tid < b.tid);
+                           } );
+
+        for ( size_t i = 0; i < num_outs; ++i ) {
+            const auto&      hit = hits_[i];
+            wasm_f64_t* const dst = hits + RAY_HIT_NUM_ELEMS * i;
+
+            const auto feature_id = (adata_.findex_size == sizeof( uint16_t )) ?
+                                    get_feature_id<uint16_t>( hit.tid ) :
+                                    get_feature_id<uint32_t>( hit.tid );
+
+            dst[0] = static_cast<wasm_f64_t>( hit.distance );
+            dst[1] = static_cast<wasm_f64_t>( hit.tid );
+            dst[2] = static_cast<wasm_f64_t>( feature_id[0] );
+            dst[3] = static_cast<wasm_f64_t>( feature_id[1] );
+        }
+
+        return num_hits;
+    }
+
+
+  private:
+    /** @brief 1 本のレイの情報
+     */
+    class Ray {
+
+      public:
+        Ray( const coords_t<double, DIM>& ray_pos,
+             const coords_t<double, DIM>& ray_dir,
+             double                         limit,
+             const rect_t&                  lrect,
+             bool                         any_hit )
+            : pos{ ALCS_TO_U16<ray_elem_t> * ray_vec_t{ ray_pos } },
+              dir{ ALCS_TO_U16<ray_elem_t> * ray_vec_t{ ray_dir } },
+              limit{ limit },
+              lrect{ lrect },
+              any_hit{ any_hit },
+              lrect_lower_dist{ std::numeric_limits<ray_elem_t>::lowest() },
+              lrect_upper_dist{ std::numeric_limits<ray_elem_t>::max()    },
+#if B3DTILE_SIMD
+              pos_f32{ splat_x4( pos ) },
+              dir_f32{ splat_x4( dir ) },
+              pos_norm1{ norm1( pos ) },
+              dir_norm1{ norm1( dir ) },
+              tmin_f32{ 0 },
+#endif
+              crossed_triangle{ 0 }
+        {
+            setup_lrect_distance_bounds( ray_pos, ray_dir, lrect );
+
+#if B3DTILE_SIMD
+            tmin_f32 = static_cast<float>( std::max( lrect_lower_dist, ray_elem_t{ 0 } ) );
+#endif
+        }
+
+
+        /** @brief レイ配列の要素から初期化
+         *
+         *  src は Tile::RAY_NUM_ELEMS 個の要素からなる 1 本のレイである。
+         */
+        Ray( const wasm_f64_t* src,
+             bool          any_hit )
+            : Ray{ { src[0], src[1], src[2] },
+                   { src[3], src[4], src[5] },
+                   src[6],
+                   rect_t::create_cube( { static_cast<float>( src[7] ),
+                                          static_cast<float>( src[8] ),
+                                          static_cast<float>( src[9] ) },
+                                        static_cast<float>( src[10] ) ),
+                   any_hit }
+        {}
+
+
+      private:
+        /** @brief lrect_*_dist を初期化
+         *
+         *  アルゴリズムは find_ray_distance_for_rect() を参照のこと。
+         */
+        void
+        setup_lrect_distance_bounds( const ray_vec_t& ray_pos,
+                                     const ray_vec_t& ray_dir,
+                                     const rect_t&      lrect )
+        {
+            for ( size_t i = 0; i < 3; ++i ) {
+                const ray_elem_t rect_lower_i = lrect.lower[i];
+                const ray_elem_t rect_upper_i = lrect.upper[i];
+
+                const auto& rni = ray_dir[i];  // r . n_i
+
+                if ( rni != 0 ) {
+                    // tA = ((P_0 - q) . n_i) / (r . n_i)
+                    // tB = ((P_1 - q) . n_i) / (r . n_i)
+                    const auto tA = (rect_lower_i - ray_pos[i]) / rni;
+                    const auto tB = (rect_upper_i - ray_pos[i]) / rni;
+
+                    const auto t0 = (rni > 0) ? tA : tB;
+                    const auto t1 = (rni > 0) ? tB : tA;
+                    assert( t0 < t1 );
+
+                    lrect_lower_dist = std::max( t0, lrect_lower_dist );
+                    lrect_upper_dist = std::min( t1, lrect_upper_dist );
+
+                    assert( lrect_lower_dist < lrect_upper_dist );
+                }
+                else { // rni == 0
+                    assert( (ray_pos[i] - rect_lower_i >=  0) &&
+                            (ray_pos[i] - rect_upper_i <   0) );
+                }
+            }
+        }
+
+
+#if B3DTILE_SIMD
+        /** @brief すべての要素が v の成分のベクトル
+         */
+        static std::array<f32x4, DIM>
+        splat_x4( const ray_vec_t& v )
+        {
+            return {{ f32x4{ static_cast<float>( v[0] ) },
+                      f32x4{ static_cast<float>( v[1] ) },
+                      f32x4{ static_cast<float>( v[2] ) } }};
+        }
+
+
+        /** @brief 1-ノルム
+         */
+        static float
+        norm1( const ray_vec_t& v )
+        {
+            return static_cast<float>( std::abs( v[0] ) + std::abs( v[1] ) + std::abs( v[2] ) );
+        }
+#endif
+
+
+      public:
+        const ray_vec_t  pos;  // レイの始点 (ALCS_TO_U16)
+        const ray_vec_t  dir;  // レイの方向 (ALCS_TO_U16)
+        const ray_elem_t limit;  // 制限距離
+        const rect_t     lrect;  // 制限直方体 (ALCS)
+
+        // 最も近い交差ではなく、最初に見つかった交差で終了するか？
+        const bool any_hit;
+
+        // lrect がレイ (無限直線) と交差する距離範囲
+        ray_elem_t lrect_lower_dist;
+        ray_elem_t lrect_upper_dist;
+
+#if B3DTILE_SIMD
+        // select_triangle_candidates() 用の単精度の値
+        const std::array<f32x4, DIM> pos_f32;  // pos の各成分
+        const std::array<f32x4, DIM> dir_f32;  // dir の各成分
+        const float      pos_norm1;  // pos の 1-ノルム
+        const float      dir_norm1;  // dir の 1-ノルム
+        float             tmin_f32;  // 交点までの距離の下限 (max( lrect_lower_dist, 0 ))
+#endif
+
+        size_t crossed_triangle;  // 最も近い位置で交差する三角形のインデックス
+
+    };
+
+
+    /** @brief レイと交差する子ノード
+     */
+    struct ChildItem {
+        ray_elem_t distance;  // 子ノード直方体との交点までの距離
+        size_t       cindex;  // 子ノードのインデックス
+    };
+
+
+    /** @brief トラバース中の枝ノードの状態
+     */
+    struct Frame {
+        TriNode node;  // 枝ノード
+        rect_t  rect;  // 枝ノードの直方体
+
+        // レイと交差する子ノード (交点が近い順)
+        std::array<ChildItem, 1u << DIM> children;
+        size_t                       num_children;
+
+        // 次に処理する children の位置
+        size_t next_child;
+    };
+
+
+    /** @brief find_hits() で収集する交点
+     */
+    struct HitItem {
+        ray_elem_t distance;  // 交点までの距離
+        size_t          tid;  // 交差した三角形のインデックス
+    };
+
+
+    /** @brief パケット内の 1 本のレイの状態
+     */
+    struct Lane {
+        std::optional<Ray> ray;
+
+        Frame*         stack;  // トラバース用スタック (要素数はツリーの最大深度)
+        size_t         depth;  // stack の使用数
+
+        TriNode leaf;  // 次に処理する葉ノード
+
+        ray_elem_t distance;  // 交点までの距離 (交差がないときは limit)
+    };
+
+
+    /** @brief パケット処理の作業領域
+     */
+    struct PacketWork {
+        std::array<Lane, PACKET_SIZE> lanes;
+
+        std::vector<Frame>         stacks;   // 各 Lane::stack の領域
+        // 三角形ブロックごとの (世代 << PACKET_SIZE) | (処理済みのレイのマスク)
+        std::vector<uint32_t> visited;
+
+        // 現在のパケットの世代 (パケットごとに増やす)
+        uint32_t generation = 0;
+    };
+
+
+    /** @brief レイとの交点を探す
+     *
+     *  交点までの距離を返す。交差しないときは ray.limit を返す。
+     *
+     *  ray.any_hit が true のときは最初に見つかった交点の距離を返す。
+     *
+     *  交差した三角形を見つけたときは ray.crossed_triangle に設定する。
+     */
+    ray_elem_t
+    find_ray_distance( Ray& ray )
+    {
+        // 前のレイで登録された三角形ブロックを消去
+        clear_tblock_visited();
+
+        if ( adata_.root_node ) {
+            // 三角形ツリーあり
+            if ( adata_.bindex_size == sizeof( uint16_t ) )
+                return find_ray_distance_for_tree<uint16_t>( ray );
+            else
+                return find_ray_distance_for_tree<uint32_t>( ray );
+        }
+        else {
+            // 三角形ツリーなし
+            return find_ray_distance_for_notree( ray );
+        }
+    }
+
+
+    /** @brief タイル全体の三角形から探す
+     *
+     *  交差した三角形を見つけたときは ray.crossed_triangle に設定する。
+     */
+    ray_elem_t
+    find_ray_distance_for_notree( Ray& ray )
+    {
+        const size_t b_tid = 0;
+        const size_t e_tid = adata_.num_triangles;
+        const ray_elem_t min_limit = ray.limit;
+
+        Stats::add( &Stats::ray_triangles, e_tid - b_tid );
+
+        if ( adata_.vindex_size == sizeof( uint16_t ) )
+            return find_ray_distance_for_triangles<uint16_t>( ray, b_tid, e_tid, min_limit );
+        else
+            return find_ray_distance_for_triangles<uint32_t>( ray, b_tid, e_tid, min_limit );
+    }
+
+
+    /** @brief 三角形ツリーから探す
+     *
+     *  @tparam BiType  三角形ブロックインデックスの型
      *
-     *  @see check_and_register_tblock_index()
+     *  交差する子ノードを交点が近い順に深さ優先でトラバースし、最初に交差が見
+     *  つかった葉ノードで処理を終了する。
+     *
+     *  交差した三角形を見つけたときは ray.crossed_triangle に設定する。
+     */
+    template<typename BiType>
+    ray_elem_t
+    find_ray_distance_for_tree( Ray& ray )
+    {
+        size_t depth = 0;
+
+        // ルートノードから開始
+        setup_frame( ray, stack_[depth++], TriNode{ tri_tree_ }, TILE_RECT, nullptr );
+
+        for ( ;; ) {
+            const auto leaf_node = next_leaf( ray, stack_.data(), depth, nullptr );
+
+            if ( leaf_node.is_none() ) {
+                // すべての葉ノードを処理した
+                return ray.limit;
+            }
+
+            // 交点までの距離 (limit のときは交差なし)
+            const auto distance = find_ray_distance_for_leaf<BiType>( ray, leaf_node );
+
+            if ( distance != ray.limit ) {
+                // 交差する点が見つかったので、全体の処理を終了
+                return distance;
+            }
+        }
+    }
+
+
+    /** @brief 次の葉ノードを取得
+     *
+     *  トラバースの状態 stack[0], ..., stack[depth - 1] から処理を進めて、ray
+     *  と交差する次の葉ノードを返す。葉ノードがなくなったときは NONE ノードを
+     *  返す。
+     *
+     *  stack の要素数はツリーの最大深度以上でなければならない。
+     *
+     *  @param cull_rect  setup_frame() を参照
+     */
+    static TriNode
+    next_leaf( const Ray&       ray,
+               Frame*         stack,
+               size_t&        depth,
+               const rect_t* cull_rect )
+    {
+        while ( depth > 0 ) {
+            Frame& frame = stack[depth - 1];
+
+            if ( frame.next_child == frame.num_children ) {
+                // frame.node のすべての子ノードを処理したので親ノードに戻る
+                --depth;
+                continue;
+            }
+
+            const size_t     cindex = frame.children[frame.next_child++].cindex;
+            const auto   child_node = frame.node.get_child( cindex );
+
+            if ( child_node.is_branch_type() ) {
+                // 枝ノード
+                const auto child_rect = get_child_rect( frame.rect, cindex );
+                setup_frame( ray, stack[depth++], child_node, child_rect, cull_rect );
+            }
+            else {
+                // 葉ノード
+                assert( child_node.is_leaf_type() );
+                Stats::add( &Stats::ray_nodes, 1 );
+                return child_node;
+            }
+        }
+
+        return TriNode{};
+    }
+
+
+    /** @brief 葉ノードの処理
+     *
+     *  @tparam BiType  三角形ブロックインデックスの型
      */
-    static constexpr auto ALREADY_REGISTERED_TBLOCK_INDEX = static_cast<size_t>( -1 );
+    template<typename BiType>
+    ray_elem_t
+    find_ray_distance_for_leaf( Ray&           ray,
+                                const TriNode& tri_node )
+    {
+        assert( tri_node.is_leaf_type() );
+
+        const size_t           num_tblocks = tri_node.num_tblocks();
+        const BiType* const tblock_indices = tri_node.get_tblock_indices<BiType>();
+
+        // 葉ノードの三角形ブロックから距離を探す
+        if ( adata_.vindex_size == sizeof( uint16_t ) ) {
+            if ( adata_.tindex_size == sizeof( uint16_t ) )
+                return find_ray_distance_for_tblocks<uint16_t, uint16_t>( ray, tblock_indices, num_tblocks );
+            else
+                return find_ray_distance_for_tblocks<uint16_t, uint32_t>( ray, tblock_indices, num_tblocks );
+        }
+        else {
+            if ( adata_.tindex_size == sizeof( uint16_t ) )
+                return find_ray_distance_for_tblocks<uint32_t, uint16_t>( ray, tblock_indices, num_tblocks );
+            else
+                return find_ray_distance_for_tblocks<uint32_t, uint32_t>( ray, tblock_indices, num_tblocks );
+        }
+    }
+
+
+    /** @brief 三角形ブロックの集合から探す
+     *
+     *  すでに他の葉ノードで処理された三角形ブロックは無視する。
+     *
+     *  @tparam ViType  頂点インデックスの型
+     *  @tparam TiType  三角形インデックスの型
+     *  @tparam BiType  三角形ブロックインデックスの型
+     */
+    template<typename ViType,
+             typename TiType,
+             typename BiType>
+    ray_elem_t
+    find_ray_distance_for_tblocks( Ray&                ray,
+                                   const BiType* tblock_indices,
+                                   size_t           num_tblocks )
+    {
+        ray_elem_t min_limit = ray.limit;
+
+        const auto tblock_table = static_cast<const TiType*>( adata_.tblock_table );
+
+        for ( size_t i = 0; i < num_tblocks; ++i ) {
+
+            const size_t bindex = tblock_indices[i];
+
+            assert( bindex < adata_.num_tblocks );
+
+            if ( !register_tblock_index( bindex ) ) {
+                // 処理済みの三角形ブロック
+                continue;
+            }
+
+            const size_t b_tid = tblock_table[bindex];
+
+            const size_t e_tid = (bindex == adata_.num_tblocks - 1) ?
+                                 adata_.num_triangles :
+                                 tblock_table[bindex + 1];
+
+            Stats::add( &Stats::ray_triangles, e_tid - b_tid );
 
+            min_limit = find_ray_distance_for_triangles<ViType>( ray, b_tid, e_tid, min_limit );
+
+            if ( ray.any_hit && min_limit != ray.limit ) {
+                // 交差が見つかったので、残りのブロックは調べない
+                break;
+            }
+        }
+
+        return min_limit;
+    }
+
+
+    /** @brief 三角形の範囲から探す
+     *
+     *  @tparam ViType  頂点インデックスの型
+     *
+     *  B3DTILE_SIMD が真のときは、4 個の三角形ごとに単精度で保守的な判定を行
+     *  い、交差の可能性がある三角形だけを倍精度で判定する。結果は三角形を 1 個
+     *  ずつ判定したときと同じである。
+     */
+    template<typename ViType>
+    ray_elem_t
+    find_ray_distance_for_triangles( Ray&        ray,
+                                     size_t begin_tid,
+                                     size_t   end_tid,
+                                     ray_elem_t limit )
+    {
+        auto ldist = limit;
+
+        size_t tid = begin_tid;
+
+#if B3DTILE_SIMD
+        for ( ; tid + 4 <= end_tid; tid += 4 ) {
+            // 交差の可能性がある三角形 (ビット i が tid + i に対応)
+            const auto       points_x4 = get_triangle_points_x4<ViType>( tid );
+            const unsigned  candidates = select_triangle_candidates( ray, points_x4, ldist );
+
+            for ( size_t i = 0; i < 4; ++i ) {
+                if ( candidates & (1u << i) ) {
+                    const auto points = get_triangle_points<ViType>( tid + i );
+                    if ( update_ray_distance_for_triangle( ray, tid + i, points, ldist ) && ray.any_hit ) {
+                        // 最も近い交差である必要はないので終了
+                        return ldist;
+                    }
+                }
+            }
+        }
+#endif
+
+        for ( ; tid < end_tid; ++tid ) {
+            const auto points = get_triangle_points<ViType>( tid );
+            if ( update_ray_distance_for_triangle( ray, tid, points, ldist ) && ray.any_hit ) {
+                // 最も近い交差である必要はないので終了
+                break;
+            }
+        }
+
+        return ldist;
+    }
+
+
+    /** @brief 三角形ツリーからすべての交点を収集
+     *
+     *  @tparam BiType  三角形ブロックインデックスの型
+     *
+     *  線分 [ray, limit] と交差するすべての葉ノードを処理する。複数の葉ノード
+     *  に含まれる三角形ブロックは 1 回だけ処理するので、同じ三角形が重複して
+     *  収集されることはない。
+     */
+    template<typename BiType>
+    void
+    collect_hits_for_tree( Ray& ray )
+    {
+        size_t depth = 0;
+
+        // ルートノードから開始
+        setup_frame( ray, stack_[depth++], TriNode{ tri_tree_ }, TILE_RECT, nullptr );
+
+        for ( ;; ) {
+            const auto leaf_node = next_leaf( ray, stack_.data(), depth, nullptr );
+
+            if ( leaf_node.is_none() ) {
+                // すべての葉ノードを処理した
+                break;
+            }
+
+            const size_t           num_tblocks = leaf_node.num_tblocks();
+            const BiType* const tblock_indices = leaf_node.get_tblock_indices<BiType>();
+
+            if ( adata_.vindex_size == sizeof( uint16_t ) ) {
+                if ( adata_.tindex_size == sizeof( uint16_t ) )
+                    collect_hits_for_tblocks<uint16_t, uint16_t>( ray, tblock_indices, num_tblocks );
+                else
+                    collect_hits_for_tblocks<uint16_t, uint32_t>( ray, tblock_indices, num_tblocks );
+            }
+            else {
+                if ( adata_.tindex_size == sizeof( uint16_t ) )
+                    collect_hits_for_tblocks<uint32_t, uint16_t>( ray, tblock_indices, num_tblocks );
+                else
+                    collect_hits_for_tblocks<uint32_t, uint32_t>( ray, tblock_indices, num_tblocks );
+            }
+        }
+    }
+
+
+    /** @brief 三角形ブロックの集合から交点を収集
+     *
+     *  すでに他の葉ノードで処理された三角形ブロックは無視する。
+     */
+    template<typename ViType,
+             typename TiType,
+             typename BiType>
+    void
+    collect_hits_for_tblocks( Ray&                ray,
+                              const BiType* tblock_indices,
+                              size_t           num_tblocks )
+    {
+        const auto tblock_table = static_cast<const TiType*>( adata_.tblock_table );
+
+        for ( size_t i = 0; i < num_tblocks; ++i ) {
+
+            const size_t bindex = tblock_indices[i];
+
+            assert( bindex < adata_.num_tblocks );
+
+            if ( !register_tblock_index( bindex ) ) {
+                // 処理済みの三角形ブロック
+                continue;
+            }
+
+            const size_t b_tid = tblock_table[bindex];
+
+            const size_t e_tid = (bindex == adata_.num_tblocks - 1) ?
+                                 adata_.num_triangles :
+                                 tblock_table[bindex + 1];
+
+            Stats::add( &Stats::ray_triangles, e_tid - b_tid );
+
+            collect_hits_for_triangles<ViType>( ray, b_tid, e_tid );
+        }
+    }
+
+
+    /** @brief 三角形の範囲から交点を収集
+     *
+     *  距離 t が 0 < t < ray.limit の範囲で ray と交差する三角形を hits_ に追
+     *  加する。
+     */
+    template<typename ViType>
+    void
+    collect_hits_for_triangles( Ray&        ray,
+                                size_t begin_tid,
+                                size_t   end_tid )
+    {
+        size_t tid = begin_tid;
+
+#if B3DTILE_SIMD
+        for ( ; tid + 4 <= end_tid; tid += 4 ) {
+            // 交差の可能性がある三角形 (ビット i が tid + i に対応)
+            const auto       points_x4 = get_triangle_points_x4<ViType>( tid );
+            const unsigned  candidates = select_triangle_candidates( ray, points_x4, ray.limit );
+
+            for ( size_t i = 0; i < 4; ++i ) {
+                if ( candidates & (1u << i) ) {
+                    collect_hit_for_triangle<ViType>( ray, tid + i );
+                }
+            }
+        }
+#endif
 
-    /** @brief 割り当てなしを表すの feature ID
-     */
-    static constexpr feature_id_t UNASSIGNED_FEATURE_ID = { 0, 0 };
+        for ( ; tid < end_tid; ++tid ) {
+            collect_hit_for_triangle<ViType>( ray, tid );
+        }
+    }
 
 
-  public:
-    /** @brief 初期化
-     *
-     *  adata は参照のみを保持すること注意すること。
+    /** @brief 1 個の三角形の交点を収集
      */
-    RaySolver( const Analyzer&                adata,
-               const coords_t<double, DIM>& ray_pos,
-               const coords_t<double, DIM>& ray_dir,
-               double                         limit,
-               const rect_t&                  lrect )
-        : adata_{ adata },
-          ray_pos_{ ALCS_TO_U16<ray_elem_t> * ray_vec_t{ ray_pos } },
-          ray_dir_{ ALCS_TO_U16<ray_elem_t> * ray_vec_t{ ray_dir } },
-          limit_{ limit },
-          lrect_{ lrect },
-          lrect_lower_dist_{ std::numeric_limits<ray_elem_t>::lowest() },
-          lrect_upper_dist_{ std::numeric_limits<ray_elem_t>::max()    },
-          crossed_triangle_{ 0 }
+    template<typename ViType>
+    void
+    collect_hit_for_triangle( Ray&   ray,
+                              size_t tid )
     {
-        setup_lrect_distance_bounds( ray_pos, ray_dir, lrect );
+        auto ldist = ray.limit;
+
+        const auto points = get_triangle_points<ViType>( tid );
+
+        if ( update_ray_distance_for_triangle( ray, tid, points, ldist ) ) {
+            hits_.push_back( { ldist, tid } );
+        }
     }
 
 
-    /** @brief 処理を実行
+    /** @brief パケットを処理
+     *
+     *  rays に格納された num_lanes 本のレイを処理して、その結果を
+     *  packet_->lanes に設定する。
+     *
+     *  各レイは find_ray_distance() と同じ順序で自身の葉ノードを処理する。そ
+     *  の際、同じ葉ノードを処理するレイをまとめて、三角形の頂点の読み込みを共
+     *  有する。そのため結果は find_ray_distance() と同じになる。
      */
     void
-    run()
+    trace_packet( size_t        num_lanes,
+                  const wasm_f64_t*  rays,
+                  bool            any_hit )
     {
-        ray_elem_t distance;
+        assert( num_lanes <= PACKET_SIZE );
 
-        if ( adata_.root_node ) {
-            // 三角形ツリーあり
-            const TriNode root_node{ adata_.root_node };
+        setup_packet_work();
 
-            if ( adata_.bindex_size == sizeof( uint16_t ) )
-                distance = find_ray_distance_for_branch<uint16_t>( root_node, TILE_RECT );
-            else
-                distance = find_ray_distance_for_branch<uint32_t>( root_node, TILE_RECT );
+        auto& lanes = packet_->lanes;
+
+        for ( size_t i = 0; i < num_lanes; ++i ) {
+            auto& lane = lanes[i];
+            lane.ray.emplace( rays + RAY_NUM_ELEMS * i, any_hit );
+            lane.distance = lane.ray->limit;
         }
-        else {
+
+        if ( !adata_.root_node ) {
             // 三角形ツリーなし
-            distance = find_ray_distance_for_notree();
+            for ( size_t i = 0; i < num_lanes; ++i ) {
+                lanes[i].distance = find_ray_distance( *lanes[i].ray );
+            }
+            return;
         }
 
-        const auto feature_id = (adata_.findex_size == sizeof( uint16_t )) ?
-                                get_feature_id<uint16_t>() :
-                                get_feature_id<uint32_t>();
+        // パケットのすべての線分を包含する直方体
+        rect_t cull_rect;
+        const rect_t* cull = get_packet_bounds( num_lanes, rays, cull_rect ) ? &cull_rect : nullptr;
 
-        // 結果を JavaScript 側に通知
-        ray_result_( static_cast<wasm_f64_t>( distance ),
-                     static_cast<wasm_f64_t>( feature_id[0] ),
-                     static_cast<wasm_f64_t>( feature_id[1] ) );
-    }
+        // 前のパケットで登録された三角形ブロックを消去
+        clear_packet_tblock_visited();
 
+        // 処理中のレイ (ビット i が lanes[i] に対応)
+        unsigned pending = 0;
 
-  private:
-    /** @brief lrect_*_dist_ を初期化
-     *
-     *  アルゴリズムは find_ray_distance_for_rect() を参照のこと。
-     */
-    void
-    setup_lrect_distance_bounds( const ray_vec_t& ray_pos,
-                                 const ray_vec_t& ray_dir,
-                                 const rect_t&      lrect )
-    {
-        for ( size_t i = 0; i < 3; ++i ) {
-            const ray_elem_t rect_lower_i = lrect.lower[i];
-            const ray_elem_t rect_upper_i = lrect.upper[i];
+        for ( size_t i = 0; i < num_lanes; ++i ) {
+            auto& lane = lanes[i];
 
-            const auto& rni = ray_dir[i];  // r . n_i
+            lane.depth = 0;
+            setup_frame( *lane.ray, lane.stack[lane.depth++], TriNode{ tri_tree_ }, TILE_RECT, cull );
+            lane.leaf = next_leaf( *lane.ray, lane.stack, lane.depth, cull );
 
-            if ( rni != 0 ) {
-                // tA = ((P_0 - q) . n_i) / (r . n_i)
-                // tB = ((P_1 - q) . n_i) / (r . n_i)
-                const auto tA = (rect_lower_i - ray_pos[i]) / rni;
-                const auto tB = (rect_upper_i - ray_pos[i]) / rni;
+            if ( !lane.leaf.is_none() ) {
+                pending |= 1u << i;
+            }
+        }
 
-                const auto t0 = (rni > 0) ? tA : tB;
-                const auto t1 = (rni > 0) ? tB : tA;
-                assert( t0 < t1 );
+        while ( pending != 0 ) {
+            // 同じ葉ノードを処理するレイをまとめて処理
+            unsigned remaining = pending;
 
-                lrect_lower_dist_ = std::max( t0, lrect_lower_dist_ );
-                lrect_upper_dist_ = std::min( t1, lrect_upper_dist_ );
+            for ( size_t i = 0; i < num_lanes; ++i ) {
+                if ( (remaining & (1u << i)) == 0 ) {
+                    continue;
+                }
 
-                assert( lrect_lower_dist_ < lrect_upper_dist_ );
-            }
-            else { // rni == 0
-                assert( (ray_pos[i] - rect_lower_i >=  0) &&
-                        (ray_pos[i] - rect_upper_i <   0) );
+                const auto leaf_node = lanes[i].leaf;
+
+                unsigned group = 0;
+                for ( size_t j = i; j < num_lanes; ++j ) {
+                    if ( (remaining & (1u << j)) && lanes[j].leaf == leaf_node ) {
+                        group |= 1u << j;
+                    }
+                }
+
+                remaining &= ~group;
+
+                trace_packet_leaf( leaf_node, group, num_lanes );
+
+                // 各レイの次の葉ノードを取得
+                for ( size_t j = i; j < num_lanes; ++j ) {
+                    if ( (group & (1u << j)) == 0 ) {
+                        continue;
+                    }
+
+                    auto& lane = lanes[j];
+
+                    if ( lane.distance != lane.ray->limit ) {
+                        // 交差する点が見つかったので、このレイの処理を終了
+                        pending &= ~(1u << j);
+                        continue;
+                    }
+
+                    lane.leaf = next_leaf( *lane.ray, lane.stack, lane.depth, cull );
+
+                    if ( lane.leaf.is_none() ) {
+                        // すべての葉ノードを処理した
+                        pending &= ~(1u << j);
+                    }
+                }
             }
         }
     }
 
 
-    /** @brief タイル全体の三角形から探す
+    /** @brief packet_ を準備
      *
-     *  交差した三角形を見つけたときは crossed_triangle_ に設定する。
+     *  最初にパケット処理を行うときに作業領域を確保する。
      */
-    ray_elem_t
-    find_ray_distance_for_notree()
+    void
+    setup_packet_work()
     {
-        const size_t b_tid = 0;
-        const size_t e_tid = adata_.num_triangles;
-        const ray_elem_t min_limit = limit_;
+        if ( packet_ ) {
+            // すでに確保されている
+            return;
+        }
 
-        if ( adata_.vindex_size == sizeof( uint16_t ) )
-            return find_ray_distance_for_triangles<uint16_t>( b_tid, e_tid, min_limit );
-        else
-            return find_ray_distance_for_triangles<uint32_t>( b_tid, e_tid, min_limit );
+        packet_ = std::make_unique<PacketWork>();
+
+        const size_t   max_depth = stack_.size();
+
+        packet_->stacks.resize( PACKET_SIZE * max_depth );
+        packet_->visited.resize( adata_.num_tblocks, 0 );
+
+        for ( size_t i = 0; i < PACKET_SIZE; ++i ) {
+            packet_->lanes[i].stack = packet_->stacks.data() + max_depth * i;
+        }
     }
 
 
-    /** @brief 枝ノードの処理
+    /** @brief パケットの線分を包含する直方体を取得
      *
-     *  @tparam BiType  三角形ブロックインデックスの型
+     *  rays に格納された num_lanes 本のレイの線分 [ray, limit] をすべて包含す
+     *  る直方体 (ALCS) を bounds に設定して true を返す。
      *
-     *  交差した三角形を見つけたときは crossed_triangle_ に設定する。
+     *  線分が有限の範囲に収まらないときは false を返す。
      */
-    template<typename BiType>
-    ray_elem_t
-    find_ray_distance_for_branch( const TriNode& tri_node,
-                                  const rect_t& node_rect )
+    static bool
+    get_packet_bounds( size_t        num_lanes,
+                       const wasm_f64_t*  rays,
+                       rect_t&          bounds )
     {
-        assert( tri_node.is_branch_type() );
+        std::array<double, DIM> lower;
+        std::array<double, DIM> upper;
 
-        for ( const auto& cindex : children_in_crossing_order<BiType>( tri_node, node_rect ) ) {
+        lower.fill( std::numeric_limits<double>::infinity() );
+        upper.fill( -std::numeric_limits<double>::infinity() );
 
-            const auto child_node = tri_node.get_child<BiType>( cindex );
+        for ( size_t i = 0; i < num_lanes; ++i ) {
+            const wasm_f64_t* const src = rays + RAY_NUM_ELEMS * i;
 
-            // 交点までの距離 (limit のときは交差なし)
-            ray_elem_t distance;
+            for ( size_t j = 0; j < DIM; ++j ) {
+                const double p0 = src[j];
+                const double p1 = src[j] + src[6] * src[3 + j];
 
-            if ( child_node.is_branch_type() ) {
-                // 枝ノード
-                const auto child_rect = get_child_rect( node_rect, cindex );
-                distance = find_ray_distance_for_branch<BiType>( child_node, child_rect );
-            }
-            else {
-                // 葉ノード
-                assert( child_node.is_leaf_type() );
-                distance = find_ray_distance_for_leaf<BiType>( child_node );
+                lower[j] = std::min( { p0, p1, lower[j] } );
+                upper[j] = std::max( { p0, p1, upper[j] } );
             }
+        }
 
-            if ( distance != limit_ ) {
-                // 交差する点が見つかったので、全体の処理を終了
-                return distance;
+        // 丸め誤差と接触を考慮して拡大する量
+        constexpr double margin = 1.0 / 65536;
+
+        // 単精度で扱うことのできる大きさの上限
+        constexpr double max_abs = 1 << 20;
+
+        for ( size_t j = 0; j < DIM; ++j ) {
+            if ( !(lower[j] > -max_abs && upper[j] < max_abs) ) {
+                // NaN, 無限大, 過大な値
+                return false;
             }
+
+            bounds.lower[j] = static_cast<real_t>( lower[j] - margin );
+            bounds.upper[j] = static_cast<real_t>( upper[j] + margin );
         }
 
-        return limit_;
+        return true;
     }
 
 
-    /** @brief 葉ノードの処理
+    /** @brief パケットの葉ノードの処理
+     *
+     *  group に含まれるレイ (ビット i が packet_->lanes[i] に対応) に対して葉
+     *  ノード tri_node を処理する。
+     */
+    void
+    trace_packet_leaf( const TriNode& tri_node,
+                       unsigned          group,
+                       size_t        num_lanes )
+    {
+        if ( adata_.bindex_size == sizeof( uint16_t ) )
+            trace_packet_leaf<uint16_t>( tri_node, group, num_lanes );
+        else
+            trace_packet_leaf<uint32_t>( tri_node, group, num_lanes );
+    }
+
+
+    /** @brief パケットの葉ノードの処理
      *
      *  @tparam BiType  三角形ブロックインデックスの型
      */
     template<typename BiType>
-    ray_elem_t
-    find_ray_distance_for_leaf( const TriNode& tri_node )
+    void
+    trace_packet_leaf( const TriNode& tri_node,
+                       unsigned          group,
+                       size_t        num_lanes )
     {
         assert( tri_node.is_leaf_type() );
 
-        const size_t         num_tblocks = tri_node.num_tblocks();
-        const BiType* const leaf_tblocks = tri_node.get_tblock_indices<BiType>();
-
-        std::vector<size_t> tblock_indices;
-        tblock_indices.reserve( num_tblocks );
-
-        // tblock_indices に三角形ブロックを収集
-        for ( size_t i = 0; i < num_tblocks; ++i ) {
-            const size_t bindex = check_and_register_tblock_index( leaf_tblocks[i] );
-
-            if ( bindex != ALREADY_REGISTERED_TBLOCK_INDEX ) {
-                tblock_indices.push_back( bindex );
-            }
-        }
+        const size_t           num_tblocks = tri_node.num_tblocks();
+        const BiType* const tblock_indices = tri_node.get_tblock_indices<BiType>();
 
-        // tblock_indices から距離を探す
         if ( adata_.vindex_size == sizeof( uint16_t ) ) {
             if ( adata_.tindex_size == sizeof( uint16_t ) )
-                return find_ray_distance_for_tblocks<uint16_t, uint16_t>( tblock_indices );
+                trace_packet_tblocks<uint16_t, uint16_t>( tblock_indices, num_tblocks, group, num_lanes );
             else
-                return find_ray_distance_for_tblocks<uint16_t, uint32_t>( tblock_indices );
+                trace_packet_tblocks<uint16_t, uint32_t>( tblock_indices, num_tblocks, group, num_lanes );
         }
         else {
             if ( adata_.tindex_size == sizeof( uint16_t ) )
-                return find_ray_distance_for_tblocks<uint32_t, uint16_t>( tblock_indices );
+                trace_packet_tblocks<uint32_t, uint16_t>( tblock_indices, num_tblocks, group, num_lanes );
             else
-                return find_ray_distance_for_tblocks<uint32_t, uint32_t>( tblock_indices );
+                trace_packet_tblocks<uint32_t, uint32_t>( tblock_indices, num_tblocks, group, num_lanes );
         }
     }
 
 
-    /** @brief 三角形ブロックの集合から探す
+    /** @brief パケットで三角形ブロックの集合を処理
      *
-     *  @tparam ViType  頂点インデックスの型
-     *  @tparam TiType  三角形インデックスの型
+     *  find_ray_distance_for_tblocks() と同じ処理を group のレイに対して行い、
+     *  各レイの Lane::distance を更新する。
+     *
+     *  三角形は同じ順序で処理し、頂点の読み込みだけをレイ間で共有する。
      */
     template<typename ViType,
-             typename TiType>
-    ray_elem_t
-    find_ray_distance_for_tblocks( const std::vector<size_t>& tblock_indices )
+             typename TiType,
+             typename BiType>
+    void
+    trace_packet_tblocks( const BiType* tblock_indices,
+                          size_t           num_tblocks,
+                          unsigned               group,
+                          size_t             num_lanes )
     {
-        ray_elem_t min_limit = limit_;
+        auto& lanes = packet_->lanes;
 
         const auto tblock_table = static_cast<const TiType*>( adata_.tblock_table );
 
-        for ( const size_t bindex : tblock_indices ) {
+        // この葉ノードで処理を続けるレイ
+        unsigned active = group;
+
+        for ( size_t k = 0; k < num_tblocks && active != 0; ++k ) {
+
+            const size_t bindex = tblock_indices[k];
+            assert( bindex < adata_.num_tblocks );
+
+            // bindex を初めて処理するレイ
+            unsigned targets = register_packet_tblock_index( bindex, active );
 
             const size_t b_tid = tblock_table[bindex];
 
@@ -253,92 +1094,307 @@ class Tile::RaySolver : Base {
                                  adata_.num_triangles :
                                  tblock_table[bindex + 1];
 
-            min_limit = find_ray_distance_for_triangles<ViType>( b_tid, e_tid, min_limit );
-        }
+            Stats::add( &Stats::ray_triangles, (e_tid - b_tid) * std::bitset<PACKET_SIZE>( targets ).count() );
 
-        return min_limit;
+            size_t tid = b_tid;
+
+#if B3DTILE_SIMD
+            for ( ; tid + 4 <= e_tid && targets != 0; tid += 4 ) {
+                const auto points_x4 = get_triangle_points_x4<ViType>( tid );
+
+                for ( size_t i = 0; i < num_lanes; ++i ) {
+                    if ( (targets & (1u << i)) == 0 ) {
+                        continue;
+                    }
+
+                    auto& lane = lanes[i];
+
+                    const unsigned candidates = select_triangle_candidates( *lane.ray, points_x4, lane.distance );
+
+                    for ( size_t c = 0; c < 4; ++c ) {
+                        if ( candidates & (1u << c) ) {
+                            const auto points = get_triangle_points<ViType>( tid + c );
+                            if ( update_ray_distance_for_triangle( *lane.ray, tid + c, points, lane.distance ) && lane.ray->any_hit ) {
+                                // 最も近い交差である必要はないので、このレイは終了
+                                targets &= ~(1u << i);
+                                active  &= ~(1u << i);
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+#endif
+
+            for ( ; tid < e_tid && targets != 0; ++tid ) {
+                const auto points = get_triangle_points<ViType>( tid );
+
+                for ( size_t i = 0; i < num_lanes; ++i ) {
+                    if ( (targets & (1u << i)) == 0 ) {
+                        continue;
+                    }
+
+                    auto& lane = lanes[i];
+
+                    if ( update_ray_distance_for_triangle( *lane.ray, tid, points, lane.distance ) && lane.ray->any_hit ) {
+                        // 最も近い交差である必要はないので、このレイは終了
+                        targets &= ~(1u << i);
+                        active  &= ~(1u << i);
+                    }
+                }
+            }
+        }
     }
 
 
-    /** @brief 三角形の範囲から探す
+    /** @brief 1 個の三角形との交差を判定
      *
-     *  @tparam ViType  頂点インデックスの型
+     *  頂点座標が a (a_0, a_1, a_2) の三角形 tid と ldist より近い位置で交差す
+     *  るとき、ldist と ray.crossed_triangle を更新して true を返す。それ以外
+     *  のときは何もせずに false を返す。
      *
      *  @see 文献 LargeScale3DScene の「レイと三角形の交点」
      */
-    template<typename ViType>
-    ray_elem_t
-    find_ray_distance_for_triangles( size_t begin_tid,
-                                     size_t   end_tid,
-                                     ray_elem_t limit )
+    static bool
+    update_ray_distance_for_triangle( Ray&                                          ray,
+                                      size_t                                        tid,
+                                      const std::array<ray_vec_t, NUM_TRI_CORNERS>& a,
+                                      ray_elem_t&                               ldist )
     {
-        auto ldist = limit;
+        Stats::add( &Stats::ray_exact_tests, 1 );
 
-        for ( size_t tid = begin_tid; tid < end_tid; ++tid ) {
-            const auto  a   = get_triangle_points<ViType>( tid );  // a_0, a_1, a_2
-            const auto& r   = ray_dir_;
-            const auto  a1_ = a[1]     - a[0];
-            const auto  a2_ = a[2]     - a[0];
-            const auto  q_  = ray_pos_ - a[0];  // q - a_0
+        const auto& r   = ray.dir;
+        const auto  a1_ = a[1]     - a[0];
+        const auto  a2_ = a[2]     - a[0];
+        const auto  q_  = ray.pos - a[0];  // q - a_0
 
-            // 三角形の面法線
-            const auto n = cross( a1_, a2_ );
+        // 三角形の面法線
+        const auto n = cross( a1_, a2_ );
 
-            // 面方向の確認
-            if ( dot( r, n ) >= 0 ) {
-                // レイ方向と三角形の面法線が向かい合っていないので対象外
-                continue;
-            }
+        // 面方向の確認
+        if ( dot( r, n ) >= 0 ) {
+            // レイ方向と三角形の面法線が向かい合っていないので対象外
+            return false;
+        }
 
-            // 奥行き距離の確認
-            const auto t = -dot( q_, n ) / dot( r, n );
+        // 奥行き距離の確認
+        const auto t = -dot( q_, n ) / dot( r, n );
 
-            if ( t < lrect_lower_dist_ || t > lrect_upper_dist_ ) {
-                // 交差したとしても、交点は制限直方体の外側にある
-                continue;
-            }
+        if ( t < ray.lrect_lower_dist || t > ray.lrect_upper_dist ) {
+            // 交差したとしても、交点は制限直方体の外側にある
+            return false;
+        }
 
-            if ( t <= 0 || t >= ldist ) {
-                // 交差したとしても
-                //   - 交点はレイの始点と終点の間にならない
-                //   - さらに近い三角形がすでに見つかっている
-                continue;
-            }
+        if ( t <= 0 || t >= ldist ) {
+            // 交差したとしても
+            //   - 交点はレイの始点と終点の間にならない
+            //   - さらに近い三角形がすでに見つかっている
+            return false;
+        }
 
-            /* 重心座標 μ_i の計算 */
-            using vec2_t = Vector<ray_elem_t, 2>;
+        /* 重心座標 μ_i の計算 */
+        using vec2_t = Vector<ray_elem_t, 2>;
 
-            const auto a1_a1 = dot( a1_, a1_ );
-            const auto a1_a2 = dot( a1_, a2_ );
-            const auto a2_a2 = dot( a2_, a2_ );
+        const auto a1_a1 = dot( a1_, a1_ );
+        const auto a1_a2 = dot( a1_, a2_ );
+        const auto a2_a2 = dot( a2_, a2_ );
 
-            // μ_1, μ_2 の計算式の一番左側の項
-            const auto ka = 1 / (a1_a1 * a2_a2 - a1_a2 * a1_a2);
+        // μ_1, μ_2 の計算式の一番左側の項
+        const auto ka = 1 / (a1_a1 * a2_a2 - a1_a2 * a1_a2);
 
-            // μ_1, μ_2 の計算式の一番右側の項
-            const auto kq = q_ - dot( n, q_ ) / dot( n, r ) * r;
+        // μ_1, μ_2 の計算式の一番右側の項
+        const auto kq = q_ - dot( n, q_ ) / dot( n, r ) * r;
 
-            // μ_1, μ_2 の計算式の右側 2 項の結合
-            const vec2_t kc{ dot( a1_, kq ), dot( a2_, kq ) };
+        // μ_1, μ_2 の計算式の右側 2 項の結合
+        const vec2_t kc{ dot( a1_, kq ), dot( a2_, kq ) };
 
-            // μ_1, μ_2 の計算
-            const auto mu1 = ka * dot( vec2_t{  a2_a2, -a1_a2 }, kc );
-            const auto mu2 = ka * dot( vec2_t{ -a1_a2,  a1_a1 }, kc );
+        // μ_1, μ_2 の計算
+        const auto mu1 = ka * dot( vec2_t{  a2_a2, -a1_a2 }, kc );
+        const auto mu2 = ka * dot( vec2_t{ -a1_a2,  a1_a1 }, kc );
 
-            if ( mu1 < 0 || mu2 < 0 || 1 - mu1 - mu2 < 0 ) {
-                // 交点は三角形の外側にあるので対象外
-                continue;
-            }
+        if ( mu1 < 0 || mu2 < 0 || 1 - mu1 - mu2 < 0 ) {
+            // 交点は三角形の外側にあるので対象外
+            return false;
+        }
+
+        // これまでで一番近い交差になったので、最短距離を更新
+        ldist = t;
+
+        // 交差した三角形を更新
+        ray.crossed_triangle = tid;
+
+        return true;
+    }
+
+
+#if B3DTILE_SIMD
+    /** @brief 交差の可能性がある三角形を選ぶ
+     *
+     *  頂点座標が pts の 4 個の三角形 (get_triangle_points_x4() を参照) を単精
+     *  度で同時に判定し、交差の可能性がある三角形をビット集合 (ビット i が要素
+     *  i に対応) で返す。
+     *
+     *  update_ray_distance_for_triangle() で交差すると判定される三角形は必ず
+     *  選ばれる。そのため、各判定には単精度の丸め誤差を十分に上回る許容誤差を
+     *  与え、面法線とレイ方向が直交に近い (倍精度でも悪条件の) 三角形は常に選
+     *  ぶ。
+     *
+     *  判定は Möller–Trumbore 法の除算を行わない形式で行う。
+     */
+    static unsigned
+    select_triangle_candidates( const Ray&                                                 ray,
+                                const std::array<std::array<f32x4, DIM>, NUM_TRI_CORNERS>& pts,
+                                ray_elem_t                                               ldist )
+    {
+        // 相対許容誤差 (単精度の丸め誤差の上限より十分に大きい値)
+        const f32x4 rel_tol{ 1.0f / 4096 };
+
+        // レイの始点と方向
+        const auto& p = ray.pos_f32;
+        const auto& r = ray.dir_f32;
+
+        const auto e1 = sub_x4( pts[1], pts[0] );  // a_1 - a_0
+        const auto e2 = sub_x4( pts[2], pts[0] );  // a_2 - a_0
+        const auto q  = sub_x4( p,      pts[0] );  // q - a_0
+
+        // det = e1 . (r x e2) = -(r . n)
+        const auto pv  = cross_x4( r, e2 );
+        const auto det = dot_x4( e1, pv );
+
+        // u = det * μ_1, v = det * μ_2, tn = det * t
+        const auto qv = cross_x4( q, e1 );
+        const auto u  = dot_x4( q, pv );
+        const auto v  = dot_x4( r, qv );
+        const auto tn = dot_x4( e2, qv );
+
+        // 許容誤差 (各値の大きさの上限に比例)
+        const auto es = max( norm1_x4( e1 ), norm1_x4( e2 ) );
+        const auto qs = norm1_x4( q ) + f32x4{ ray.pos_norm1 };
+        const f32x4 rs{ ray.dir_norm1 };
 
-            // これまでで一番近い交差になったので、最短距離を更新
-            ldist = t;
+        const auto tol_d = rel_tol * es * es * rs;
+        const auto tol_u = rel_tol * qs * rs * es;
+        const auto tol_t = rel_tol * es * qs * es;
 
-            // 交差した三角形を更新
-            crossed_triangle_ = tid;
+        // 交点までの距離の範囲
+        const f32x4 tmin{ ray.tmin_f32 };
+        const f32x4 tmax{ to_float_upper( std::min( ldist, ray.lrect_upper_dist ) ) };
+
+        const auto tol_tmin = tol_t + abs( tmin ) * tol_d;
+        const auto tol_tmax = tol_t + abs( tmax ) * tol_d;
+
+        const f32x4 zero{ 0 };
+
+        // 明らかに裏向きの三角形
+        const auto back_facing = det < zero - tol_d;
+
+        // det が十分に大きいときだけ判定できる条件
+        const auto decidable = det > tol_d;
+
+        const auto outside = (u < zero - tol_u) |
+                             (v < zero - tol_u) |
+                             (det - u - v < zero - tol_d - tol_u - tol_u) |
+                             (tn < tmin * det - tol_tmin) |
+                             (tn > tmax * det + tol_tmax);
+
+        const auto rejected = back_facing | (decidable & outside);
+
+        return ~rejected.to_bits() & 0b1111u;
+    }
+
+
+    /** @brief 4 個の三角形の頂点座標を取得
+     *
+     *  三角形 tid, ..., tid + 3 の頂点座標を頂点ごと、座標成分ごとにまとめて返
+     *  す。頂点座標は U16 の値なので単精度で正確に表現される。
+     */
+    template<typename ViType>
+    std::array<std::array<f32x4, DIM>, NUM_TRI_CORNERS>
+    get_triangle_points_x4( size_t tid ) const
+    {
+        const auto triangles = static_cast<const ViType*>( adata_.triangles );
+
+        const Triangle tri0{ triangles, tid     };
+        const Triangle tri1{ triangles, tid + 1 };
+        const Triangle tri2{ triangles, tid + 2 };
+        const Triangle tri3{ triangles, tid + 3 };
+
+        const auto pos = [this]( const Triangle& tri, size_t cid, size_t i ) {
+            return static_cast<float>( adata_.positions[DIM * tri.get_vertex_index( cid ) + i] );
+        };
+
+        std::array<std::array<f32x4, DIM>, NUM_TRI_CORNERS> points {{
+            {{ f32x4{ 0 }, f32x4{ 0 }, f32x4{ 0 } }},
+            {{ f32x4{ 0 }, f32x4{ 0 }, f32x4{ 0 } }},
+            {{ f32x4{ 0 }, f32x4{ 0 }, f32x4{ 0 } }},
+        }};
+
+        for ( size_t cid = 0; cid < NUM_TRI_CORNERS; ++cid ) {
+            for ( size_t i = 0; i < DIM; ++i ) {
+                points[cid][i] = f32x4{ pos( tri0, cid, i ),
+                                        pos( tri1, cid, i ),
+                                        pos( tri2, cid, i ),
+                                        pos( tri3, cid, i ) };
+            }
         }
 
-        return ldist;
+        return points;
+    }
+
+
+    /** @brief 要素ごとの差
+     */
+    static std::array<f32x4, DIM>
+    sub_x4( const std::array<f32x4, DIM>& a,
+            const std::array<f32x4, DIM>& b )
+    {
+        return {{ a[0] - b[0], a[1] - b[1], a[2] - b[2] }};
+    }
+
+
+    /** @brief 要素ごとの外積
+     */
+    static std::array<f32x4, DIM>
+    cross_x4( const std::array<f32x4, DIM>& a,
+              const std::array<f32x4, DIM>& b )
+    {
+        return {{ a[1] * b[2] - a[2] * b[1],
+                  a[2] * b[0] - a[0] * b[2],
+                  a[0] * b[1] - a[1] * b[0] }};
+    }
+
+
+    /** @brief 要素ごとの内積
+     */
+    static f32x4
+    dot_x4( const std::array<f32x4, DIM>& a,
+            const std::array<f32x4, DIM>& b )
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+
+    /** @brief 要素ごとの 1-ノルム
+     */
+    static f32x4
+    norm1_x4( const std::array<f32x4, DIM>& a )
+    {
+        return abs( a[0] ) + abs( a[1] ) + abs( a[2] );
+    }
+
+
+    /** @brief 単精度に変換
+     *
+     *  単精度で表現できない大きさの値は無限大にする。
+     */
+    static float
+    to_float_upper( ray_elem_t value )
+    {
+        return (value < std::numeric_limits<float>::max()) ?
+               static_cast<float>( value ) :
+               std::numeric_limits<float>::infinity();
     }
+#endif
 
 
     /** @brief 三角形の頂点座標を取得
@@ -365,30 +1421,35 @@ class Tile::RaySolver : Base {
     }
 
 
-    /** @brief 交差する子ノードを近い順に得る
+    /** @brief 枝ノードの状態を初期化
      *
      *  線分 [ray, limit] と交差する tri_node の子ノードのインデックスを、交点が
-     *  近い順に得る反復子可能オブジェクトを返す。
+     *  近い順に frame.children に設定する。
+     *
+     *  cull_rect が nullptr でないときは、cull_rect と交差しない子ノードを (レ
+     *  イとの交差を確認せずに) 除外する。cull_rect は線分 [ray, limit] を包含
+     *  していなければならない。
      */
-    template<typename BiType>
-    std::vector<size_t>
-    children_in_crossing_order( const TriNode& tri_node,
-                                const rect_t& node_rect ) const
+    static void
+    setup_frame( const Ray&       ray,
+                 Frame&         frame,
+                 const TriNode& tri_node,
+                 const rect_t& node_rect,
+                 const rect_t* cull_rect )
     {
         assert( tri_node.is_branch_type() );
 
-        struct Item {
-            ray_elem_t distance;
-            size_t       cindex;
+        Stats::add( &Stats::ray_nodes, 1 );
 
-            bool operator<( const Item& rhs ) const { return distance < rhs.distance; }
-        };
-        std::vector<Item> items;
+        frame.node         = tri_node;
+        frame.rect         = node_rect;
+        frame.num_children = 0;
+        frame.next_child   = 0;
 
         // 交差する子ノードを収集
         for ( size_t cindex = 0; cindex < (1u << DIM); ++cindex ) {
             // 子ノードを取得
-            const auto child_node = tri_node.get_child<BiType>( cindex );
+            const auto child_node = tri_node.get_child( cindex );
             if ( child_node.is_none() ) {
                 // { u, v, w } に子ノードはないので無視
                 continue;
@@ -396,64 +1457,66 @@ class Tile::RaySolver : Base {
 
             // 子ノードの直方体
             const auto child_rect = get_child_rect( node_rect, cindex );
-            if ( !child_rect.is_cross( lrect_ ) ) {
+            if ( !child_rect.is_cross( ray.lrect ) ) {
                 // child_node は lrect と交差しないので対象外
                 continue;
             }
 
+            if ( cull_rect != nullptr && !child_rect.is_cross( *cull_rect ) ) {
+                // child_node はレイの線分と交差しないので対象外
+                continue;
+            }
+
             // 子ノード直方体とレイの交差を確認
-            const auto distance = find_ray_distance_for_rect( child_rect );
+            const auto distance = find_ray_distance_for_rect( ray, child_rect );
 
-            if ( distance != limit_ ) {
-                // 交差するので追加
-                items.push_back( { distance, cindex } );
+            if ( distance == ray.limit ) {
+                // 交差しないので対象外
+                continue;
             }
-        }
 
-        // 距離順に並び替え
-        std::sort( items.begin(), items.end() );
+            // 距離順を保つように挿入 (同じ距離のときは cindex 順)
+            size_t pos = frame.num_children++;
 
-        // 結果を生成して返す
-        std::vector<size_t> child_indices;
-        child_indices.reserve( items.size() );
+            for ( ; pos > 0 && distance < frame.children[pos - 1].distance; --pos ) {
+                frame.children[pos] = frame.children[pos - 1];
+            }
 
-        for ( const auto& item : items ) {
-            child_indices.push_back( item.cindex );
+            frame.children[pos] = { distance, cindex };
         }
-
-        return child_indices;
     }
 
 
     /** @brief 直方体とレイとの交点を探す
      *
-     *  rect と [ray_*, limits_] との交点の中で、始点から最も近い交点までの距離
-     *  を返す。ただし交差しないときは limit_ を返す。
+     *  rect と [ray.pos, ray.limit] との交点の中で、始点から最も近い交点までの
+     *  距離を返す。ただし交差しないときは ray.limit を返す。
      *
      *  @see 文献 LargeScale3DScene の「レイと直方体の交差」
      */
-    ray_elem_t
-    find_ray_distance_for_rect( const rect_t& rect ) const
+    static ray_elem_t
+    find_ray_distance_for_rect( const Ray&    ray,
+                                const rect_t& rect )
     {
         // P_0 = rect.lower
         // P_1 = rect.upper
-        //   q = ray_pos_
-        //   r = ray_dir_
+        //   q = ray.pos
+        //   r = ray.dir
 
         ray_elem_t tmin = 0;
-        ray_elem_t tmax = limit_;
+        ray_elem_t tmax = ray.limit;
 
         for ( size_t i = 0; i < 3; ++i ) {
             const ray_elem_t rect_lower_i = ALCS_TO_U16<> * rect.lower[i];
             const ray_elem_t rect_upper_i = ALCS_TO_U16<> * rect.upper[i];
 
-            const auto& rni = ray_dir_[i];  // r . n_i
+            const auto& rni = ray.dir[i];  // r . n_i
 
             if ( rni != 0 ) {
                 // tA = ((P_0 - q) . n_i) / (r . n_i)
                 // tB = ((P_1 - q) . n_i) / (r . n_i)
-                const auto tA = (rect_lower_i - ray_pos_[i]) / rni;
-                const auto tB = (rect_upper_i - ray_pos_[i]) / rni;
+                const auto tA = (rect_lower_i - ray.pos[i]) / rni;
+                const auto tB = (rect_upper_i - ray.pos[i]) / rni;
 
                 const auto t0 = (rni > 0) ? tA : tB;
                 const auto t1 = (rni > 0) ? tB : tA;
@@ -464,16 +1527,16 @@ class Tile::RaySolver : Base {
 
                 if ( tmin >= tmax ) {
                     // 共通区間が存在しないので交差しない
-                    return limit_;
+                    return ray.limit;
                 }
             }
             else { // rni == 0
-                if ( (ray_pos_[i] - rect_lower_i <  0) ||
-                     (ray_pos_[i] - rect_upper_i >= 0) ) {
+                if ( (ray.pos[i] - rect_lower_i <  0) ||
+                     (ray.pos[i] - rect_upper_i >= 0) ) {
                     // すべての i において、以下が満たされないので交差しない
                     // (q - P_0) . n_i >= 0
                     // (q - P_1) . n_i < 0
-                    return limit_;
+                    return ray.limit;
                 }
             }
         }
@@ -483,41 +1546,106 @@ class Tile::RaySolver : Base {
     }
 
 
-    /** @brief 三角形ブロックのインデックスの確認
+    /** @brief 処理済み三角形ブロックの集合を空にする
      *
-     *  index が初めて使われたときは index を返す。それ以外のときは
-     *  ALREADY_REGISTERED_TBLOCK_INDEX を返す。
+     *  世代を進めることで tblock_visited_ のすべての要素を未処理とする。世代
+     *  が一巡したときだけ tblock_visited_ 全体を消去する。
      */
-    size_t
-    check_and_register_tblock_index( size_t index )
+    void
+    clear_tblock_visited()
     {
-        if ( tblock_manager_.insert( index ) ) {
-            return index;
+        if ( ++tblock_generation_ == 0 ) {
+            std::fill( tblock_visited_.begin(), tblock_visited_.end(), 0 );
+            tblock_generation_ = 1;
+        }
+    }
+
+
+    /** @brief 三角形ブロックのインデックスを登録
+     *
+     *  index が現在のレイで初めて登録されるときは登録して true を返す。それ以
+     *  外のときは false を返す。
+     */
+    bool
+    register_tblock_index( size_t index )
+    {
+        auto& generation = tblock_visited_[index];
+
+        if ( generation == tblock_generation_ ) {
+            return false;
         }
         else {
-            return ALREADY_REGISTERED_TBLOCK_INDEX;
+            generation = tblock_generation_;
+            return true;
+        }
+    }
+
+
+    /** @brief パケットの処理済み三角形ブロックの集合を空にする
+     *
+     *  clear_tblock_visited() のパケット版である。世代は PacketWork::visited
+     *  の上位 (32 - PACKET_SIZE) ビットに格納される。
+     */
+    void
+    clear_packet_tblock_visited()
+    {
+        auto& packet = *packet_;
+
+        if ( ++packet.generation == (uint32_t{ 1 } << (32 - PACKET_SIZE)) ) {
+            std::fill( packet.visited.begin(), packet.visited.end(), 0 );
+            packet.generation = 1;
+        }
+    }
+
+
+    /** @brief パケットのレイに三角形ブロックのインデックスを登録
+     *
+     *  lanes (ビット i が lanes[i] に対応) のレイのうち、index を現在のパケッ
+     *  トで初めて処理するレイに index を登録し、それらのレイのマスクを返す。
+     */
+    unsigned
+    register_packet_tblock_index( size_t   index,
+                                  unsigned lanes )
+    {
+        static_assert( PACKET_SIZE < 32 );
+
+        constexpr uint32_t lane_mask = (uint32_t{ 1 } << PACKET_SIZE) - 1;
+
+        auto&         entry = packet_->visited[index];
+        const uint32_t stamp = packet_->generation << PACKET_SIZE;
+
+        if ( (entry & ~lane_mask) != stamp ) {
+            // 前のパケットで登録された値
+            entry = stamp;
         }
+
+        const unsigned targets = lanes & ~entry;
+
+        entry |= targets;
+
+        return targets;
     }
 
 
     /** @brief feature ID を取得
      *
-     *  crossed_triangle_ に対する feature ID を取得する。
+     *  三角形 tid に対する feature ID を取得する。
      *
-     *  交差がなかったとき、返される値は意味を持たない。
+     *  交差がなかったレイの crossed_triangle を与えたとき、返される値は意味を
+     *  持たない。
      */
     template<typename FiType>
     feature_id_t
-    get_feature_id() const
+    get_feature_id( size_t tid ) const
     {
         auto feature_id = UNASSIGNED_FEATURE_ID;
 
         if ( (adata_.num_fid_entries > 0) && (adata_.num_triangles > 0) ) {
             // サイズが 1 以上の fid_palette と fid_indices が存在
-            assert( crossed_triangle_ < adata_.num_triangles );
+            assert( tid < adata_.num_triangles );
 
             const auto fid_indices = static_cast<const FiType*>( adata_.fid_indices );
-            const auto&  fid_index = fid_indices[crossed_triangle_];
+            const auto&  fid_index = fid_indices[tid];
 
             for ( size_t i = 0; i < feature_id.size(); ++i ) {
                 feature_id[i] = adata_.fid_palette[feature_id.size() * fid_index + i];
@@ -529,19 +1657,24 @@ class Tile::RaySolver : Base {
 
 
   private:
-    const Analyzer&   adata_;
-    const ray_vec_t ray_pos_;  // レイの始点 (ALCS_TO_U16)
-    const ray_vec_t ray_dir_;  // レイの方向 (ALCS_TO_U16)
-    const ray_elem_t  limit_;  // 制限距離
-    const rect_t      lrect_;  // 制限直方体 (ALCS)
+    const Analyzer& adata_;
+    const TriTree&  tri_tree_;
+
+    // 枝ノードのトラバース用スタック (要素数はツリーの最大深度)
+    std::vector<Frame> stack_;
+
+    // 三角形ブロックを最後に処理したレイの世代 (tblock_generation_ と等しい
+    // 要素が現在のレイで処理済み)
+    std::vector<uint32_t> tblock_visited_;
 
-    // lrect_ がレイ (無限直線) と交差する距離範囲
-    ray_elem_t lrect_lower_dist_;
-    ray_elem_t lrect_upper_dist_;
+    // 現在のレイの世代 (レイごとに増やす)
+    uint32_t tblock_generation_ = 0;
 
-    size_t crossed_triangle_;  // 最も近い位置で交差する三角形のインデックス
+    // パケット処理の作業領域 (最初に使うときに確保する)
+    std::unique_ptr<PacketWork> packet_;
 
-    HashSet tblock_manager_;
+    // find_hits() で収集した交点 (レイごとに消去して再利用する)
+    std::vector<HitItem> hits_;
 
 };
 
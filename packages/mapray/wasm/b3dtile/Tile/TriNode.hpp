@@ -1,12 +1,17 @@
 ﻿#pragma once
 
 #include "Base.hpp"
+#include "TriTree.hpp"
+#include <bitset>
 #include <cassert>
 
 
 namespace b3dtile {
 
 /** @brief 三角形ツリーのノード
+ *
+ *  TriTree のノードを参照する軽量なオブジェクトである。参照先の TriTree は存
+ *  続していなければならない。
  */
 class Tile::TriNode : Base {
 
@@ -17,12 +22,28 @@ class Tile::TriNode : Base {
     };
 
   public:
+    /** @brief NONE ノードで初期化
+     */
+    TriNode()
+        : tree_{ nullptr },
+          type_{ Type::NONE },
+          index_{ 0 } {}
+
+
     /** @brief 初期化
+     *
+     *  tree のルートノードを参照する。
+     *
+     *  @pre tree.root_data() != nullptr
      */
     explicit
-    TriNode( const byte_t* data )
-        : type_{ Type::BRANCH },
-          data_{ data } {}
+    TriNode( const TriTree& tree )
+        : tree_{ &tree },
+          type_{ Type::BRANCH },
+          index_{ 0 }
+    {
+        assert( tree.root_data() != nullptr );
+    }
 
 
     bool
@@ -37,47 +58,38 @@ class Tile::TriNode : Base {
     is_leaf_type() const { return type_ == Type::LEAF; }
 
 
+    /** @brief 同じノードか？
+     */
+    bool
+    operator==( const TriNode& rhs ) const
+    {
+        return tree_ == rhs.tree_ && type_ == rhs.type_ && index_ == rhs.index_;
+    }
+
+
     /** @brief 子ノードを取得
-     *
-     *  @tparam BiType  三角形ブロックインデックスの型
      *
      *  @param cindex  子ノードのインデックス
      */
-    template<typename BiType>
     TriNode
     get_child( size_t cindex ) const
     {
         assert( is_branch_type() );
 
-        const byte_t* cursor = data_;
-
-        // TREE_SIZE
-        size_t tree_size = read_value<uint16_t>( cursor );
+        const auto&      node = tree_->ref_node( index_ );
+        const unsigned children = node.count;
 
-        // CHILDREN
-        const unsigned children = read_value<uint16_t>( cursor );
+        const auto type = static_cast<Type>( (children >> (2 * cindex)) & 0b11u );
 
-        if ( tree_size == 0 ) {
-            // TREE_SIZE_EX
-            tree_size = read_value<uint32_t>( cursor );
+        if ( type == Type::NONE ) {
+            return TriNode{ *tree_, type, 0 };
         }
 
-        // cindex より前の子を読み飛ばす
-        for ( size_t i = 0; i < cindex; ++i ) {
-            const auto cnode_type = static_cast<Type>( (children >> (2 * i)) & 0b11u );
-            if ( cnode_type == Type::BRANCH ) {
-                cursor = skip_branch( cursor );
-            }
-            else if ( cnode_type == Type::LEAF ) {
-                cursor = skip_leaf<BiType>( cursor );
-            }
-            else {
-                assert( cnode_type == Type::NONE );
-            }
-        }
+        // cindex より前の子ノード (NONE 以外) の数
+        const unsigned lower = children & ((1u << (2 * cindex)) - 1u);
+        const auto      rank = std::bitset<16>{ (lower | (lower >> 1)) & 0x5555u }.count();
 
-        const auto type = static_cast<Type>( (children >> (2 * cindex)) & 0b11u );
-        return TriNode{ type, cursor };
+        return TriNode{ *tree_, type, node.data + rank };
     }
 
 
@@ -88,12 +100,7 @@ class Tile::TriNode : Base {
     {
         assert( is_leaf_type() );
 
-        const byte_t* cursor = data_;
-
-        // NUM_BLOCKS
-        const size_t num_blocks = read_value<uint32_t>( cursor );
-
-        return num_blocks;
+        return tree_->ref_node( index_ ).count;
     }
 
 
@@ -105,62 +112,23 @@ class Tile::TriNode : Base {
     {
         assert( is_leaf_type() );
 
-        const auto offset = sizeof( uint32_t );
-
-        return get_pointer<BiType>( data_, offset );
+        return get_pointer<BiType>( tree_->root_data(), tree_->ref_node( index_ ).data );
     }
 
 
   private:
-    TriNode( Type          type,
-             const byte_t* data )
-        : type_{ type },
-          data_{ data } {}
-
-
-    /** @brief 枝ノードを読み飛ばし
-     */
-    static const byte_t*
-    skip_branch( const byte_t* data )
-    {
-        const byte_t* cursor = data;
-
-        // TREE_SIZE
-        size_t tree_size = read_value<uint16_t>( cursor );
-
-        // CHILDREN
-        read_value<uint16_t>( cursor );
-
-        if ( tree_size == 0 ) {
-            // TREE_SIZE_EX
-            tree_size = read_value<uint32_t>( cursor );
-        }
-
-        return data + WORD_SIZE * tree_size;
-    }
-
-
-    /** @brief 葉ノードを読み飛ばし
-     */
-    template<typename BiType>
-    static const byte_t*
-    skip_leaf( const byte_t* data )
-    {
-        const byte_t* cursor = data;
-
-        // NUM_BLOCKS
-        const size_t num_blocks = read_value<uint32_t>( cursor );
-
-        // BLOCK_INDICES
-        cursor += get_aligned<4>( sizeof( BiType ) * num_blocks );
-
-        return cursor;
-    }
+    TriNode( const TriTree& tree,
+             Type           type,
+             size_t        index )
+        : tree_{ &tree },
+          type_{ type },
+          index_{ index } {}
 
 
   private:
-    Type          type_;
-    const byte_t* data_;
+    const TriTree* tree_;
+    Type           type_;
+    size_t        index_;
 
 };
 
@@ -0,0 +1,215 @@
+﻿#pragma once
+
+#include "Base.hpp"
+#include "Analyzer.hpp"
+#include <vector>
+#include <algorithm>  // for max()
+#include <cstdint>    // for uint32_t
+#include <cassert>
+
+
+namespace b3dtile {
+
+/** @brief 展開された三角形ツリー
+ *
+ *  タイルデータの三角形ツリーは子ノードの位置を得るために兄ノードをすべて読み
+ *  飛ばす必要がある。そこで、タイルの構築時に一度だけツリーを走査して、子ノー
+ *  ドの位置を直接参照できる配列に展開しておく。
+ *
+ *  ノードはノード配列の要素で、枝ノードの子ノード (NONE 以外) はノード配列上
+ *  に連続して配置される。ルートノード (枝ノード) はノード配列の先頭である。
+ *
+ *  三角形ツリーが存在しないタイルではノード配列は空である。
+ *
+ *  TriNode を通してアクセスする。
+ */
+class Tile::TriTree : Base {
+
+  public:
+    /** @brief ノード配列の要素
+     */
+    struct Node {
+
+        /** @brief ノードのデータ
+         *
+         *  - 枝ノード: 最初の子ノードのノード配列上のインデックス
+         *  - 葉ノード: BLOCK_INDICES のルートノードからのバイトオフセット
+         */
+        uint32_t data;
+
+        /** @brief ノードの個数情報
+         *
+         *  - 枝ノード: CHILDREN の値
+         *  - 葉ノード: NUM_BLOCKS の値
+         */
+        uint32_t count;
+
+    };
+
+
+  public:
+    /** @brief 初期化
+     *
+     *  adata の三角形ツリーを展開する。adata は参照のみを保持すること注意する
+     *  こと。
+     */
+    explicit
+    TriTree( const Analyzer& adata )
+        : adata_{ adata },
+          max_depth_{ 0 }
+    {
+        if ( adata.root_node ) {
+            nodes_.push_back( Node{ 0, 0 } );
+            expand_branch( adata.root_node, 0, 1 );
+        }
+    }
+
+
+    /** @brief ルートノードのデータ
+     *
+     *  三角形ツリーが存在しないときは nullptr である。
+     */
+    const byte_t*
+    root_data() const { return adata_.root_node; }
+
+
+    /** @brief ノード配列のノードを参照
+     */
+    const Node&
+    ref_node( size_t index ) const
+    {
+        assert( index < nodes_.size() );
+        return nodes_[index];
+    }
+
+
+    /** @brief ツリーの最大深度
+     *
+     *  ルートノードの深度を 1 とする。三角形ツリーが存在しないときは 0 である。
+     */
+    size_t
+    max_depth() const { return max_depth_; }
+
+
+    TriTree( const TriTree& ) = delete;
+    void operator=( const TriTree& ) = delete;
+
+
+  private:
+    // 三角形ツリーのノード種類
+    enum class NodeType {
+        NONE   = 0,
+        BRANCH = 1,
+        LEAF   = 2,
+    };
+
+
+    /** @brief 枝ノードを展開
+     *
+     *  node_data の枝ノードを nodes_[index] に展開し、その子孫も展開する。
+     *
+     *  @param node_data  枝ノードのデータ
+     *  @param index      枝ノードのノード配列上のインデックス
+     *  @param depth      枝ノードの深度
+     *
+     *  @return 枝ノードの次のデータ
+     */
+    const byte_t*
+    expand_branch( const byte_t* node_data,
+                   size_t            index,
+                   size_t            depth )
+    {
+        max_depth_ = std::max( depth, max_depth_ );
+
+        const byte_t* cursor = node_data;
+
+        // TREE_SIZE
+        size_t tree_size = read_value<uint16_t>( cursor );
+
+        // CHILDREN
+        const unsigned children = read_value<uint16_t>( cursor );
+
+        if ( tree_size == 0 ) {
+            // TREE_SIZE_EX
+            tree_size = read_value<uint32_t>( cursor );
+        }
+
+        // 子ノードの領域をノード配列に確保
+        const size_t first = nodes_.size();
+
+        size_t num_children = 0;
+        for ( size_t cindex = 0; cindex < (1u << DIM); ++cindex ) {
+            if ( get_child_type( children, cindex ) != NodeType::NONE ) {
+                ++num_children;
+            }
+        }
+
+        nodes_.resize( first + num_children );
+        nodes_[index] = Node{ static_cast<uint32_t>( first ), children };
+
+        // 子ノードを展開
+        size_t child_index = first;
+
+        for ( size_t cindex = 0; cindex < (1u << DIM); ++cindex ) {
+            const auto type = get_child_type( children, cindex );
+
+            if ( type == NodeType::BRANCH ) {
+                cursor = expand_branch( cursor, child_index++, depth + 1 );
+            }
+            else if ( type == NodeType::LEAF ) {
+                cursor = expand_leaf( cursor, child_index++, depth + 1 );
+            }
+            else {
+                assert( type == NodeType::NONE );
+            }
+        }
+
+        assert( cursor == node_data + WORD_SIZE * tree_size );
+        return cursor;
+    }
+
+
+    /** @brief 葉ノードを展開
+     *
+     *  @return 葉ノードの次のデータ
+     */
+    const byte_t*
+    expand_leaf( const byte_t* node_data,
+                 size_t            index,
+                 size_t            depth )
+    {
+        max_depth_ = std::max( depth, max_depth_ );
+
+        const byte_t* cursor = node_data;
+
+        // NUM_BLOCKS
+        const auto num_blocks = read_value<uint32_t>( cursor );
+
+        // BLOCK_INDICES
+        const auto offset = static_cast<uint32_t>( cursor - adata_.root_node );
+        nodes_[index] = Node{ offset, num_blocks };
+
+        cursor += get_aligned<4>( adata_.bindex_size * num_blocks );
+
+        return cursor;
+    }
+
+
+    /** @brief CHILDREN から子ノードの種類を取得
+     */
+    static NodeType
+    get_child_type( unsigned children,
+                    size_t     cindex )
+    {
+        return static_cast<NodeType>( (children >> (2 * cindex)) & 0b11u );
+    }
+
+
+  private:
+    const Analyzer&   adata_;
+    std::vector<Node> nodes_;
+    size_t        max_depth_;
+
+};
+
+} // namespace b3dtile
@@ -0,0 +1,123 @@
+﻿#include "WorkerPool.hpp"
+#include <cassert>
+
+
+namespace b3dtile {
+
+WorkerPool&
+WorkerPool::instance()
+{
+    static WorkerPool pool{ B3DTILE_NUM_THREADS };
+    return pool;
+}
+
+
+void
+WorkerPool::run( size_t                            num_tasks,
+                 const std::function<void( size_t )>& func )
+{
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+
+        assert( func_ == nullptr );  // 同時に呼び出されていない
+
+        func_         = &func;
+        num_tasks_    = num_tasks;
+        next_task_    = 0;
+        busy_workers_ = workers_.size();
+        ++generation_;
+    }
+
+    start_cv_.notify_all();
+
+    // 呼び出し側のスレッドもタスクを実行
+    run_pending_tasks();
+
+    // すべてのワーカーが終了するまで待つ
+    std::unique_lock<std::mutex> lock{ mutex_ };
+    done_cv_.wait( lock, [this]() { return busy_workers_ == 0; } );
+
+    func_ = nullptr;
+}
+
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        stopping_ = true;
+    }
+
+    start_cv_.notify_all();
+
+    for ( auto& worker : workers_ ) {
+        worker.join();
+    }
+}
+
+
+WorkerPool::WorkerPool( size_t num_threads )
+{
+    assert( num_threads >= 1 );
+
+    workers_.reserve( num_threads - 1 );
+
+    for ( size_t i = 1; i < num_threads; ++i ) {
+        workers_.emplace_back( [this]() { worker_main(); } );
+    }
+}
+
+
+void
+WorkerPool::worker_main()
+{
+    size_t last_generation = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock{ mutex_ };
+            start_cv_.wait( lock, [&]() { return stopping_ || generation_ != last_generation; } );
+
+            if ( stopping_ ) {
+                return;
+            }
+
+            last_generation = generation_;
+        }
+
+        run_pending_tasks();
+
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            --busy_workers_;
+        }
+
+        done_cv_.notify_one();
+    }
+}
+
+
+void
+WorkerPool::run_pending_tasks()
+{
+    for (;;) {
+        size_t ti;
+        const std::function<void( size_t )>* func;
+
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+
+            if ( next_task_ == num_tasks_ ) {
+                // 未実行のタスクはない
+                return;
+            }
+
+            ti   = next_task_++;
+            func = func_;
+        }
+
+        (*func)( ti );
+    }
+}
+
+} // namespace b3dtile
@@ -0,0 +1,110 @@
+﻿#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstddef>  // for size_t
+
+
+/** @brief スレッドプールのスレッド数 (呼び出し側のスレッドを含む)
+ *
+ *  wasm では -s PTHREAD_POOL_SIZE に B3DTILE_NUM_THREADS - 1 を指定する。
+ */
+#if !defined( B3DTILE_NUM_THREADS )
+#  define B3DTILE_NUM_THREADS 4
+#endif
+
+
+namespace b3dtile {
+
+/** @brief 固定数のスレッドによるタスクの並列実行
+ *
+ *  B3DTILE_USE_THREADS が真のときだけ使用する。wasm では pthread
+ *  (SharedArrayBuffer) による std::thread、ホスト環境では通常の std::thread
+ *  で動作する。
+ *
+ *  run() を呼び出したスレッドもタスクを実行するので、作成するワーカースレッ
+ *  ドは num_threads() - 1 個である。
+ *
+ *  run() は同時に 1 つのスレッドからしか呼び出せない。
+ */
+class WorkerPool {
+
+    using size_t = std::size_t;
+
+  public:
+    /** @brief 共有インスタンスを取得
+     *
+     *  最初の呼び出しでワーカースレッドを生成する。
+     */
+    static WorkerPool&
+    instance();
+
+
+    /** @brief タスクを実行するスレッドの数
+     */
+    size_t
+    num_threads() const
+    {
+        return workers_.size() + 1;
+    }
+
+
+    /** @brief タスクを並列に実行
+     *
+     *  0 から num_tasks - 1 までの各 ti に対して func( ti ) を 1 回ずつ呼び出
+     *  す。どのスレッドがどのタスクを実行するかは不定である。
+     *
+     *  すべてのタスクが終了してから戻る。
+     */
+    void
+    run( size_t                            num_tasks,
+         const std::function<void( size_t )>& func );
+
+
+    ~WorkerPool();
+
+
+    WorkerPool( const WorkerPool& ) = delete;
+    void operator=( const WorkerPool& ) = delete;
+
+
+  private:
+    explicit
+    WorkerPool( size_t num_threads );
+
+
+    /** @brief ワーカースレッドの処理
+     */
+    void
+    worker_main();
+
+
+    /** @brief 未実行のタスクがなくなるまで実行
+     *
+     *  @pre mutex_ をロックしていない
+     */
+    void
+    run_pending_tasks();
+
+
+  private:
+    std::vector<std::thread> workers_;
+
+    std::mutex                mutex_;
+    std::condition_variable start_cv_;  // 新しい run() または終了の通知
+    std::condition_variable  done_cv_;  // ワーカーの作業終了の通知
+
+    // 以下は mutex_ で保護する
+    const std::function<void( size_t )>* func_ = nullptr;
+    size_t num_tasks_    = 0;
+    size_t next_task_    = 0;      // 次に実行するタスク
+    size_t generation_   = 0;      // run() ごとに増加
+    size_t busy_workers_ = 0;      // 現在の run() のタスクを実行中のワーカー数
+    bool   stopping_     = false;
+
+};
+
+} // namespace b3dtile
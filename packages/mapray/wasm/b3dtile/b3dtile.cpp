@@ -1,8 +1,10 @@
 ﻿#include "Tile.hpp"
+#include "Tile/ClipJob.hpp"
 #include "Rect.hpp"
 #include "wasm_types.hpp"
 #include <emscripten/emscripten.h>  // for EMSCRIPTEN_KEEPALIVE
 #include <cstddef>  // for size_t
+#include <cstdlib>  // for malloc(), free()
 #include <cassert>
 
 using std::size_t;
@@ -26,6 +28,20 @@ initialize( Tile::binary_copy_func_t* binary_copy,
 }
 
 
+/** @brief clip() などの結果の頂点属性の形式を設定
+ *
+ *  @param format  Tile::ClipVertexFormat の値
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+void
+set_clip_vertex_format( wasm_i32_t format )
+{
+    assert( format == static_cast<wasm_i32_t>( Tile::ClipVertexFormat::SEPARATE ) ||
+            format == static_cast<wasm_i32_t>( Tile::ClipVertexFormat::INTERLEAVED ) );
+    Tile::set_clip_vertex_format( static_cast<Tile::ClipVertexFormat>( format ) );
+}
+
+
 extern "C" EMSCRIPTEN_KEEPALIVE
 Tile*
 tile_create( wasm_i32_t size )
@@ -35,6 +51,54 @@ tile_create( wasm_i32_t size )
 }
 
 
+/** @brief データを書き込む前の Tile インスタンスを生成
+ *
+ *  tile_create() と違い binary_copy() は呼び出されない。
+ *
+ *  クライアントは tile_get_write_position() の位置に size バイトのタイルデー
+ *  タを書き込み、その後に tile_commit() を呼び出す。これにより、JavaScript 側
+ *  で受信したデータを直接 wasm のメモリーに書き込むことができる。
+ *
+ *  @param size  タイルデータのバイト数
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+Tile*
+tile_reserve( wasm_i32_t size )
+{
+    assert( size > 0 );
+    return new Tile{ static_cast<size_t>( size ), Tile::deferred_copy_t{} };
+}
+
+
+/** @brief タイルデータの書き込み位置を取得
+ *
+ *  @pre tile は tile_reserve() で生成され、tile_commit() は呼び出されていない
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+Tile::byte_t*
+tile_get_write_position( Tile* tile )
+{
+    assert( tile );
+    return tile->get_write_position();
+}
+
+
+/** @brief タイルデータの書き込みを完了
+ *
+ *  この関数を呼び出した後は tile_create() で生成したインスタンスと同じように
+ *  使うことができる。
+ *
+ *  @pre tile は tile_reserve() で生成され、tile_commit() は呼び出されていない
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+void
+tile_commit( Tile* tile )
+{
+    assert( tile );
+    tile->commit();
+}
+
+
 extern "C" EMSCRIPTEN_KEEPALIVE
 void
 tile_destroy( const Tile* tile )
@@ -68,6 +132,121 @@ tile_clip( const Tile* tile,
 }
 
 
+/** @brief 指定領域で切り取った結果のバイト数を計算
+ *
+ *  詳細は Tile::clip_prepare() を参照のこと。
+ *
+ *  @return 結果のバイト数
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+wasm_i32_t
+tile_clip_prepare( const Tile* tile,
+                   wasm_f32_t     x,
+                   wasm_f32_t     y,
+                   wasm_f32_t     z,
+                   wasm_f32_t  size )
+{
+    return static_cast<wasm_i32_t>( tile->clip_prepare( x, y, z, size ) );
+}
+
+
+/** @brief tile_clip_prepare() で準備した結果を書き込む
+ *
+ *  buffer の領域は buffer_create() などで確保することができる。
+ *
+ *  詳細は Tile::clip_write() を参照のこと。
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+void
+tile_clip_write( const Tile* tile,
+                 void*     buffer )
+{
+    tile->clip_write( buffer );
+}
+
+
+/** @brief 再開可能なクリップ処理を開始
+ *
+ *  パラメータは tile_clip() と同じである。tile_clip_step() で処理を進め、
+ *  tile_clip_finish() で結果を受け取る。
+ *
+ *  返したインスタンスは tile_clip_finish() または tile_clip_cancel() で破棄
+ *  しなければならない。それまで tile は破棄してはならない。
+ *
+ *  詳細は Tile::ClipJob を参照のこと。
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+Tile::ClipJob*
+tile_clip_begin( const Tile* tile,
+                 wasm_f32_t     x,
+                 wasm_f32_t     y,
+                 wasm_f32_t     z,
+                 wasm_f32_t  size )
+{
+    assert( tile );
+    return new Tile::ClipJob{ *tile, x, y, z, size };
+}
+
+
+/** @brief クリップ処理を最大 max_triangles 個の三角形だけ進める
+ *
+ *  残りの処理が tile_clip_finish() だけになったとき 1, それ以外のとき 0 を
+ *  返す。
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+wasm_i32_t
+tile_clip_step( Tile::ClipJob*      job,
+                wasm_i32_t max_triangles )
+{
+    assert( job );
+    assert( max_triangles >= 0 );
+    return job->step( static_cast<size_t>( max_triangles ) ) ? 1 : 0;
+}
+
+
+/** @brief クリップ処理を完了
+ *
+ *  残りの処理を行って結果を clip_result() で通知し、job を破棄する。
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+void
+tile_clip_finish( Tile::ClipJob* job )
+{
+    assert( job );
+    job->finish();
+    delete job;
+}
+
+
+/** @brief クリップ処理を中止
+ *
+ *  結果を通知せずに job を破棄する。
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+void
+tile_clip_cancel( Tile::ClipJob* job )
+{
+    assert( job );
+    delete job;
+}
+
+
+/** @brief 指定領域を 8 分割した領域ごとに切り取る
+ *
+ *  詳細は Tile::clip_octants() を参照のこと。
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+void
+tile_clip_octants( const Tile* tile,
+                   wasm_f32_t     x,
+                   wasm_f32_t     y,
+                   wasm_f32_t     z,
+                   wasm_f32_t  size )
+{
+    tile->clip_octants( x, y, z, size );
+}
+
+
 extern "C" EMSCRIPTEN_KEEPALIVE
 void
 tile_find_ray_distance( const Tile*    tile,
@@ -90,3 +269,132 @@ tile_find_ray_distance( const Tile*    tile,
                              limit,
                              lrect );
 }
+
+
+/** @brief レイがタイル内の三角形で遮蔽されるかを判定
+ *
+ *  パラメータは tile_find_ray_distance() と同じである。
+ *
+ *  @return 遮蔽されるとき 1, それ以外は 0
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+wasm_i32_t
+tile_test_ray_occluded( const Tile*    tile,
+                        wasm_f64_t   ray_px,
+                        wasm_f64_t   ray_py,
+                        wasm_f64_t   ray_pz,
+                        wasm_f64_t   ray_dx,
+                        wasm_f64_t   ray_dy,
+                        wasm_f64_t   ray_dz,
+                        wasm_f64_t    limit,
+                        wasm_f32_t lrect_ox,
+                        wasm_f32_t lrect_oy,
+                        wasm_f32_t lrect_oz,
+                        wasm_f32_t lrect_size )
+{
+    const auto lrect = Rect<float, Tile::DIM>::create_cube( { lrect_ox, lrect_oy, lrect_oz }, lrect_size );
+
+    const bool occluded = tile->test_ray_occluded( { ray_px, ray_py, ray_pz },
+                                                   { ray_dx, ray_dy, ray_dz },
+                                                   limit,
+                                                   lrect );
+
+    return occluded ? 1 : 0;
+}
+
+
+/** @brief 複数のレイとタイル内の三角形との交点を探す
+ *
+ *  rays と results の形式は Tile::find_ray_distance_many() を参照のこと。
+ *
+ *  rays と results の領域は buffer_create() などで確保することができる。
+ *
+ *  @param tile      タイル
+ *  @param num_rays  レイの数
+ *  @param rays      レイ配列
+ *  @param results   結果配列
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+void
+tile_find_ray_distance_many( const Tile*        tile,
+                             wasm_i32_t     num_rays,
+                             const wasm_f64_t*  rays,
+                             wasm_f64_t*     results )
+{
+    assert( num_rays >= 0 );
+    tile->find_ray_distance_many( static_cast<size_t>( num_rays ), rays, results );
+}
+
+
+/** @brief 複数のレイがタイル内の三角形で遮蔽されるかを判定
+ *
+ *  rays と results の形式は Tile::test_ray_occluded_many() を参照のこと。
+ *
+ *  @param tile      タイル
+ *  @param num_rays  レイの数
+ *  @param rays      レイ配列
+ *  @param results   結果配列
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+void
+tile_test_ray_occluded_many( const Tile*        tile,
+                             wasm_i32_t     num_rays,
+                             const wasm_f64_t*  rays,
+                             wasm_i32_t*     results )
+{
+    assert( num_rays >= 0 );
+    tile->test_ray_occluded_many( static_cast<size_t>( num_rays ), rays, results );
+}
+
+
+/** @brief レイとタイル内の三角形とのすべての交点を探す
+ *
+ *  ray と hits の形式は Tile::find_ray_hits() を参照のこと。
+ *
+ *  交点までの距離 t の範囲は 0 < t < limit である (limit はレイの要素)。
+ *
+ *  @param tile      タイル
+ *  @param ray       レイ
+ *  @param max_hits  格納する交点の最大数
+ *  @param hits      交点配列
+ *
+ *  @return 交点の総数
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+wasm_i32_t
+tile_find_ray_hits( const Tile*       tile,
+                    const wasm_f64_t*  ray,
+                    wasm_i32_t    max_hits,
+                    wasm_f64_t*       hits )
+{
+    assert( max_hits >= 0 );
+    const auto num_hits = tile->find_ray_hits( ray, static_cast<size_t>( max_hits ), hits );
+    return static_cast<wasm_i32_t>( num_hits );
+}
+
+
+/** @brief JavaScript とデータをやり取りするための領域を確保
+ *
+ *  領域は wasm_f64_t 型の配列として使えるようにアラインされている。
+ *
+ *  @param size  領域のバイト数
+ *
+ *  @return 領域の先頭へのポインタ
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+void*
+buffer_create( wasm_i32_t size )
+{
+    assert( size > 0 );
+    return std::malloc( static_cast<size_t>( size ) );
+}
+
+
+/** @brief buffer_create() で確保した領域を解放
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+void
+buffer_destroy( void* buffer )
+{
+    std::free( buffer );
+}
@@ -0,0 +1,72 @@
+﻿// ヒープ割り当ての回数を数えるための operator new の置き換え
+// このファイルはベンチマークの実行ファイルごとに 1 つだけリンクする
+#include "bench_utility.hpp"
+#include <atomic>
+#include <cstdlib>  // for malloc(), free()
+#include <new>
+
+
+namespace {
+
+std::atomic<uint64_t> alloc_count{ 0 };
+
+} // namespace
+
+
+namespace bench {
+
+uint64_t
+get_alloc_count()
+{
+    return alloc_count.load( std::memory_order_relaxed );
+}
+
+} // namespace bench
+
+
+void*
+operator new( std::size_t size )
+{
+    alloc_count.fetch_add( 1, std::memory_order_relaxed );
+
+    if ( void* const ptr = std::malloc( size != 0 ? size : 1 ) ) {
+        return ptr;
+    }
+
+    throw std::bad_alloc{};
+}
+
+
+void*
+operator new[]( std::size_t size )
+{
+    return operator new( size );
+}
+
+
+void
+operator delete( void* ptr ) noexcept
+{
+    std::free( ptr );
+}
+
+
+void
+operator delete[]( void* ptr ) noexcept
+{
+    std::free( ptr );
+}
+
+
+void
+operator delete( void* ptr, std::size_t ) noexcept
+{
+    std::free( ptr );
+}
+
+
+void
+operator delete[]( void* ptr, std::size_t ) noexcept
+{
+    std::free( ptr );
+}
@@ -0,0 +1,107 @@
+﻿#pragma once
+
+#include "../b3dtile/Tile.hpp"
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+
+
+namespace bench {
+
+namespace fs = std::filesystem;
+using b3dtile::Tile;
+
+
+/** @brief 起動してからのヒープ割り当ての回数
+ *
+ *  bench_alloc.cpp で定義される。
+ */
+uint64_t
+get_alloc_count();
+
+
+/** @brief 経過時間の計測
+ */
+class Timer {
+
+    using clock_t = std::chrono::steady_clock;
+
+  public:
+    Timer()
+        : start_{ clock_t::now() }
+    {}
+
+
+    /** @brief 構築してからの経過時間 (秒)
+     */
+    double
+    elapsed() const
+    {
+        return std::chrono::duration<double>( clock_t::now() - start_ ).count();
+    }
+
+
+  private:
+    const clock_t::time_point start_;
+
+};
+
+
+/** @brief ファイルから読み込んだタイル
+ */
+struct TileFile {
+
+    std::string           name;  // ファイル名
+    std::unique_ptr<Tile> tile;
+
+};
+
+
+/** @brief タイルを読み込む
+ *
+ *  dir の直下にある拡張子が .bin のファイルをすべてタイルとして読み込む。
+ *  ファイル名の順に並べて返す。
+ */
+inline std::vector<TileFile>
+load_tiles( const fs::path& dir )
+{
+    if ( !fs::is_directory( dir ) ) {
+        throw std::runtime_error( "directory cannot be found: " + dir.string() );
+    }
+
+    std::vector<fs::path> paths;
+
+    for ( const auto& entry : fs::directory_iterator{ dir } ) {
+        if ( entry.is_regular_file() && entry.path().extension() == ".bin" ) {
+            paths.push_back( entry.path() );
+        }
+    }
+
+    std::sort( paths.begin(), paths.end() );
+
+    std::vector<TileFile> tiles;
+
+    for ( const auto& path : paths ) {
+        std::ifstream ifs{ path, std::ios_base::binary };
+
+        const auto size = fs::file_size( path );
+
+        auto tile = std::make_unique<Tile>( size, Tile::deferred_copy_t{} );
+
+        // タイルの領域に直接読み込む
+        ifs.read( reinterpret_cast<char*>( tile->get_write_position() ), size );
+        tile->commit();
+
+        tiles.push_back( { path.filename().string(), std::move( tile ) } );
+    }
+
+    return tiles;
+}
+
+} // namespace bench
@@ -0,0 +1,149 @@
+﻿// クリップ処理 (Tile::clip()) のベンチマーク
+//
+//   clip_bench <tile_dir> [max_depth]
+//
+// tile_dir の直下にある *.bin をタイルとして読み込み、深さ 1 から max_depth
+// までの各深さで、タイルを 8^depth 個に分割する立方体ごとにクリップする。深
+// さごとに処理時間の内訳と出力バイト数、ヒープ割り当て回数を出力する。
+//
+// 各深さは clip() で子ごとに処理する場合 (single) と、clip_octants() で親ご
+// とにまとめて処理する場合 (octants) を計測する。
+#include "bench_utility.hpp"
+#include "../b3dtile/Stats.hpp"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>  // for strtoul()
+
+using bench::Tile;
+using b3dtile::Stats;
+
+
+namespace {
+
+/** @brief 1 つのタイルと深さの計測
+ */
+void
+run_bench( const bench::TileFile& tfile,
+           int                    depth,
+           bool                 octants )
+{
+    const Tile& tile = *tfile.tile;
+
+    const size_t num_side = size_t{ 1 } << depth;
+    const float      size = 1.0f / num_side;
+
+    const auto clip_all = [&]() {
+        if ( octants ) {
+            // 親の立方体ごとに 8 個の子をまとめて処理
+            for ( size_t k = 0; k < num_side; k += 2 ) {
+                for ( size_t j = 0; j < num_side; j += 2 ) {
+                    for ( size_t i = 0; i < num_side; i += 2 ) {
+                        tile.clip_octants( i * size, j * size, k * size, 2 * size );
+                    }
+                }
+            }
+        }
+        else {
+            for ( size_t k = 0; k < num_side; ++k ) {
+                for ( size_t j = 0; j < num_side; ++j ) {
+                    for ( size_t i = 0; i < num_side; ++i ) {
+                        tile.clip( i * size, j * size, k * size, size );
+                    }
+                }
+            }
+        }
+    };
+
+    // 最初の実行による影響を除外
+    clip_all();
+
+    Stats::reset();
+
+    const auto    allocs = bench::get_alloc_count();
+    const bench::Timer timer;
+
+    clip_all();
+
+    const double  seconds = timer.elapsed();
+    const auto&     stats = Stats::instance;
+    const double num_clips = static_cast<double>( num_side * num_side * num_side );
+
+    const auto per_clip = [num_clips]( uint64_t value ) {
+        return static_cast<double>( value ) / num_clips;
+    };
+
+    // 各段階の時間 (ミリ秒)
+    const auto msec = []( uint64_t nsec ) {
+        return static_cast<double>( nsec ) / 1e6;
+    };
+
+    std::cout << std::left
+              << std::setw( 24 ) << tfile.name
+              << std::setw(  8 ) << (octants ? "octants" : "single")
+              << std::right << std::fixed
+              << std::setw(  6 ) << depth
+              << std::setw( 10 ) << std::setprecision( 3 ) << 1e3 * seconds / num_clips
+              << std::setw( 10 ) << std::setprecision( 3 ) << msec( stats.clip_bcollect_time ) / num_clips
+              << std::setw( 10 ) << std::setprecision( 3 ) << msec( stats.clip_polygons_time ) / num_clips
+              << std::setw( 10 ) << std::setprecision( 3 ) << msec( stats.clip_result_time ) / num_clips
+              << std::setw( 10 ) << std::setprecision( 1 ) << per_clip( stats.clip_tblocks )
+              << std::setw( 10 ) << std::setprecision( 1 ) << per_clip( stats.clip_triangles )
+              << std::setw( 10 ) << std::setprecision( 1 ) << per_clip( stats.clip_polygons )
+              << std::setw( 12 ) << std::setprecision( 0 ) << per_clip( stats.clip_output_bytes )
+              << std::setw( 10 ) << std::setprecision( 1 ) << per_clip( bench::get_alloc_count() - allocs )
+              << std::endl;
+}
+
+
+void
+clip_result( wasm_i32_t, wasm_i32_t, const void* )
+{}
+
+} // namespace
+
+
+int
+main( int argc, char* argv[] )
+{
+    if ( argc < 2 ) {
+        std::cerr << "usage: " << argv[0] << " <tile_dir> [max_depth]" << std::endl;
+        return 1;
+    }
+
+    const int max_depth = (argc >= 3) ? static_cast<int>( std::strtoul( argv[2], nullptr, 10 ) ) : 3;
+
+    Tile::setup_javascript_functions( nullptr, &clip_result, nullptr );
+
+    const auto tiles = bench::load_tiles( argv[1] );
+
+    if ( !Stats::enabled ) {
+        std::cerr << "warning: B3DTILE_ENABLE_STATS is not set" << std::endl;
+    }
+
+    // 時間はクリップ 1 回あたりのミリ秒
+    // (total: 全体, bcoll: BCollector::run(), polys: collect_polygons(), result: Result)
+    std::cout << std::left
+              << std::setw( 24 ) << "tile"
+              << std::setw(  8 ) << "mode"
+              << std::right
+              << std::setw(  6 ) << "depth"
+              << std::setw( 10 ) << "total"
+              << std::setw( 10 ) << "bcoll"
+              << std::setw( 10 ) << "polys"
+              << std::setw( 10 ) << "result"
+              << std::setw( 10 ) << "tblocks"
+              << std::setw( 10 ) << "tris"
+              << std::setw( 10 ) << "clipped"
+              << std::setw( 12 ) << "bytes"
+              << std::setw( 10 ) << "allocs"
+              << std::endl;
+
+    for ( const auto& tfile : tiles ) {
+        for ( int depth = 1; depth <= max_depth; ++depth ) {
+            run_bench( tfile, depth, false );
+            run_bench( tfile, depth, true );
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,284 @@
+﻿// レイ判定 (Tile::find_ray_distance() など) のベンチマーク
+//
+//   ray_bench <tile_dir> [num_rays]
+//
+// tile_dir の直下にある *.bin をタイルとして読み込み、再現可能なレイ集合ご
+// とに処理速度とレイ 1 本あたりの統計を出力する。
+#include "bench_utility.hpp"
+#include "../b3dtile/Stats.hpp"
+#include "../b3dtile/Rect.hpp"
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <cmath>    // for cos(), sin()
+#include <cstdlib>  // for strtoul()
+
+using bench::Tile;
+using b3dtile::Stats;
+
+
+namespace {
+
+constexpr double pi = 3.14159265358979323846;
+
+
+/** @brief レイ配列に 1 本のレイを追加
+ *
+ *  形式は Tile::find_ray_distance_many() の rays と同じで、制限直方体はタイ
+ *  ル全体である。
+ */
+void
+add_ray( std::vector<wasm_f64_t>& rays,
+         const double            pos[],
+         const double            dir[],
+         double                  limit )
+{
+    rays.insert( rays.end(), { pos[0], pos[1], pos[2],
+                               dir[0], dir[1], dir[2],
+                               limit,
+                               0, 0, 0, 1 } );
+}
+
+
+/** @brief ランダムなレイ
+ *
+ *  タイルを囲む球面上の点から、タイル内のランダムな点を通るレイを生成する。
+ */
+std::vector<wasm_f64_t>
+create_random_rays( size_t num_rays )
+{
+    std::mt19937 engine{ 1 };
+    std::uniform_real_distribution<double> dist{ 0, 1 };
+
+    std::vector<wasm_f64_t> rays;
+
+    for ( size_t i = 0; i < num_rays; ++i ) {
+        const double   z = 2 * dist( engine ) - 1;
+        const double phi = 2 * pi * dist( engine );
+        const double   r = std::sqrt( 1 - z * z );
+
+        const double    pos[] = { 0.5 + 2 * r * std::cos( phi ), 0.5 + 2 * r * std::sin( phi ), 0.5 + 2 * z };
+        const double target[] = { dist( engine ), dist( engine ), dist( engine ) };
+        const double    dir[] = { target[0] - pos[0], target[1] - pos[1], target[2] - pos[2] };
+
+        add_ray( rays, pos, dir, 2 );
+    }
+
+    return rays;
+}
+
+
+/** @brief 格子状のレイ
+ *
+ *  画面上の格子点でピックするときのように、上方の 1 点からタイルを覆う格子
+ *  の点を通るレイを、格子の行順に生成する。
+ */
+std::vector<wasm_f64_t>
+create_grid_rays( size_t num_rays )
+{
+    const auto num_side = static_cast<size_t>( std::ceil( std::sqrt( static_cast<double>( num_rays ) ) ) );
+
+    const double pos[] = { 0.3, 0.4, 3 };
+
+    std::vector<wasm_f64_t> rays;
+
+    for ( size_t i = 0; i < num_rays; ++i ) {
+        const double tx = (i % num_side + 0.5) / num_side;
+        const double ty = (i / num_side + 0.5) / num_side;
+
+        const double dir[] = { tx - pos[0], ty - pos[1], -pos[2] };
+
+        add_ray( rays, pos, dir, 2 );
+    }
+
+    return rays;
+}
+
+
+/** @brief かすめるレイ
+ *
+ *  ほぼ水平な方向で、タイルの側面から地表面をかすめるように進むレイを生成
+ *  する。多くのノードを通過するので、トラバースの負荷が大きい。
+ */
+std::vector<wasm_f64_t>
+create_grazing_rays( size_t num_rays )
+{
+    std::mt19937 engine{ 2 };
+    std::uniform_real_distribution<double> dist{ 0, 1 };
+
+    std::vector<wasm_f64_t> rays;
+
+    for ( size_t i = 0; i < num_rays; ++i ) {
+        const double theta = 2 * pi * dist( engine );
+        const double  tilt = 0.02 * (dist( engine ) - 0.5);
+
+        const double dir[] = { std::cos( theta ), std::sin( theta ), tilt };
+        const double pos[] = { 0.5 - dir[0], 0.5 - dir[1], dist( engine ) - dir[2] };
+
+        add_ray( rays, pos, dir, 2 );
+    }
+
+    return rays;
+}
+
+
+/** @brief レイ集合
+ */
+struct RaySet {
+
+    const char*             name;
+    std::vector<wasm_f64_t> rays;
+
+};
+
+
+/** @brief 計測の結果
+ */
+struct Measure {
+
+    double   seconds;
+    Stats    stats;
+    uint64_t allocs;
+
+};
+
+
+/** @brief func() の処理を計測
+ */
+template<typename Func>
+Measure
+measure( Func func )
+{
+    Stats::reset();
+
+    const auto    allocs = bench::get_alloc_count();
+    const bench::Timer timer;
+
+    func();
+
+    const double seconds = timer.elapsed();
+
+    return { seconds, Stats::instance, bench::get_alloc_count() - allocs };
+}
+
+
+/** @brief 計測の結果を出力
+ */
+void
+print_measure( const std::string& tile_name,
+               const char*         set_name,
+               const char*        mode_name,
+               size_t              num_rays,
+               const Measure&       result )
+{
+    const auto per_ray = [num_rays]( uint64_t value ) {
+        return static_cast<double>( value ) / num_rays;
+    };
+
+    std::cout << std::left
+              << std::setw( 24 ) << tile_name
+              << std::setw( 10 ) << set_name
+              << std::setw(  8 ) << mode_name
+              << std::right << std::fixed
+              << std::setw( 14 ) << std::setprecision( 0 ) << num_rays / result.seconds
+              << std::setw( 12 ) << std::setprecision( 2 ) << per_ray( result.stats.ray_nodes )
+              << std::setw( 12 ) << std::setprecision( 2 ) << per_ray( result.stats.ray_triangles )
+              << std::setw( 12 ) << std::setprecision( 2 ) << per_ray( result.stats.ray_exact_tests )
+              << std::setw( 12 ) << std::setprecision( 4 ) << per_ray( result.allocs )
+              << std::endl;
+}
+
+
+/** @brief 1 つのタイルとレイ集合の計測
+ */
+void
+run_bench( const bench::TileFile& tfile,
+           const RaySet&            rset )
+{
+    const Tile&      tile = *tfile.tile;
+    const size_t num_rays = rset.rays.size() / Tile::RAY_NUM_ELEMS;
+
+    std::vector<wasm_f64_t> results( Tile::RAY_RESULT_NUM_ELEMS * num_rays );
+    std::vector<wasm_i32_t> occluded( num_rays );
+
+    // 作業領域を確保させるために 1 回ずつ実行
+    tile.find_ray_distance_many( 1, rset.rays.data(), results.data() );
+    tile.test_ray_occluded_many( 1, rset.rays.data(), occluded.data() );
+
+    const auto lrect = b3dtile::Rect<float, Tile::DIM>::create_cube( { 0, 0, 0 }, 1 );
+
+    const auto single = measure( [&]() {
+        for ( size_t i = 0; i < num_rays; ++i ) {
+            const auto ray = rset.rays.data() + Tile::RAY_NUM_ELEMS * i;
+            tile.find_ray_distance( { ray[0], ray[1], ray[2] },
+                                    { ray[3], ray[4], ray[5] },
+                                    ray[6],
+                                    lrect );
+        }
+    } );
+
+    const auto many = measure( [&]() {
+        tile.find_ray_distance_many( num_rays, rset.rays.data(), results.data() );
+    } );
+
+    const auto occl = measure( [&]() {
+        tile.test_ray_occluded_many( num_rays, rset.rays.data(), occluded.data() );
+    } );
+
+    print_measure( tfile.name, rset.name, "single", num_rays, single );
+    print_measure( tfile.name, rset.name, "many",   num_rays, many );
+    print_measure( tfile.name, rset.name, "occl",   num_rays, occl );
+}
+
+
+void
+ray_result( wasm_f64_t, wasm_f64_t, wasm_f64_t )
+{}
+
+} // namespace
+
+
+int
+main( int argc, char* argv[] )
+{
+    if ( argc < 2 ) {
+        std::cerr << "usage: " << argv[0] << " <tile_dir> [num_rays]" << std::endl;
+        return 1;
+    }
+
+    const size_t num_rays = (argc >= 3) ? std::strtoul( argv[2], nullptr, 10 ) : 100000;
+
+    Tile::setup_javascript_functions( nullptr, nullptr, &ray_result );
+
+    const auto tiles = bench::load_tiles( argv[1] );
+
+    const RaySet ray_sets[] = {
+        { "random",  create_random_rays( num_rays )  },
+        { "grid",    create_grid_rays( num_rays )    },
+        { "grazing", create_grazing_rays( num_rays ) },
+    };
+
+    if ( !Stats::enabled ) {
+        std::cerr << "warning: B3DTILE_ENABLE_STATS is not set" << std::endl;
+    }
+
+    std::cout << std::left
+              << std::setw( 24 ) << "tile"
+              << std::setw( 10 ) << "rays"
+              << std::setw(  8 ) << "mode"
+              << std::right
+              << std::setw( 14 ) << "rays/s"
+              << std::setw( 12 ) << "nodes/ray"
+              << std::setw( 12 ) << "tris/ray"
+              << std::setw( 12 ) << "exact/ray"
+              << std::setw( 12 ) << "allocs/ray"
+              << std::endl;
+
+    for ( const auto& tfile : tiles ) {
+        for ( const auto& rset : ray_sets ) {
+            run_bench( tfile, rset );
+        }
+    }
+
+    return 0;
+}
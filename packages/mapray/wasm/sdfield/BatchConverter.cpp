@@ -0,0 +1,93 @@
+﻿#include "BatchConverter.hpp"
+#include "utility.hpp"  // for get_aligned
+#include "config.hpp"   // for MAX_SDF_WIDTH, MAX_SDF_HEIGHT
+#include <algorithm>    // for copy()
+#include <cassert>
+
+
+namespace sdfield {
+
+
+BatchConverter::BatchConverter()
+    : converter_{ { cast, 1, 1 }, 0 }
+{}
+
+
+void
+BatchConverter::reserve( std::size_t num_images,
+                         std::size_t  cov_bytes )
+{
+    num_images_ = num_images;
+    table_.assign( TABLE_NUM_ELEMS * num_images, 0 );
+
+    // 入力領域 (std::vector と std::make_unique を使わない理由は
+    // CovImage を参照)
+    if ( cov_capacity_ < cov_bytes || !cov_data_ ) {
+        cov_data_.reset( new CovImage::pixel_t[ std::max<std::size_t>( cov_bytes, 1 ) ] );
+        cov_capacity_ = cov_bytes;
+    }
+
+    cov_bytes_ = cov_bytes;
+}
+
+
+const SdfImage::pixel_t*
+BatchConverter::build_sdf()
+{
+    // 出力領域での各画像の位置を決める
+    std::size_t sdf_bytes = 0;
+
+    for ( std::size_t i = 0; i < num_images_; ++i ) {
+        wasm_i32_t* const entry = table_.data() + TABLE_NUM_ELEMS * i;
+
+        const img_size_t cov_size { cast, entry[1], entry[2] };
+        const auto        sdf_ext = static_cast<sdf_ext_t>( entry[3] );
+
+        assert( entry[0] >= 0 && entry[1] >= 1 && entry[2] >= 1 && entry[3] >= 0 );
+        assert( static_cast<unsigned int>( entry[1] + 2 * entry[3] ) <= MAX_SDF_WIDTH );
+        assert( static_cast<unsigned int>( entry[2] + 2 * entry[3] ) <= MAX_SDF_HEIGHT );
+        assert( static_cast<std::size_t>( entry[0] ) + std::size_t{ cov_size[0] } * cov_size[1] <= cov_bytes_ );
+
+        entry[4]   = static_cast<wasm_i32_t>( sdf_bytes );
+        sdf_bytes += calc_sdf_bytes( cov_size, sdf_ext );
+    }
+
+    if ( sdf_capacity_ < sdf_bytes || !sdf_data_ ) {
+        sdf_data_.reset( new SdfImage::pixel_t[ std::max<std::size_t>( sdf_bytes, 1 ) ] );
+        sdf_capacity_ = sdf_bytes;
+    }
+
+    // 各画像を変換して出力領域にコピー
+    for ( std::size_t i = 0; i < num_images_; ++i ) {
+        const wasm_i32_t* const entry = table_.data() + TABLE_NUM_ELEMS * i;
+
+        const img_size_t cov_size { cast, entry[1], entry[2] };
+        const auto        sdf_ext = static_cast<sdf_ext_t>( entry[3] );
+
+        converter_.reset( cov_size, sdf_ext );
+
+        const auto cov_src = cov_data_.get() + entry[0];
+        std::copy( cov_src, cov_src + std::size_t{ cov_size[0] } * cov_size[1],
+                   converter_.get_write_position() );
+
+        const auto sdf_src = converter_.build_sdf();
+        std::copy( sdf_src, sdf_src + calc_sdf_bytes( cov_size, sdf_ext ),
+                   sdf_data_.get() + entry[4] );
+    }
+
+    return sdf_data_.get();
+}
+
+
+std::size_t
+BatchConverter::calc_sdf_bytes( const img_size_t& cov_size,
+                                sdf_ext_t          sdf_ext )
+{
+    const auto sdf_size = SdfImage::calc_size( cov_size, sdf_ext );
+
+    // 各行は 4 バイト境界に揃っている (SdfImage を参照)
+    return get_aligned<4>( std::size_t{ sdf_size[0] } ) * sdf_size[1];
+}
+
+
+} // namespace sdfield
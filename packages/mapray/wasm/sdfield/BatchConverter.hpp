@@ -0,0 +1,111 @@
+﻿#pragma once
+
+#include "Converter.hpp"
+#include "CovImage.hpp"
+#include "SdfImage.hpp"
+#include "basic_types.hpp"  // for img_size_t, sdf_ext_t
+#include "wasm_types.hpp"   // for wasm_i32_t
+#include <vector>
+#include <memory>   // for unique_ptr
+#include <cstddef>  // for size_t
+
+
+namespace sdfield {
+
+
+/** @brief 複数の画像の一括変換
+ *
+ *  複数の被覆率画像を 1 回の呼び出しで SDF 画像に変換する。
+ *
+ *  クライアントは次の手順で使用する。
+ *
+ *  1. reserve() で画像数と入力領域のバイト数を指定する
+ *  2. get_table() で得た画像表に各画像の入力パラメータを書き込む
+ *  3. get_write_position() で得た入力領域に各被覆率画像を書き込む
+ *  4. build_sdf() で変換し、戻り値の出力領域から各 SDF 画像を読み込む
+ *
+ *  各 SDF 画像の形式は Converter::build_sdf() と同じで、出力領域の中の
+ *  位置は画像表に書き込まれる。
+ *
+ *  内部の領域は足りないときだけ確保し直すので、同じインスタンスを繰
+ *  り返し使うことができる。
+ */
+class BatchConverter {
+
+  public:
+    using img_size_t = sdfield::img_size_t;
+    using  sdf_ext_t = sdfield::sdf_ext_t;
+
+
+    /** @brief 画像表の 1 画像あたりの要素数
+     *
+     *  画像表は画像ごとに次の wasm_i32_t 型の要素を並べた配列である。
+     *
+     *  - [0] 被覆率画像の入力領域の先頭からのバイト位置 (入力)
+     *  - [1] 被覆率画像の水平方向の画素数 (入力)
+     *  - [2] 被覆率画像の垂直方向の画素数 (入力)
+     *  - [3] 出力 SDF 画像のための拡張画素数 (入力)
+     *  - [4] SDF 画像の出力領域の先頭からのバイト位置 (出力)
+     *
+     *  入力の要素の条件は converter_create() のパラメータと同じである。
+     *  また被覆率画像は入力領域に収まっていなければならない。
+     */
+    static constexpr std::size_t TABLE_NUM_ELEMS = 5;
+
+
+  public:
+    BatchConverter();
+
+
+    // batch_converter_reserve() の実装
+    void
+    reserve( std::size_t num_images,
+             std::size_t  cov_bytes );
+
+
+    // batch_converter_get_table() の実装
+    wasm_i32_t*
+    get_table() { return table_.data(); }
+
+
+    // batch_converter_get_write_position() の実装
+    CovImage::pixel_t*
+    get_write_position() { return cov_data_.get(); }
+
+
+    // batch_converter_build_sdf() の実装
+    const SdfImage::pixel_t*
+    build_sdf();
+
+
+    // batch_converter_set_engine() の実装
+    void
+    set_engine( DistanceEngine engine ) { converter_.set_engine( engine ); }
+
+
+  private:
+    /** @brief 画像の SDF 画像のバイト数
+     */
+    static std::size_t
+    calc_sdf_bytes( const img_size_t& cov_size,
+                    sdf_ext_t          sdf_ext );
+
+
+  private:
+    std::size_t                           num_images_ = 0;
+    std::vector<wasm_i32_t>                    table_;
+
+    std::unique_ptr<CovImage::pixel_t[]>    cov_data_;
+    std::size_t                         cov_capacity_ = 0;
+    std::size_t                            cov_bytes_ = 0;
+
+    std::unique_ptr<SdfImage::pixel_t[]>    sdf_data_;
+    std::size_t                         sdf_capacity_ = 0;
+
+    // 各画像の変換に再利用する
+    Converter                              converter_;
+
+};
+
+
+} // namespace sdfield
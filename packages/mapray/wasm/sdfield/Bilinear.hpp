@@ -26,10 +26,20 @@ class Bilinear {
               CovImage::coord_t   x,
               CovImage::coord_t   y )
     {
+        const auto size = image.size();
+
         // 周辺を含めた被覆率を書き込む
+        //
+        // 画像の外の画素は被覆率 0 とする (Grid の外側のノードと同じ
+        // 扱い)。
         for ( short oy = -1; oy <= +1; ++oy ) {
             for ( short ox = -1; ox <= +1; ++ox ) {
-                const auto value = image.get_pixel( x + ox, y + oy );
+                const auto px = x + ox;
+                const auto py = y + oy;
+
+                const bool inside = px >= 0 && px < size[0] && py >= 0 && py < size[1];
+
+                const auto value = inside ? image.get_pixel( px, py ) : 0;
                 data_[ index( ox + 1, oy + 1 ) ] = static_cast<value_t>( value );
             }
         }
@@ -1,5 +1,4 @@
 ﻿#include "Converter.hpp"
-#include "Grid.hpp"
 
 
 namespace sdfield {
@@ -13,10 +12,20 @@ Converter::Converter( const img_size_t& cov_size,
 {}
 
 
+void
+Converter::reset( const img_size_t& cov_size,
+                  sdf_ext_t          sdf_ext )
+{
+    cov_image_.reset( cov_size );
+    sdf_image_.reset( cov_size, sdf_ext );
+    sdf_ext_ = sdf_ext;
+}
+
+
 const SdfImage::pixel_t*
 Converter::build_sdf()
 {
-    const Grid grid { cov_image_, sdf_image_, sdf_ext_ };
+    const Grid grid { cov_image_, sdf_image_, sdf_ext_, engine_, grid_workspace_ };
 
     return sdf_image_.data();
 }
@@ -2,6 +2,7 @@
 
 #include "CovImage.hpp"
 #include "SdfImage.hpp"
+#include "Grid.hpp"
 #include "basic_types.hpp"  // for img_size_t, sdf_ext_t
 
 
@@ -17,7 +18,11 @@ namespace sdfield {
  *  次にその画像を build_sdf() により SDF 画像に変換する。戻り値に変換
  *  結果のデータが書き込まれる。
  *
- *  変換結果はデストラクタが呼び出されるまで参照することができる。
+ *  変換結果はデストラクタまたは reset() が呼び出されるまで参照する
+ *  ことができる。
+ *
+ *  reset() により別の寸法の画像の変換に再利用することができる。この
+ *  とき、内部の領域は足りないときだけ確保し直される。
  *
  *  デストラクタはいつでも呼び出すことができる。
  */
@@ -39,6 +44,27 @@ class Converter {
                sdf_ext_t          sdf_ext );
 
 
+    /** @brief 再初期化
+     *
+     *  converter_reset() の実装である。パラメータはコンストラクタと同
+     *  じである。
+     *
+     *  以前の入力画像と変換結果は無効になる。
+     */
+    void
+    reset( const img_size_t& cov_size,
+           sdf_ext_t          sdf_ext );
+
+
+    /** @brief 距離変換の手法を設定
+     *
+     *  converter_set_engine() の実装である。既定値は
+     *  DistanceEngine::SSEDT8 である。
+     */
+    void
+    set_engine( DistanceEngine engine ) { engine_ = engine; }
+
+
     // converter_get_write_position() の実装
     CovImage::pixel_t*
     get_write_position() { return cov_image_.data(); }
@@ -50,9 +76,11 @@ class Converter {
 
 
   private:
-    CovImage cov_image_;
-    SdfImage sdf_image_;
-    sdf_ext_t  sdf_ext_;
+    CovImage               cov_image_;
+    SdfImage               sdf_image_;
+    sdf_ext_t                sdf_ext_;
+    DistanceEngine            engine_ = DistanceEngine::SSEDT8;
+    Grid::Workspace   grid_workspace_;
 
 };
 
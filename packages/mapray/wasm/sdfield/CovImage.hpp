@@ -2,7 +2,7 @@
 
 #include "basic_types.hpp"  // for img_coord_elem_t, img_size_t
 #include <memory>   // for unique_ptr
-#include <cstddef>  // for ptrdiff_t
+#include <cstddef>  // for size_t, ptrdiff_t
 
 
 namespace sdfield {
@@ -39,7 +39,8 @@ class CovImage {
      */
     explicit CovImage( const img_size_t& size )
         : size_{ size },
-          data_{ new pixel_t[ size[0] * size[1] ] }
+          capacity_{ calc_num_pixels( size ) },
+          data_{ new pixel_t[ capacity_ ] }
     {
         // 画素の初期化は必要なく、さらに速度が重要なため
         // std::vector ではなく動的配列を使用する。
@@ -49,6 +50,27 @@ class CovImage {
     }
 
 
+    /** @brief 画像サイズを変更
+     *
+     *  サイズが size の画像に変更する。
+     *
+     *  画素列の領域は足りないときだけ確保し直す。画素値は初期化され
+     *  ない。
+     */
+    void
+    reset( const img_size_t& size )
+    {
+        const auto num_pixels = calc_num_pixels( size );
+
+        if ( capacity_ < num_pixels ) {
+            data_.reset( new pixel_t[ num_pixels ] );
+            capacity_ = num_pixels;
+        }
+
+        size_ = size;
+    }
+
+
     /** @brief 画像サイズ
      */
     img_size_t size() const { return size_; }
@@ -59,6 +81,11 @@ class CovImage {
     pixel_t* data() { return data_.get(); }
 
 
+    /** @brief 画素列の先頭アドレスを取得 (const)
+     */
+    const pixel_t* data() const { return data_.get(); }
+
+
     /** @brief 指定位置に画素を設定
      */
     void
@@ -81,6 +108,15 @@ class CovImage {
 
 
   private:
+    /** @brief 画素数を計算
+     */
+    static std::size_t
+    calc_num_pixels( const img_size_t& size )
+    {
+        return static_cast<std::size_t>( size[0] ) * size[1];
+    }
+
+
     /** @brief 指定位置のインデックスを取得
      */
     std::ptrdiff_t
@@ -93,8 +129,9 @@ class CovImage {
 
 
   private:
-    const img_size_t size_;
-    const std::unique_ptr<pixel_t[]> data_;
+    img_size_t                 size_;
+    std::size_t            capacity_;  // data_ の画素数
+    std::unique_ptr<pixel_t[]> data_;
 
 };
 
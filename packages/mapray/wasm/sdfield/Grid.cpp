@@ -1,38 +1,240 @@
 ﻿#include "Grid.hpp"
 #include "Binarizer.hpp"
 #include "SdfImage.hpp"
-#include <algorithm>   // for clamp()
+#include "Simd.hpp"
+#include "utility.hpp" // for get_aligned()
+#include <algorithm>   // for clamp(), min(), max()
 #include <cmath>       // for sqrt(), round()
+#include <limits>      // for numeric_limits
 #include <cassert>
 
 
 namespace sdfield {
 
 
+namespace {
+
+/** @brief 表と裏の最小距離から SDF 画像の画素値を計算
+ */
+SdfImage::pixel_t
+get_sdf_pixel( float d0,
+               float d1 )
+{
+    using std::round;
+    using std::clamp;
+
+    // 符号付き距離
+    const auto d = d0 - d1;
+
+    // テクスチャのサンプル値 (スケール、クランプ済み)
+    const auto s = clamp<float>( (d - DIST_LOWER) * DIST_FACTOR * SdfImage::max_value,
+                                 0, SdfImage::max_value );
+
+    return static_cast<SdfImage::pixel_t>( round( s ) );
+}
+
+
+#if SDFIELD_SIMD
+/** @brief 候補のほうが短いときベクトルを更新
+ *
+ *  8SSEDT でノードのベクトル vec を候補 cand と比較する。同じ長さのと
+ *  きは更新しない。
+ */
+inline void
+update_if_shorter( Vec&        vec,
+                   const Vec& cand )
+{
+    if ( cand.dist_sq() < vec.dist_sq() ) {
+        vec = cand;
+    }
+}
+
+
+/** @brief 行の横方向のスキャン
+ *
+ *  @tparam step  左から右へのとき +1、右から左へのとき -1
+ *
+ *  各ノード x を、直前に更新したノード x - step からの候補と比較し、
+ *  cand_dx が nullptr でなければ、さらに隣接行からの候補
+ *  (find_row_candidates() の結果) と比較する。
+ *
+ *  @param [in,out] dx       行のノード 0 の dx の位置
+ *  @param [in,out] dy       行のノード 0 の dy の位置
+ *  @param          cand_dx  隣接行からの候補の dx、または nullptr
+ *  @param          cand_dy  隣接行からの候補の dy、または nullptr
+ *  @param          count    行のノード数
+ */
+template<int step>
+void
+scan_row( vec_elem_t*            dx,
+          vec_elem_t*            dy,
+          const vec_elem_t* cand_dx,
+          const vec_elem_t* cand_dy,
+          img_coord_elem_t    count )
+{
+    using coord_t = img_coord_elem_t;
+
+    const auto first = static_cast<coord_t>( (step > 0) ? 0 : count - 1 );
+    const auto  last = static_cast<coord_t>( (step > 0) ? count - 1 : 0 );
+
+    // 直前に更新したノードのベクトル (dx と dy の別名の可能性により、
+    // 配列から読み直さないようにする)
+    Vec prev { dx[first - step], dy[first - step] };
+
+    for ( auto x = first; x != last + step; x += step ) {
+        Vec vec { dx[x], dy[x] };
+
+        update_if_shorter( vec, Vec{ prev.dx - step, prev.dy } );
+
+        if ( cand_dx != nullptr ) {
+            update_if_shorter( vec, Vec{ cand_dx[x], cand_dy[x] } );
+        }
+
+        dx[x] = vec.dx;
+        dy[x] = vec.dy;
+        prev  = vec;
+    }
+}
+
+
+/** @brief 隣接行のノードからの候補を計算
+ *
+ *  8SSEDT で行の各ノード x と比較する、隣接行のノード x - 1, x, x + 1
+ *  のベクトルにオフセット (-1, oy), (0, oy), (+1, oy) を加えた 3 個の
+ *  候補のうち、最短のもの (同じ長さのときは先のもの) を求める。
+ *
+ *  この候補は行内の他のノードの更新に依存しないので、4 ノードずつ計算
+ *  する。演算と比較の順序はノードごとの比較と同じなので、結果は
+ *  compare_and_update_node() による処理と一致する。
+ *
+ *  行の横方向の比較の後にこの候補と比較すると、3 個の候補と順に比較し
+ *  たときと同じ結果になる。
+ *
+ *  @param      src_dx   隣接行のノード -1 の dx の位置
+ *  @param      src_dy   隣接行のノード -1 の dy の位置
+ *  @param      oy       隣接行のオフセット (-1 または +1)
+ *  @param      count    行のノード数
+ *  @param[out] cand_dx  候補の dx の格納先 (4 の倍数に切り上げた要素数)
+ *  @param[out] cand_dy  候補の dy の格納先 (4 の倍数に切り上げた要素数)
+ *
+ *  src_dx, src_dy の要素 count + 2 から 3 要素先まで読み込むことがある。
+ */
+void
+find_row_candidates( const vec_elem_t* src_dx,
+                     const vec_elem_t* src_dy,
+                     vec_elem_t            oy,
+                     img_coord_elem_t   count,
+                     vec_elem_t*      cand_dx,
+                     vec_elem_t*      cand_dy )
+{
+    const f32x4 oy4{ oy };
+
+    for ( img_coord_elem_t i = 0; i < count; i += 4 ) {
+        // オフセット (-1, oy) の候補
+        auto best_dx = f32x4::load( src_dx + i ) + f32x4{ -1 };
+        auto best_dy = f32x4::load( src_dy + i ) + oy4;
+        auto best_ds = best_dx * best_dx + best_dy * best_dy;
+
+        // オフセット (0, oy), (+1, oy) の候補
+        for ( img_coord_elem_t ox = 0; ox <= 1; ++ox ) {
+            const auto cdx = f32x4::load( src_dx + i + ox + 1 ) + f32x4{ static_cast<float>( ox ) };
+            const auto cdy = f32x4::load( src_dy + i + ox + 1 ) + oy4;
+            const auto cds = cdx * cdx + cdy * cdy;
+            const auto   m = cds < best_ds;
+
+            best_dx = select( m, cdx, best_dx );
+            best_dy = select( m, cdy, best_dy );
+            best_ds = select( m, cds, best_ds );
+        }
+
+        best_dx.store( cand_dx + i );
+        best_dy.store( cand_dy + i );
+    }
+}
+#endif
+
+
+/** @brief 画素ブロックの周囲がすべて同じ側の fulcov 画素か?
+ *
+ *  行 p0, p1, p2 の画素 [0, 18) (中央の行の 16 画素のブロック [1, 17)
+ *  とその周囲の画素) が、すべて hi 以上、またはすべて lo 以下のとき真を返す。
+ *
+ *  SDFIELD_SIMD が真のときは 16 画素ずつ比較する。
+ */
+bool
+is_flat_block( const CovImage::pixel_t* p0,
+               const CovImage::pixel_t* p1,
+               const CovImage::pixel_t* p2,
+               CovImage::pixel_t        lo,
+               CovImage::pixel_t        hi )
+{
+#if SDFIELD_SIMD
+    auto vmin = u8x16::load( p0 );
+    auto vmax = vmin;
+
+    for ( const auto* p : { p0, p1, p2 } ) {
+        for ( int ox = 0; ox <= 2; ++ox ) {
+            const auto v = u8x16::load( p + ox );
+            vmin = min( vmin, v );
+            vmax = max( vmax, v );
+        }
+    }
+
+    return vmin.all_ge( hi ) || vmax.all_le( lo );
+#else
+    CovImage::pixel_t vmin = p0[0];
+    CovImage::pixel_t vmax = p0[0];
+
+    for ( const auto* p : { p0, p1, p2 } ) {
+        for ( int i = 0; i < 18; ++i ) {
+            vmin = std::min( vmin, p[i] );
+            vmax = std::max( vmax, p[i] );
+        }
+    }
+
+    return vmin >= hi || vmax <= lo;
+#endif
+}
+
+} // namespace
+
+
 Grid::Grid( const CovImage& cov_image,
             SdfImage&       sdf_image,
-            sdf_ext_t         sdf_ext )
+            sdf_ext_t         sdf_ext,
+            DistanceEngine     engine,
+            Workspace&      workspace )
     : size_{ SdfImage::calc_size( cov_image.size(), sdf_ext ) },
       actual_size_{ cast,
                     size_[0] + 2 * dummy_ext,
                     size_[1] + 2 * dummy_ext },
       sdf_ext_{ sdf_ext },
-      data_{ new Node[ actual_size_[0] * actual_size_[1] ] }
+      data_{ workspace.reserve_nodes( static_cast<std::size_t>( actual_size_[0] ) * actual_size_[1] ) }
 {
-    // std::vector ではなく動的配列を使用する理由は CovImage.hpp
-    // のコメントを参照
+    // 境界画素を探す
+    auto& runs = workspace.edge_runs_;
+    find_edge_runs( cov_image, runs );
 
     // ノードを初期値で埋める
     setup_outer_nodes();
     setup_inner_nodes( cov_image );
 
     // 近隣ノードを更新
-    for ( const auto& [x, y] : update_around_fulcov( cov_image ) ) {
+    auto& coords = workspace.gencov_coords_;
+    update_around_fulcov( cov_image, runs, coords );
+
+    for ( const auto& [x, y] : coords ) {
         update_around_gencov( cov_image, x, y );
     }
 
-    // ラスタスキャンにより更新
-    scan_with_8SSEDT_method( sdf_image );
+    // 距離を求めて sdf_image に書き込む
+    if ( engine == DistanceEngine::SEPARABLE ) {
+        scan_with_separable_method( sdf_image, workspace );
+    }
+    else {
+        // ラスタスキャンにより更新
+        scan_with_8SSEDT_method( sdf_image, workspace );
+    }
 }
 
 
@@ -218,25 +420,107 @@ Grid::setup_inner_nodes( const CovImage& cov_image )
 }
 
 
-/** すべての fulcov 画素の周りを更新
+/** @brief 境界画素の範囲を探す
+ *
+ *  CovImage の境界画素の連続範囲を行順、左から順に runs に設定する (以
+ *  前の内容は消去)。
+ *
+ *  ここで境界画素でない画素とは、画像の最外周ではなく、自己と隣接する
+ *  8 画素がすべて表の fulcov 画素、またはすべて裏の fulcov 画素である
+ *  ものである。その画素に対する update_adjacent_nodes() は、隣接ノード
+ *  のベクトルがすでに零ベクトルなので何も変更しない。gencov 画素はすべ
+ *  て境界画素になる。
+ *
+ *  境界画素かどうかは edge_block_width 画素のブロック単位で判定するの
+ *  で、runs には境界画素でない画素も含まれることがある。
  */
-std::vector<Grid::packed_coords_t>
-Grid::update_around_fulcov( const CovImage& cov_image )
+void
+Grid::find_edge_runs( const CovImage&       cov_image,
+                      std::vector<EdgeRun>& runs ) const
 {
-    constexpr auto    one = CovImage::max_value;
-    constexpr auto thresh = fulcov_pixel_value_thresh;
+    constexpr auto thresh_1 = fulcov_pixel_value_thresh;  // 表の fulcov 画素の下限
+    constexpr auto thresh_0 = static_cast<CovImage::pixel_t>( CovImage::max_value - thresh_1 );  // 裏の上限
+
+    static_assert( edge_block_width == 16 );  // is_flat_block() のブロックの画素数
 
     const auto cov_size = cov_image.size();
 
-    // CovImage 座標の範囲
-    const auto cx_lower = static_cast<CovImage::coord_t>( 0 );
-    const auto cy_lower = static_cast<CovImage::coord_t>( 0 );
-    const auto cx_upper = static_cast<CovImage::coord_t>( cov_size[0] );
-    const auto cy_upper = static_cast<CovImage::coord_t>( cov_size[1] );
+    const auto xsize = static_cast<CovImage::coord_t>( cov_size[0] );
+    const auto ysize = static_cast<CovImage::coord_t>( cov_size[1] );
+
+    const auto* const    pixels = cov_image.data();
+    const std::ptrdiff_t  pitch = xsize;
+
+    // 範囲を追加する関数
+    const auto add_run = [&runs]( CovImage::coord_t y,
+                                  CovImage::coord_t x_lower,
+                                  CovImage::coord_t x_upper ) {
+        using elem_t = decltype( EdgeRun::y );
+
+        runs.push_back( { static_cast<elem_t>( y ),
+                          static_cast<elem_t>( x_lower ),
+                          static_cast<elem_t>( x_upper ) } );
+    };
+
+    runs.clear();
+
+    for ( CovImage::coord_t cy = 0; cy < ysize; ++cy ) {
+        if ( cy == 0 || cy == ysize - 1 ) {
+            // 最上行と最下行はすべて境界画素とする
+            add_run( cy, 0, xsize );
+            continue;
+        }
+
+        // 行 cy - 1, cy, cy + 1 の先頭
+        const auto p1 = pixels + cy * pitch;
+        const auto p0 = p1 - pitch;
+        const auto p2 = p1 + pitch;
 
-    std::vector<packed_coords_t> coords;
+        // 最左列は境界画素とする
+        CovImage::coord_t run_lower = 0;
+
+        // ブロック [x, x + edge_block_width) の判定には画素
+        // [x - 1, x + edge_block_width] を読み込む (最右列は境界画素)
+        CovImage::coord_t x = 1;
+
+        for ( ; x + edge_block_width < xsize; x += edge_block_width ) {
+            if ( is_flat_block( p0 + x - 1, p1 + x - 1, p2 + x - 1, thresh_0, thresh_1 ) ) {
+                if ( run_lower < x ) {
+                    add_run( cy, run_lower, x );
+                }
+                run_lower = static_cast<CovImage::coord_t>( x + edge_block_width );
+            }
+        }
+
+        // 残りの画素
+        add_run( cy, run_lower, xsize );
+    }
+}
+
+
+/** すべての境界の fulcov 画素の周りを更新
+ *
+ *  runs (find_edge_runs() の結果) の範囲の画素だけを処理する。範囲外
+ *  の画素に対する更新は何も変更しないので省略できる。
+ *
+ *  fulcov でない画素の座標を coords に設定する (以前の内容は消去)。
+ */
+void
+Grid::update_around_fulcov( const CovImage&               cov_image,
+                            const std::vector<EdgeRun>&   runs,
+                            std::vector<packed_coords_t>& coords )
+{
+    constexpr auto    one = CovImage::max_value;
+    constexpr auto thresh = fulcov_pixel_value_thresh;
+
+    coords.clear();
+
+    for ( const auto& run : runs ) {
+        // CovImage 座標の範囲
+        const auto cx_lower = static_cast<CovImage::coord_t>( run.x_lower );
+        const auto cx_upper = static_cast<CovImage::coord_t>( run.x_upper );
+        const auto       cy = static_cast<CovImage::coord_t>( run.y );
 
-    for ( auto cy = cy_lower; cy < cy_upper; ++cy ) {
         for ( auto cx = cx_lower; cx < cx_upper; ++cx ) {
             const auto cov_0 = cov_image.get_pixel( cx, cy );  // 表の被覆率
             const auto cov_1 = one - cov_0;                    // 裏の被覆率
@@ -268,8 +552,6 @@ Grid::update_around_fulcov( const CovImage& cov_image )
             }
         }
     }
-
-    return coords;
 }
 
 
@@ -316,10 +598,104 @@ Grid::update_around_gencov( const CovImage& cov_image,
  *  2D Euclidean distance transform algorithms: a comparative survey
  *  <https://core.ac.uk/download/pdf/37522354.pdf>
  *
+ *  SDFIELD_SIMD が真のときは、ノードのベクトルを成分ごとの配列
+ *  (VecPlanes) に複写して処理し、表と裏は独立にスキャンする。各行で隣
+ *  接行のノードとの比較は find_row_candidates() でまとめて行うが、比較
+ *  の順序はノードごとに処理するときと同じなので、結果は変わらない。
+ *
+ *  SDFIELD_SIMD が偽のときは、複写の負荷と作業領域を避けるため、ノー
+ *  ド配列を直接スキャンする。
+ *
  *  @param [in,out] sdf_image  格納先の SDF 画像
+ *  @param [in,out] workspace  作業領域 (SDFIELD_SIMD が真のときに使う)
  */
+#if SDFIELD_SIMD
 void
-Grid::scan_with_8SSEDT_method( SdfImage& sdf_image )
+Grid::scan_with_8SSEDT_method( SdfImage& sdf_image,
+                               Workspace& workspace )
+{
+    assert( sdf_image.size()[0] == size_[0] &&
+            sdf_image.size()[1] == size_[1] );
+
+    const auto xsize = static_cast<coord_t>( size_[0] );
+    const auto ysize = static_cast<coord_t>( size_[1] );
+
+    // 表と裏のベクトルを成分ごとの配列で処理する
+    auto& planes = workspace.vec_planes_;
+    auto&  cands = workspace.row_cands_;
+
+    load_vec_planes( planes );
+
+    for ( auto& cand : cands ) {
+        cand.dx.resize( get_aligned<4>( static_cast<std::size_t>( xsize ) ) );
+        cand.dy.resize( get_aligned<4>( static_cast<std::size_t>( xsize ) ) );
+    }
+
+    // 上から下へのパス
+    for ( coord_t y = 0; y < ysize; ++y ) {
+        for ( std::size_t side = 0; side < 2; ++side ) {
+            const auto dx = planes[side].dx.data() + node_index( 0, y );
+            const auto dy = planes[side].dy.data() + node_index( 0, y );
+            const auto cdx = cands[side].dx.data();
+            const auto cdy = cands[side].dy.data();
+
+            // 上の行からの候補
+            find_row_candidates( planes[side].dx.data() + node_index( -1, y - 1 ),
+                                 planes[side].dy.data() + node_index( -1, y - 1 ),
+                                 -1, xsize, cdx, cdy );
+
+            // 左から右にスキャン
+            scan_row<+1>( dx, dy, cdx, cdy, xsize );
+
+            // 右から左にスキャン
+            scan_row<-1>( dx, dy, nullptr, nullptr, xsize );
+        }
+    }
+
+    // 下から上へのパス
+    for ( coord_t y = ysize - 1; y >= 0; --y ) {
+        for ( std::size_t side = 0; side < 2; ++side ) {
+            const auto dx = planes[side].dx.data() + node_index( 0, y );
+            const auto dy = planes[side].dy.data() + node_index( 0, y );
+            const auto cdx = cands[side].dx.data();
+            const auto cdy = cands[side].dy.data();
+
+            // 下の行からの候補
+            find_row_candidates( planes[side].dx.data() + node_index( -1, y + 1 ),
+                                 planes[side].dy.data() + node_index( -1, y + 1 ),
+                                 +1, xsize, cdx, cdy );
+
+            // 右から左にスキャン
+            scan_row<-1>( dx, dy, cdx, cdy, xsize );
+
+            // 左から右にスキャン
+            scan_row<+1>( dx, dy, nullptr, nullptr, xsize );
+        }
+
+        // 行 y のノードは確定したので、結果を sdf_image に書き込む
+        const auto index = node_index( 0, y );
+
+        for ( coord_t x = 0; x < xsize; ++x ) {
+            const Vec v0 { planes[0].dx[index + x], planes[0].dy[index + x] };
+            const Vec v1 { planes[1].dx[index + x], planes[1].dy[index + x] };
+
+            assert( v0.is_zero() || v1.is_zero() );  // 少なくとも一方は距離 0
+
+            using std::sqrt;
+
+            // 表の距離と裏の距離
+            const auto d0 = sqrt( static_cast<float>( v0.dist_sq() ) );
+            const auto d1 = sqrt( static_cast<float>( v1.dist_sq() ) );
+
+            // sdf_image に画素値を設定
+            sdf_image.set_pixel( x, y, get_sdf_pixel( d0, d1 ) );
+        }
+    }
+}
+#else
+void
+Grid::scan_with_8SSEDT_method( SdfImage& sdf_image,
+                               Workspace& )
 {
     assert( sdf_image.size()[0] == size_[0] &&
             sdf_image.size()[1] == size_[1] );
@@ -368,22 +744,193 @@ Grid::scan_with_8SSEDT_method( SdfImage& sdf_image )
             assert( node.v0.is_zero() || node.v1.is_zero() );  // 少なくとも一方は距離 0
 
             using std::sqrt;
-            using std::round;
-            using std::clamp;
 
             // 表の距離と裏の距離
             const auto d0 = sqrt( static_cast<float>( node.v0.dist_sq() ) );
             const auto d1 = sqrt( static_cast<float>( node.v1.dist_sq() ) );
 
-            // 符号付き距離
-            const auto d = d0 - d1;
+            // sdf_image に画素値を設定
+            sdf_image.set_pixel( x, y, get_sdf_pixel( d0, d1 ) );
+        }
+    }
+}
+#endif
+
+
+#if SDFIELD_SIMD
+/** @brief ノード配列のベクトルを成分ごとの配列に複写
+ *
+ *  planes の要素 0 に表、1 に裏のベクトルを複写する。
+ */
+void
+Grid::load_vec_planes( std::array<VecPlanes, 2>& planes ) const
+{
+    const auto num_nodes = static_cast<std::size_t>( actual_size_[0] ) * actual_size_[1];
+
+    for ( auto& plane : planes ) {
+        plane.dx.resize( num_nodes + planes_padding );
+        plane.dy.resize( num_nodes + planes_padding );
+    }
+
+    for ( std::size_t i = 0; i < num_nodes; ++i ) {
+        const auto& node = data_[i];
+
+        planes[0].dx[i] = node.v0.dx;
+        planes[0].dy[i] = node.v0.dy;
+        planes[1].dx[i] = node.v1.dx;
+        planes[1].dy[i] = node.v1.dy;
+    }
+}
+#endif
+
+
+/** @brief 行と列に分離した距離変換
+ *
+ *  初期化後のノードのうち、隣接画素内の点を指すノードをシード (その点
+ *  をサイト) として、各ノードから最も近いサイトまでの距離を求める。
+ *
+ *  Felzenszwalb and Huttenlocher (2012) の手法に従い、各行で 1 次元の
+ *  距離変換を行い、その結果に対して各列で 1 次元の距離変換を行う。各
+ *  段階は放物線の下側包絡線 (ParabolaEnvelope) により線形時間で処理さ
+ *  れ、行ごと列ごとに独立している。
+ *
+ *  サイトがすべて画素中心にあるときは厳密解になる。サイトは画素中心か
+ *  ら最大 1.5 画素ずれることがあるので、行の段階ではその行の標本点に最
+ *  も近いサイトを代表とし、列の段階ではその正確な位置を使う。
+ *
+ *  8SSEDT と異なり、遠方のサイトへの伝播で誤差が蓄積することはない。
+ *
+ *  @param [in,out] sdf_image  格納先の SDF 画像
+ *  @param [in,out] workspace  作業領域
+ */
+void
+Grid::scan_with_separable_method( SdfImage&  sdf_image,
+                                  Workspace& workspace )
+{
+    assert( sdf_image.size()[0] == size_[0] &&
+            sdf_image.size()[1] == size_[1] );
+
+    auto& dist_sq0 = workspace.dist_sqs_[0];
+    auto& dist_sq1 = workspace.dist_sqs_[1];
 
-            // テクスチャのサンプル値 (スケール、クランプ済み)
-            const auto s = clamp<float>( (d - DIST_LOWER) * DIST_FACTOR * SdfImage::max_value,
-                                         0, SdfImage::max_value );
+    compute_separable_dist_sq<&Node::v0>( workspace, dist_sq0 );
+    compute_separable_dist_sq<&Node::v1>( workspace, dist_sq1 );
+
+    const auto xsize = static_cast<coord_t>( size_[0] );
+    const auto ysize = static_cast<coord_t>( size_[1] );
+
+    std::size_t index = 0;
+
+    for ( coord_t y = 0; y < ysize; ++y ) {
+        for ( coord_t x = 0; x < xsize; ++x, ++index ) {
+            using std::sqrt;
+
+            // 表の距離と裏の距離
+            const auto d0 = sqrt( dist_sq0[index] );
+            const auto d1 = sqrt( dist_sq1[index] );
 
             // sdf_image に画素値を設定
-            sdf_image.set_pixel( x, y, static_cast<SdfImage::pixel_t>( round( s ) ) );
+            sdf_image.set_pixel( x, y, get_sdf_pixel( d0, d1 ) );
+        }
+    }
+}
+
+
+/** @brief 表または裏の最小距離の平方を計算
+ *
+ *  scan_with_separable_method() の片面の処理である。
+ *
+ *  @tparam vec_ptr  Node のメンバー &Node::v0 または &Node::v1
+ *
+ *  @param [in,out] workspace  作業領域
+ *  @param [out]    dist_sq    ダミーを除く各ノードの距離の平方 (行優先)
+ *
+ *  サイトが存在しないノードの距離は ∞ とする (inf_point までの距離と
+ *  同じく、SDF 画像では最大値になる)。
+ */
+template<Vec Grid::Node::* vec_ptr>
+void
+Grid::compute_separable_dist_sq( Workspace&          workspace,
+                                 std::vector<float>&   dist_sq )
+{
+    const auto xsize = static_cast<coord_t>( size_[0] );
+    const auto ysize = static_cast<coord_t>( size_[1] );
+
+    // ダミーを含むノードの範囲
+    const auto x_lower = static_cast<coord_t>( -dummy_ext );
+    const auto y_lower = static_cast<coord_t>( -dummy_ext );
+    const auto x_upper = static_cast<coord_t>( xsize + dummy_ext );
+    const auto y_upper = static_cast<coord_t>( ysize + dummy_ext );
+
+    auto& row_sites = workspace.row_sites_;
+    auto&  envelope = workspace.envelope_;
+
+    row_sites.resize( static_cast<std::size_t>( xsize ) * actual_size_[1] );
+
+    // 各行の処理
+    //
+    // ノード (x, y) に、行 y のサイトで標本点 (x, y) に最も近いものを
+    // 記録する。
+    for ( auto y = y_lower; y < y_upper; ++y ) {
+        envelope.clear();
+
+        for ( auto x = x_lower; x < x_upper; ++x ) {
+            const auto& v = ref_node( x, y ).*vec_ptr;
+
+            if ( v.dist_sq() <= max_seed_dist_sq ) {
+                // サイト (x + v.dx, y + v.dy)
+                envelope.add( x + v.dx, v.dy * v.dy, y + v.dy );
+            }
+        }
+
+        const auto row = row_sites.begin() + (y - y_lower) * xsize;
+
+        if ( envelope.empty() ) {
+            std::fill( row, row + xsize, RowSite{ 0, 0, false } );
+            continue;
+        }
+
+        envelope.build();
+
+        for ( coord_t x = 0; x < xsize; ++x ) {
+            const auto& site = envelope.find_lowest( x );
+
+            row[x] = RowSite{ static_cast<vec_elem_t>( site.pos ),
+                              static_cast<vec_elem_t>( site.aux ),
+                              true };
+        }
+    }
+
+    // 各列の処理
+    //
+    // 各行の代表のサイトから、標本点 (x, y) に最も近いものを求める。
+    dist_sq.resize( static_cast<std::size_t>( xsize ) * ysize );
+
+    constexpr auto inf = std::numeric_limits<float>::infinity();
+
+    for ( coord_t x = 0; x < xsize; ++x ) {
+        envelope.clear();
+
+        for ( auto y = y_lower; y < y_upper; ++y ) {
+            const auto& site = row_sites[(y - y_lower) * xsize + x];
+
+            if ( site.exists ) {
+                const double dx = x - site.x;
+                envelope.add( site.y, dx * dx, 0 );
+            }
+        }
+
+        if ( envelope.empty() ) {
+            for ( coord_t y = 0; y < ysize; ++y ) {
+                dist_sq[y * xsize + x] = inf;
+            }
+            continue;
+        }
+
+        envelope.build();
+
+        for ( coord_t y = 0; y < ysize; ++y ) {
+            dist_sq[y * xsize + x] = static_cast<float>( envelope.find_lowest( y ).value( y ) );
         }
     }
 }
@@ -2,6 +2,7 @@
 
 #include "Binarizer.hpp"    // for PixelPart
 #include "CovImage.hpp"
+#include "ParabolaEnvelope.hpp"
 #include "basic_types.hpp"  // for img_coord_elem_t, img_size_t
 #include "config.hpp"       // for SUB_PIXEL_DIVS
 #include <vector>
@@ -16,6 +17,27 @@ namespace sdfield {
 class SdfImage;
 
 
+/** @brief 距離変換の手法
+ *
+ *  Grid が各ノードの最小距離を求める手法である。
+ */
+enum class DistanceEngine {
+
+    /** @brief 8SSEDT によるラスタスキャン (既定)
+     *
+     *  Grid::scan_with_8SSEDT_method() を参照
+     */
+    SSEDT8 = 0,
+
+    /** @brief 行と列に分離した距離変換
+     *
+     *  Grid::scan_with_separable_method() を参照
+     */
+    SEPARABLE = 1,
+
+};
+
+
 /** @brief グリッド
  *
  *  実装に使われている用語
@@ -79,6 +101,26 @@ class Grid {
     using packed_coords_t = std::array<std::uint16_t, 2>;
 
 
+    /** @brief 境界画素の連続範囲
+     *
+     *  CovImage の行 y の画素 [x_lower, x_upper) を表す。
+     *
+     *  find_edge_runs() を参照
+     */
+    struct EdgeRun {
+        std::uint16_t       y;
+        std::uint16_t x_lower;
+        std::uint16_t x_upper;
+    };
+
+
+    /** @brief 境界画素を探すブロックの画素数
+     *
+     *  find_edge_runs() は行をこの画素数のブロック単位で調べる。
+     */
+    static constexpr img_coord_elem_t edge_block_width = 16;
+
+
     /** fulcov 画素の被覆率の閾値
      *
      *  この値以上の被覆率の画素は fulcov 画素とする。
@@ -100,16 +142,113 @@ class Grid {
     static constexpr dummy_ext_t dummy_ext = 1;
 
 
+    /** @brief シードとするノードのベクトルの距離の平方の上限
+     *
+     *  初期化後のノードのベクトルは、隣接画素内の点へのベクトル (長さ
+     *  1.5√2 以下) か、inf_point へのベクトルである。前者のノードを
+     *  scan_with_separable_method() のシードとする。
+     */
+    static constexpr vec_dist_t max_seed_dist_sq = 8;
+
+
+    /** @brief 行ごとの最近シードの位置
+     *
+     *  scan_with_separable_method() の作業用である。
+     */
+    struct RowSite {
+        vec_elem_t x;
+        vec_elem_t y;
+        bool  exists;  // 行にシードが存在するか?
+    };
+
+
+#if SDFIELD_SIMD
+    /** @brief ベクトルの成分ごとの配列 (SoA)
+     *
+     *  scan_with_8SSEDT_method() の作業用である。ノード配列と同じ配置の
+     *  ときは、ノード (x, y) の成分は要素 node_index( x, y ) になる。
+     */
+    struct VecPlanes {
+        std::vector<vec_elem_t> dx;
+        std::vector<vec_elem_t> dy;
+    };
+
+
+    /** @brief VecPlanes の末尾の余白の要素数
+     *
+     *  4 要素単位の読み込みが配列の範囲を超えないようにする。
+     */
+    static constexpr std::size_t planes_padding = 4;
+#endif
+
+
+  public:
+    /** @brief 作業領域
+     *
+     *  Grid のノード配列などの領域で、複数の Grid インスタンスで順に
+     *  再利用することができる。
+     *
+     *  領域は足りないときだけ確保し直し、縮小することはない。
+     */
+    class Workspace {
+
+        friend class Grid;
+
+
+        /** @brief count 個以上のノードの領域を取得
+         *
+         *  ノードは初期化されない。
+         */
+        Node*
+        reserve_nodes( std::size_t count )
+        {
+            if ( node_capacity_ < count ) {
+                // std::vector ではなく動的配列を使用する理由は
+                // CovImage.hpp のコメントを参照
+                nodes_.reset( new Node[ count ] );
+                node_capacity_ = count;
+            }
+
+            return nodes_.get();
+        }
+
+
+        std::unique_ptr<Node[]>          nodes_;
+        std::size_t              node_capacity_ = 0;
+        std::vector<EdgeRun>             edge_runs_;  // find_edge_runs() の結果
+        std::vector<packed_coords_t> gencov_coords_;  // update_around_fulcov() の結果
+
+#if SDFIELD_SIMD
+        // scan_with_8SSEDT_method() の作業領域 (要素 0 が表、1 が裏)
+        std::array<VecPlanes, 2> vec_planes_;  // ノード配列と同じ配置
+        std::array<VecPlanes, 2>  row_cands_;  // 隣接行からの候補 (1 行分)
+#endif
+
+        // scan_with_separable_method() の作業領域
+        std::vector<RowSite>             row_sites_;
+        std::array<std::vector<float>, 2> dist_sqs_;  // 表と裏の距離の平方
+        ParabolaEnvelope                  envelope_;
+
+    };
+
+
   public:
     /** @brief 初期化
      *
      *  @param          cov_image  入力画像
      *  @param [in,out] sdf_image  出力画像
      *  @param          sdf_ext    拡張画素数
+     *  @param          engine     距離変換の手法
+     *  @param [in,out] workspace  作業領域
+     *
+     *  workspace はこのインスタンスが破棄されるまで他で使ってはならな
+     *  い。
      */
-    explicit Grid( const CovImage& cov_image,
-                   SdfImage&       sdf_image,
-                   sdf_ext_t         sdf_ext );
+    Grid( const CovImage& cov_image,
+          SdfImage&       sdf_image,
+          sdf_ext_t         sdf_ext,
+          DistanceEngine     engine,
+          Workspace&      workspace );
 
 
     /** @brief SDF 画像を取得
@@ -124,10 +263,18 @@ class Grid {
   private:
     void setup_outer_nodes();
     void setup_inner_nodes( const CovImage& cov_image );
-    std::vector<packed_coords_t>
-    update_around_fulcov( const CovImage& cov_image );
+    void find_edge_runs( const CovImage& cov_image, std::vector<EdgeRun>& runs ) const;
+    void update_around_fulcov( const CovImage& cov_image, const std::vector<EdgeRun>& runs,
+                               std::vector<packed_coords_t>& coords );
     void update_around_gencov( const CovImage& cov_image, coord_t gx, coord_t gy );
-    void scan_with_8SSEDT_method( SdfImage& sdf_image );
+    void scan_with_8SSEDT_method( SdfImage& sdf_image, Workspace& workspace );
+#if SDFIELD_SIMD
+    void load_vec_planes( std::array<VecPlanes, 2>& planes ) const;
+#endif
+    void scan_with_separable_method( SdfImage& sdf_image, Workspace& workspace );
+
+    template<Vec Node::* vec_ptr>
+    void compute_separable_dist_sq( Workspace& workspace, std::vector<float>& dist_sq );
 
 
     /** @brief 指定位置にノードを設定
@@ -141,19 +288,28 @@ class Grid {
     }
 
 
-    /** @brief 指定位置のノードを参照 (const)
+    /** @brief 指定位置のノードのインデックスを取得
      */
-    const Node&
-    ref_node( coord_t x,
-              coord_t y ) const
+    std::ptrdiff_t
+    node_index( coord_t x,
+                coord_t y ) const
     {
         const auto pitch = static_cast<std::ptrdiff_t>( actual_size_[0] );
 
         const auto actual_x = x + 1;
         const auto actual_y = y + 1;
-        const auto index = actual_x + actual_y * pitch;
 
-        return data_[index];
+        return actual_x + actual_y * pitch;
+    }
+
+
+    /** @brief 指定位置のノードを参照 (const)
+     */
+    const Node&
+    ref_node( coord_t x,
+              coord_t y ) const
+    {
+        return data_[node_index( x, y )];
     }
 
 
@@ -246,6 +402,7 @@ class Grid {
     }
 
 
+#if !SDFIELD_SIMD
     /** @brief ノードを比較して必要なら更新
      *
      *  @param [in,out] u_node  更新対象のノード
@@ -284,13 +441,14 @@ class Grid {
             u_node.v1 = v1_cand;
         }
     }
+#endif
 
 
   private:
     const grid_size_t size_;
     const grid_size_t actual_size_;
     const sdf_ext_t   sdf_ext_;
-    const std::unique_ptr<Node[]> data_;
+    Node* const          data_;  // Workspace のノード配列
 
 };
 
@@ -0,0 +1,202 @@
+﻿#pragma once
+
+#include <vector>
+#include <limits>   // for numeric_limits
+#include <cassert>
+#include <cstddef>  // for size_t
+
+
+namespace sdfield {
+
+
+/** @brief 放物線の下側包絡線
+ *
+ *  1 次元の距離変換のための、頂点の位置と高さが与えられた放物線
+ *
+ *    f(t) = (t - pos)^2 + height
+ *
+ *  の集合の下側包絡線を求める。
+ *
+ *  Felzenszwalb and Huttenlocher (2012) の手法による。ただし頂点の位置
+ *  は整数に限らない。
+ *
+ *  Distance Transforms of Sampled Functions
+ *  <https://doi.org/10.4086/toc.2012.v008a019>
+ *
+ *  clear(), add(), build() の後に、昇順の t で find_lowest() を呼び出
+ *  す。内部の領域は再利用される。
+ */
+class ParabolaEnvelope {
+
+  public:
+    /** @brief 放物線
+     */
+    struct Parabola {
+
+        /** @brief 頂点の位置
+         */
+        double pos;
+
+
+        /** @brief 頂点の高さ
+         */
+        double height;
+
+
+        /** @brief 放物線に付随する値
+         *
+         *  ParabolaEnvelope は参照しない。
+         */
+        double aux;
+
+
+        /** @brief t での値
+         */
+        double
+        value( double t ) const
+        {
+            const auto d = t - pos;
+            return d*d + height;
+        }
+
+    };
+
+
+  public:
+    /** @brief すべての放物線を削除
+     */
+    void
+    clear()
+    {
+        parabolas_.clear();
+    }
+
+
+    /** @brief 放物線を追加
+     */
+    void
+    add( double    pos,
+         double height,
+         double    aux )
+    {
+        parabolas_.push_back( { pos, height, aux } );
+    }
+
+
+    /** @brief 放物線が存在しないか?
+     */
+    bool
+    empty() const
+    {
+        return parabolas_.empty();
+    }
+
+
+    /** @brief 下側包絡線を構築
+     *
+     *  add() の順序は問わないが、頂点の位置がほぼ昇順のとき (各放物線の
+     *  順序のずれが小さいとき) に線形時間になる。
+     *
+     *  @pre !empty()
+     */
+    void
+    build()
+    {
+        assert( !empty() );
+
+        sort_parabolas();
+
+        constexpr auto inf = std::numeric_limits<double>::infinity();
+
+        hull_.clear();
+        bounds_.clear();
+
+        hull_.push_back( 0 );
+        bounds_.push_back( -inf );
+
+        for ( std::size_t q = 1; q < parabolas_.size(); ++q ) {
+            const auto& pq = parabolas_[q];
+
+            while ( true ) {
+                const auto& pv = parabolas_[hull_.back()];
+
+                // pq と pv の交点 (pq が右側で最小になる境界)
+                const double s = (pq.pos == pv.pos) ?
+                    ((pq.height < pv.height) ? -inf : inf) :
+                    ((pq.height + pq.pos * pq.pos) - (pv.height + pv.pos * pv.pos)) / (2 * (pq.pos - pv.pos));
+
+                if ( s == inf ) {
+                    // pq は pv より常に高い
+                    break;
+                }
+
+                if ( s <= bounds_.back() ) {
+                    // pv は包絡線に含まれない
+                    if ( hull_.size() == 1 ) {
+                        hull_.back() = q;
+                        break;
+                    }
+                    hull_.pop_back();
+                    bounds_.pop_back();
+                }
+                else {
+                    hull_.push_back( q );
+                    bounds_.push_back( s );
+                    break;
+                }
+            }
+        }
+
+        bounds_.push_back( inf );
+        cursor_ = 0;
+    }
+
+
+    /** @brief t で最小の放物線を取得
+     *
+     *  @pre build() の後であること
+     *  @pre t は前回の呼び出しの t 以上
+     */
+    const Parabola&
+    find_lowest( double t )
+    {
+        while ( bounds_[cursor_ + 1] < t ) {
+            ++cursor_;
+        }
+
+        return parabolas_[hull_[cursor_]];
+    }
+
+
+  private:
+    /** @brief parabolas_ を頂点の位置の昇順に整列
+     *
+     *  挿入ソートを使う (ほぼ整列済みのとき線形時間)。
+     */
+    void
+    sort_parabolas()
+    {
+        for ( std::size_t i = 1; i < parabolas_.size(); ++i ) {
+            const auto p = parabolas_[i];
+
+            std::size_t j = i;
+
+            for ( ; j > 0 && p.pos < parabolas_[j - 1].pos; --j ) {
+                parabolas_[j] = parabolas_[j - 1];
+            }
+
+            parabolas_[j] = p;
+        }
+    }
+
+
+  private:
+    std::vector<Parabola> parabolas_;
+    std::vector<std::size_t>  hull_;    // 包絡線を構成する放物線 (parabolas_ のインデックス)
+    std::vector<double>     bounds_;    // hull_[k] が最小になる区間は [bounds_[k], bounds_[k + 1]]
+    std::size_t             cursor_ = 0;
+
+};
+
+
+} // namespace sdfield
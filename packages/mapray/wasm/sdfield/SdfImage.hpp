@@ -3,7 +3,7 @@
 #include "utility.hpp"  // for get_aligned
 #include "basic_types.hpp"  // for img_coord_elem_t, img_size_t, sdf_ext_t
 #include <memory>   // for unique_ptr
-#include <cstddef>  // for ptrdiff_t
+#include <cstddef>  // for size_t, ptrdiff_t
 
 
 namespace sdfield {
@@ -46,13 +46,39 @@ class SdfImage {
               sdf_ext_t          sdf_ext )
         : size_{ calc_size( cov_size, sdf_ext ) },
           pitch_{ get_aligned<4>( size_[0] ) },
-          data_{ new pixel_t[ pitch_ * size_[1] ] }
+          capacity_{ static_cast<std::size_t>( pitch_ * size_[1] ) },
+          data_{ new pixel_t[ capacity_ ] }
     {
         // std::vector と std::make_unique を使わない理由は CovImage
         // を参照
     }
 
 
+    /** @brief 画像サイズを変更
+     *
+     *  パラメータはコンストラクタと同じである。
+     *
+     *  画素列の領域は足りないときだけ確保し直す。画素値は初期化され
+     *  ない。
+     */
+    void
+    reset( const img_size_t& cov_size,
+           sdf_ext_t          sdf_ext )
+    {
+        const auto           size = calc_size( cov_size, sdf_ext );
+        const std::ptrdiff_t pitch = get_aligned<4>( size[0] );
+        const auto           bytes = static_cast<std::size_t>( pitch * size[1] );
+
+        if ( capacity_ < bytes ) {
+            data_.reset( new pixel_t[ bytes ] );
+            capacity_ = bytes;
+        }
+
+        size_  = size;
+        pitch_ = pitch;
+    }
+
+
     /** @brief 画像サイズ
      */
     img_size_t size() const { return size_; }
@@ -103,9 +129,10 @@ class SdfImage {
 
 
   private:
-    const img_size_t size_;
-    const std::ptrdiff_t pitch_;
-    const std::unique_ptr<pixel_t[]> data_;
+    img_size_t                 size_;
+    std::ptrdiff_t            pitch_;
+    std::size_t            capacity_;  // data_ のバイト数
+    std::unique_ptr<pixel_t[]> data_;
 
 };
 
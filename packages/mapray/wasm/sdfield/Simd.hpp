@@ -0,0 +1,300 @@
+﻿#pragma once
+
+#if defined( __wasm_simd128__ )
+#  include <wasm_simd128.h>
+#else
+#  include <array>
+#endif
+
+
+namespace sdfield {
+
+class f32x4;
+
+
+/** @brief f32x4 の要素ごとの比較結果
+ *
+ *  wasm SIMD128 (-msimd128) が有効なときは v128_t を使い、それ以外のときは
+ *  ビット集合で表現する。
+ *
+ *  b3dtile の同名のクラスから、sdfield で使う操作だけを抜き出したもので
+ *  ある。
+ */
+class m32x4 {
+
+    friend f32x4 select( const m32x4& m, const f32x4& a, const f32x4& b );
+
+  public:
+#if defined( __wasm_simd128__ )
+    explicit
+    m32x4( v128_t v )
+        : v_{ v } {}
+#else
+    explicit
+    m32x4( unsigned bits )
+        : bits_{ bits } {}
+#endif
+
+
+  private:
+#if defined( __wasm_simd128__ )
+    v128_t v_;
+#else
+    unsigned bits_;
+#endif
+
+};
+
+
+/** @brief 単精度浮動小数点数の 4 要素ベクトル
+ *
+ *  wasm SIMD128 (-msimd128) が有効なときは v128_t を使い、それ以外のときは
+ *  要素ごとに処理する。
+ */
+class f32x4 {
+
+  public:
+    /** @brief すべての要素を s で初期化
+     */
+    explicit
+    f32x4( float s )
+#if defined( __wasm_simd128__ )
+        : v_{ wasm_f32x4_splat( s ) } {}
+#else
+        : v_{ s, s, s, s } {}
+#endif
+
+
+    /** @brief p から連続する 4 要素を読み込む
+     *
+     *  p の整列は問わない。
+     */
+    static f32x4
+    load( const float* p )
+    {
+#if defined( __wasm_simd128__ )
+        return f32x4{ wasm_v128_load( p ) };
+#else
+        return f32x4{ p[0], p[1], p[2], p[3] };
+#endif
+    }
+
+
+    /** @brief p から連続する 4 要素に書き込む
+     *
+     *  p の整列は問わない。
+     */
+    void
+    store( float* p ) const
+    {
+#if defined( __wasm_simd128__ )
+        wasm_v128_store( p, v_ );
+#else
+        for ( int i = 0; i < 4; ++i ) {
+            p[i] = v_[i];
+        }
+#endif
+    }
+
+
+    friend f32x4
+    operator+( const f32x4& a,
+               const f32x4& b )
+    {
+#if defined( __wasm_simd128__ )
+        return f32x4{ wasm_f32x4_add( a.v_, b.v_ ) };
+#else
+        return f32x4{ a.v_[0] + b.v_[0], a.v_[1] + b.v_[1], a.v_[2] + b.v_[2], a.v_[3] + b.v_[3] };
+#endif
+    }
+
+
+    friend f32x4
+    operator*( const f32x4& a,
+               const f32x4& b )
+    {
+#if defined( __wasm_simd128__ )
+        return f32x4{ wasm_f32x4_mul( a.v_, b.v_ ) };
+#else
+        return f32x4{ a.v_[0] * b.v_[0], a.v_[1] * b.v_[1], a.v_[2] * b.v_[2], a.v_[3] * b.v_[3] };
+#endif
+    }
+
+
+    /** @brief 要素ごとの a < b
+     */
+    friend m32x4
+    operator<( const f32x4& a,
+               const f32x4& b )
+    {
+#if defined( __wasm_simd128__ )
+        return m32x4{ wasm_f32x4_lt( a.v_, b.v_ ) };
+#else
+        unsigned bits = 0;
+        for ( int i = 0; i < 4; ++i ) {
+            if ( a.v_[i] < b.v_[i] ) bits |= 1u << i;
+        }
+        return m32x4{ bits };
+#endif
+    }
+
+
+    /** @brief 要素ごとの選択
+     *
+     *  m の要素が真のときは a の要素、偽のときは b の要素を選ぶ。
+     */
+    friend f32x4
+    select( const m32x4& m,
+            const f32x4& a,
+            const f32x4& b )
+    {
+#if defined( __wasm_simd128__ )
+        return f32x4{ wasm_v128_bitselect( a.v_, b.v_, m.v_ ) };
+#else
+        return f32x4{ (m.bits_ & 0b0001u) ? a.v_[0] : b.v_[0],
+                      (m.bits_ & 0b0010u) ? a.v_[1] : b.v_[1],
+                      (m.bits_ & 0b0100u) ? a.v_[2] : b.v_[2],
+                      (m.bits_ & 0b1000u) ? a.v_[3] : b.v_[3] };
+#endif
+    }
+
+
+  private:
+#if defined( __wasm_simd128__ )
+    explicit
+    f32x4( v128_t v )
+        : v_{ v } {}
+#else
+    f32x4( float e0,
+           float e1,
+           float e2,
+           float e3 )
+        : v_{ e0, e1, e2, e3 } {}
+#endif
+
+
+  private:
+#if defined( __wasm_simd128__ )
+    v128_t v_;
+#else
+    std::array<float, 4> v_;
+#endif
+
+};
+
+
+/** @brief 符号なし 8 ビット整数の 16 要素ベクトル
+ *
+ *  wasm SIMD128 (-msimd128) が有効なときは v128_t を使い、それ以外のときは
+ *  要素ごとに処理する。
+ */
+class u8x16 {
+
+  public:
+    /** @brief p から連続する 16 要素を読み込む
+     *
+     *  p の整列は問わない。
+     */
+    static u8x16
+    load( const unsigned char* p )
+    {
+#if defined( __wasm_simd128__ )
+        return u8x16{ wasm_v128_load( p ) };
+#else
+        u8x16 r;
+        for ( int i = 0; i < 16; ++i ) {
+            r.v_[i] = p[i];
+        }
+        return r;
+#endif
+    }
+
+
+    /** @brief 要素ごとの最小値
+     */
+    friend u8x16
+    min( const u8x16& a,
+         const u8x16& b )
+    {
+#if defined( __wasm_simd128__ )
+        return u8x16{ wasm_u8x16_min( a.v_, b.v_ ) };
+#else
+        u8x16 r;
+        for ( int i = 0; i < 16; ++i ) {
+            r.v_[i] = (b.v_[i] < a.v_[i]) ? b.v_[i] : a.v_[i];
+        }
+        return r;
+#endif
+    }
+
+
+    /** @brief 要素ごとの最大値
+     */
+    friend u8x16
+    max( const u8x16& a,
+         const u8x16& b )
+    {
+#if defined( __wasm_simd128__ )
+        return u8x16{ wasm_u8x16_max( a.v_, b.v_ ) };
+#else
+        u8x16 r;
+        for ( int i = 0; i < 16; ++i ) {
+            r.v_[i] = (a.v_[i] < b.v_[i]) ? b.v_[i] : a.v_[i];
+        }
+        return r;
+#endif
+    }
+
+
+    /** @brief すべての要素が s 以上か?
+     */
+    bool
+    all_ge( unsigned char s ) const
+    {
+#if defined( __wasm_simd128__ )
+        return wasm_i8x16_all_true( wasm_u8x16_ge( v_, wasm_u8x16_splat( s ) ) );
+#else
+        for ( int i = 0; i < 16; ++i ) {
+            if ( v_[i] < s ) return false;
+        }
+        return true;
+#endif
+    }
+
+
+    /** @brief すべての要素が s 以下か?
+     */
+    bool
+    all_le( unsigned char s ) const
+    {
+#if defined( __wasm_simd128__ )
+        return wasm_i8x16_all_true( wasm_u8x16_le( v_, wasm_u8x16_splat( s ) ) );
+#else
+        for ( int i = 0; i < 16; ++i ) {
+            if ( v_[i] > s ) return false;
+        }
+        return true;
+#endif
+    }
+
+
+  private:
+#if defined( __wasm_simd128__ )
+    explicit
+    u8x16( v128_t v )
+        : v_{ v } {}
+#else
+    u8x16() = default;
+#endif
+
+
+  private:
+#if defined( __wasm_simd128__ )
+    v128_t v_;
+#else
+    std::array<unsigned char, 16> v_;
+#endif
+
+};
+
+} // namespace sdfield
@@ -7,15 +7,21 @@
  */
 
 #include "Converter.hpp"
+#include "BatchConverter.hpp"
 #include "basic_types.hpp"
+#include "config.hpp"  // for MAX_SDF_WIDTH, MAX_SDF_HEIGHT
 #include "wasm_types.hpp"
 #include <emscripten/emscripten.h>  // for EMSCRIPTEN_KEEPALIVE
 #include <cassert>
 
 using sdfield::Converter;
+using sdfield::BatchConverter;
 using sdfield::CovImage;
 using sdfield::SdfImage;
+using sdfield::DistanceEngine;
 using sdfield::cast;
+using sdfield::MAX_SDF_WIDTH;
+using sdfield::MAX_SDF_HEIGHT;
 
 
 /** @brief Converter インスタンスを生成
@@ -40,14 +46,58 @@ converter_create( wasm_i32_t width,
                   wasm_i32_t sdf_ext )
 {
     assert( width >= 1 && height >= 1 && sdf_ext >= 0 );
-    assert( width  + 2 * sdf_ext <= MAX_SDF_WIDTH );
-    assert( height + 2 * sdf_ext <= MAX_SDF_HEIGHT );
+    assert( static_cast<unsigned int>( width  + 2 * sdf_ext ) <= MAX_SDF_WIDTH );
+    assert( static_cast<unsigned int>( height + 2 * sdf_ext ) <= MAX_SDF_HEIGHT );
 
     return new Converter( { cast, width, height },
                           static_cast<Converter::sdf_ext_t>( sdf_ext ) );
 }
 
 
+/** @brief Converter インスタンスを再初期化
+ *
+ *  conv を converter_create( width, height, sdf_ext ) で生成したインス
+ *  タンスと同じ状態にする。ただし、内部の領域は足りないときだけ確保し
+ *  直す。
+ *
+ *  パラメータと事前条件は converter_create() と同じである。
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+void
+converter_reset( Converter* conv,
+                 wasm_i32_t width,
+                 wasm_i32_t height,
+                 wasm_i32_t sdf_ext )
+{
+    assert( conv );
+    assert( width >= 1 && height >= 1 && sdf_ext >= 0 );
+    assert( static_cast<unsigned int>( width  + 2 * sdf_ext ) <= MAX_SDF_WIDTH );
+    assert( static_cast<unsigned int>( height + 2 * sdf_ext ) <= MAX_SDF_HEIGHT );
+
+    conv->reset( { cast, width, height },
+                 static_cast<Converter::sdf_ext_t>( sdf_ext ) );
+}
+
+
+/** @brief 距離変換の手法を設定
+ *
+ *  以降の converter_build_sdf() に適用される。
+ *
+ *  @param engine  sdfield::DistanceEngine の値 (既定値は SSEDT8)
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+void
+converter_set_engine( Converter* conv,
+                      wasm_i32_t engine )
+{
+    assert( conv );
+    assert( engine == static_cast<wasm_i32_t>( DistanceEngine::SSEDT8 ) ||
+            engine == static_cast<wasm_i32_t>( DistanceEngine::SEPARABLE ) );
+
+    conv->set_engine( static_cast<DistanceEngine>( engine ) );
+}
+
+
 /** @brief Converter インスタンスを破棄
  */
 extern "C" EMSCRIPTEN_KEEPALIVE
@@ -81,3 +131,104 @@ converter_build_sdf( Converter* conv )
     assert( conv );
     return conv->build_sdf();
 }
+
+
+/** @brief BatchConverter インスタンスを生成
+ *
+ *  複数の画像を 1 回の呼び出しで変換するためのインスタンスである。使
+ *  い方は BatchConverter を参照のこと。
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+BatchConverter*
+batch_converter_create()
+{
+    return new BatchConverter();
+}
+
+
+/** @brief BatchConverter インスタンスを破棄
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+void
+batch_converter_destroy( const BatchConverter* conv )
+{
+    assert( conv );
+    delete conv;
+}
+
+
+/** @brief 画像数と入力領域のバイト数を設定
+ *
+ *  画像表と入力領域を確保する。以前の画像表、入力領域、出力領域は無効
+ *  になる。
+ *
+ *  @param num_images  画像数
+ *  @param cov_bytes   すべての被覆率画像を書き込む入力領域のバイト数
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+void
+batch_converter_reserve( BatchConverter* conv,
+                         wasm_i32_t num_images,
+                         wasm_i32_t  cov_bytes )
+{
+    assert( conv );
+    assert( num_images >= 0 && cov_bytes >= 0 );
+
+    conv->reserve( static_cast<std::size_t>( num_images ),
+                   static_cast<std::size_t>( cov_bytes ) );
+}
+
+
+/** @brief 距離変換の手法を設定
+ *
+ *  converter_set_engine() と同じである。
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+void
+batch_converter_set_engine( BatchConverter* conv,
+                            wasm_i32_t    engine )
+{
+    assert( conv );
+    assert( engine == static_cast<wasm_i32_t>( DistanceEngine::SSEDT8 ) ||
+            engine == static_cast<wasm_i32_t>( DistanceEngine::SEPARABLE ) );
+
+    conv->set_engine( static_cast<DistanceEngine>( engine ) );
+}
+
+
+/** @brief 画像表の位置を取得
+ *
+ *  形式は BatchConverter::TABLE_NUM_ELEMS を参照のこと。
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+wasm_i32_t*
+batch_converter_get_table( BatchConverter* conv )
+{
+    assert( conv );
+    return conv->get_table();
+}
+
+
+/** @brief 被覆率画像の入力領域の位置を取得
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+CovImage::pixel_t*
+batch_converter_get_write_position( BatchConverter* conv )
+{
+    assert( conv );
+    return conv->get_write_position();
+}
+
+
+/** @brief すべての画像を SDF 画像に変換して出力領域の位置を取得
+ *
+ *  各 SDF 画像の出力領域の中の位置は画像表に書き込まれる。各画像の形
+ *  式は converter_build_sdf() と同じである。
+ */
+extern "C" EMSCRIPTEN_KEEPALIVE
+const SdfImage::pixel_t*
+batch_converter_build_sdf( BatchConverter* conv )
+{
+    assert( conv );
+    return conv->build_sdf();
+}
@@ -1,13 +1,22 @@
 ﻿#include "../b3dtile/Tile.hpp"
+#include "../b3dtile/Tile/ClipJob.hpp"
 #include "../b3dtile/Rect.hpp"
 #include "../b3dtile/HashMap.hpp"
 #include "../b3dtile/HashSet.hpp"
+#include "../b3dtile/DenseMap.hpp"
+#if B3DTILE_USE_THREADS
+#  include "../b3dtile/Tile/Clipper.hpp"
+#  include "../b3dtile/WorkerPool.hpp"
+#endif
 #include <boost/test/unit_test.hpp>
 #include <filesystem>
 #include <fstream>
 #include <algorithm>
 #include <vector>
+#include <array>
 #include <memory>
+#include <random>
+#include <limits>
 
 namespace utf = boost::unit_test;
 namespace  fs = std::filesystem;
@@ -22,6 +31,9 @@ struct Env {
         Tile::setup_javascript_functions( &binary_copy,
                                           &clip_result,
                                           &ray_result );
+
+        // 前のテストが途中で終了しても、既定の形式から始める
+        Tile::set_clip_vertex_format( Tile::ClipVertexFormat::SEPARATE );
     }
 
 
@@ -35,23 +47,65 @@ struct Env {
     }
 
 
+    /** @brief clip_result() で受け取った三角形の位置
+     *
+     *  各三角形の 3 頂点の位置座標を並べたもので、頂点の順序には依存しないよ
+     *  うに整列されている。
+     */
+    using clip_mesh_t = std::vector<std::array<uint16_t, 3 * Tile::DIM>>;
+
+
     static void
-    clip_result( wasm_i32_t /*num_vertices*/,
-                 wasm_i32_t /*num_triangles*/,
-                 const void*         /*data*/ )
-    {}
+    clip_result( wasm_i32_t  num_vertices,
+                 wasm_i32_t num_triangles,
+                 const void*         data )
+    {
+        const auto positions = static_cast<const uint16_t*>( data );
+        const auto    offset = (3 * sizeof( uint16_t ) * num_vertices + 3) / 4 * 4;
+        const auto     tdata = static_cast<const Tile::byte_t*>( data ) + offset;
+
+        clip_mesh_t mesh;
+
+        for ( wasm_i32_t ti = 0; ti < num_triangles; ++ti ) {
+            std::array<uint16_t, 3 * Tile::DIM> triangle;
+
+            for ( size_t ci = 0; ci < 3; ++ci ) {
+                const size_t vi = (num_vertices > 65536) ?
+                                  reinterpret_cast<const uint32_t*>( tdata )[3 * ti + ci] :
+                                  reinterpret_cast<const uint16_t*>( tdata )[3 * ti + ci];
+
+                std::copy( positions + Tile::DIM * vi,
+                           positions + Tile::DIM * (vi + 1),
+                           triangle.begin() + Tile::DIM * ci );
+            }
+
+            mesh.push_back( triangle );
+        }
+
+        std::sort( mesh.begin(), mesh.end() );
+
+        clip_meshes.push_back( mesh );
+        last_clip_data = data;
+    }
 
 
     static void
-    ray_result( wasm_f64_t /*distance*/,
-                wasm_f64_t     /*id_0*/,
-                wasm_f64_t     /*id_1*/ )
-    {}
+    ray_result( wasm_f64_t distance,
+                wasm_f64_t     id_0,
+                wasm_f64_t     id_1 )
+    {
+        last_ray_result = { distance, id_0, id_1 };
+    }
 
 
     static inline const void* src_begin;
     static inline std::size_t src_size;
 
+    static inline std::array<wasm_f64_t, Tile::RAY_RESULT_NUM_ELEMS> last_ray_result;
+
+    static inline std::vector<clip_mesh_t> clip_meshes;
+    static inline const void*           last_clip_data;
+
 };
 
 
@@ -74,6 +128,58 @@ create_tile( const fs::path& path )
 }
 
 
+/** @brief create_tile() と同じだが、データは後から書き込む
+ */
+std::unique_ptr<Tile>
+create_tile_deferred( const fs::path& path )
+{
+    if ( !fs::exists( path ) ) {
+        throw std::runtime_error( "file cannot be found: " + path.string() );
+    }
+
+    std::ifstream ifs{ path, std::ios_base::binary };
+
+    const auto size = fs::file_size( path );
+
+    auto tile = std::make_unique<Tile>( size, Tile::deferred_copy_t{} );
+
+    // タイルの領域に直接読み込む
+    ifs.read( reinterpret_cast<char*>( tile->get_write_position() ), size );
+
+    tile->commit();
+
+    return tile;
+}
+
+
+/** @brief テスト用のレイ配列を生成
+ *
+ *  上方からタイル内の点に向かうレイを num_rays 本生成する。形式は
+ *  Tile::find_ray_distance_many() の rays と同じで、制限直方体はタイル全体で
+ *  ある。
+ */
+std::vector<wasm_f64_t>
+create_test_rays( size_t num_rays )
+{
+    std::mt19937 engine{ 1 };
+    std::uniform_real_distribution<double> dist{ 0, 1 };
+
+    std::vector<wasm_f64_t> rays;
+
+    for ( size_t i = 0; i < num_rays; ++i ) {
+        const double target[] = { dist( engine ), dist( engine ), dist( engine ) };
+        const double    dir[] = { dist( engine ) - 0.5, dist( engine ) - 0.5, -1 };
+
+        rays.insert( rays.end(), { target[0] - dir[0], target[1] - dir[1], target[2] - dir[2],
+                                   dir[0], dir[1], dir[2],
+                                   100,
+                                   0, 0, 0, 1 } );
+    }
+
+    return rays;
+}
+
+
 BOOST_FIXTURE_TEST_SUITE( b3dtile_suite, Env )
 
 
@@ -83,6 +189,24 @@ BOOST_AUTO_TEST_CASE( tile_constructor )
 }
 
 
+BOOST_AUTO_TEST_CASE( tile_deferred_copy )
+{
+    const auto tile0 = create_tile( "tile.bin" );
+    const auto tile1 = create_tile_deferred( "tile.bin" );
+
+    const auto rect = Rect<float, Tile::DIM>::create_cube( { 0, 0, 0 }, 1 );
+
+    tile0->find_ray_distance( { 0.5, 0.5, 2 }, { 0.1, 0.2, -1 }, 100, rect );
+    const auto result0 = last_ray_result;
+
+    tile1->find_ray_distance( { 0.5, 0.5, 2 }, { 0.1, 0.2, -1 }, 100, rect );
+    const auto result1 = last_ray_result;
+
+    BOOST_CHECK( result0 == result1 );
+    BOOST_CHECK_NO_THROW( tile1->clip( 0, 0, 0, 0.5f ) );
+}
+
+
 BOOST_AUTO_TEST_CASE( tile_clip_full )
 {
     const auto tile = create_tile( "tile.bin" );
@@ -108,6 +232,494 @@ BOOST_AUTO_TEST_CASE( tile_clip_part )
 }
 
 
+/** @brief 呼び出し側の領域へのクリップ
+ *
+ *  clip_prepare() と clip_write() の結果が、clip() の結果と一致し、指定した
+ *  領域に書き込まれるかを確認する。
+ */
+BOOST_AUTO_TEST_CASE( tile_clip_write )
+{
+    const auto tile = create_tile( "tile.bin" );
+
+    // { x, y, z, size }
+    const std::array<float, 4> rects[] = {
+        { 0,     0,    0,     1      },  // タイル全体
+        { 0,     0,    0,     0.5f   },
+        { 0.5f,  0.5f, 0.5f,  0.5f   },
+        { 0.25f, 0.5f, 0,     0.25f  },
+        { 0.75f, 0.5f, 0.25f, 0.125f },
+    };
+
+    for ( const auto& rect : rects ) {
+        clip_meshes.clear();
+        tile->clip( rect[0], rect[1], rect[2], rect[3] );
+
+        const size_t bytes = tile->clip_prepare( rect[0], rect[1], rect[2], rect[3] );
+
+        // 4 バイト境界に揃えた領域
+        std::vector<uint32_t> buffer( (bytes + 3) / 4 );
+        tile->clip_write( buffer.data() );
+
+        BOOST_REQUIRE( clip_meshes.size() == 2 );
+        BOOST_CHECK( clip_meshes[0] == clip_meshes[1] );
+        BOOST_CHECK( last_clip_data == buffer.data() );
+    }
+}
+
+
+/** @brief 頂点属性をまとめたクリップ結果
+ *
+ *  ClipVertexFormat::INTERLEAVED の結果が、ClipVertexFormat::SEPARATE の結果
+ *  と同じ三角形 (頂点属性) を持ち、頂点内の詰め物が 0 であるかを確認する。
+ */
+BOOST_AUTO_TEST_CASE( tile_clip_interleaved )
+{
+    const auto tile = create_tile( "tile.bin" );
+
+    // clip_result() に渡された { num_vertices, num_triangles }
+    static std::array<size_t, 2> counts;
+
+    Tile::setup_javascript_functions( &binary_copy,
+                                      []( wasm_i32_t nv, wasm_i32_t nt, const void* ) {
+                                          counts = { static_cast<size_t>( nv ), static_cast<size_t>( nt ) };
+                                      },
+                                      &ray_result );
+
+    const auto clip_to_buffer = [&tile]( const std::array<float, 4>& rect,
+                                         Tile::ClipVertexFormat    format ) {
+        Tile::set_clip_vertex_format( format );
+
+        const size_t bytes = tile->clip_prepare( rect[0], rect[1], rect[2], rect[3] );
+
+        std::vector<uint32_t> buffer( (bytes + 3) / 4 );
+        tile->clip_write( buffer.data() );
+
+        const auto data = reinterpret_cast<const Tile::byte_t*>( buffer.data() );
+        return std::vector<Tile::byte_t>( data, data + bytes );
+    };
+
+    const auto aligned = []( size_t bytes ) { return (bytes + 3) / 4 * 4; };
+
+    // 各三角形の 3 頂点の { POSITIONS, N_ARRAY, TC_ARRAY } を並べたもの (整列済み)
+    using vertex_t   = std::array<Tile::byte_t, 6 + 3 + 4>;
+    using triangle_t = std::array<vertex_t, 3>;
+
+    // vertices[k] から vertex_t の各属性の位置までのバイト数が offsets[k] の頂点
+    const auto get_triangles = []( const std::vector<Tile::byte_t>& buffer,
+                                   size_t                            nv,
+                                   size_t                            nt,
+                                   size_t                      tri_offset,
+                                   const std::array<size_t, 3>&  vertices,
+                                   const std::array<size_t, 3>&   strides ) {
+        constexpr size_t sizes[] = { 6, 3, 4 };
+
+        std::vector<triangle_t> triangles;
+
+        for ( size_t ti = 0; ti < nt; ++ti ) {
+            triangle_t triangle{};
+
+            for ( size_t ci = 0; ci < 3; ++ci ) {
+                const auto index = buffer.data() + tri_offset;
+                const size_t  vi = (nv > 65536) ?
+                                   reinterpret_cast<const uint32_t*>( index )[3 * ti + ci] :
+                                   reinterpret_cast<const uint16_t*>( index )[3 * ti + ci];
+
+                for ( size_t ai = 0, pos = 0; ai < 3; pos += sizes[ai++] ) {
+                    if ( strides[ai] != 0 ) {
+                        const auto src = buffer.begin() + vertices[ai] + strides[ai] * vi;
+                        std::copy( src, src + sizes[ai], triangle[ci].begin() + pos );
+                    }
+                }
+            }
+
+            triangles.push_back( triangle );
+        }
+
+        std::sort( triangles.begin(), triangles.end() );
+
+        return triangles;
+    };
+
+    // { x, y, z, size }
+    const std::array<float, 4> rects[] = {
+        { 0,     0,     0,    1     },  // タイル全体
+        { 0,     0,     0,    0.5f  },
+        { 0.5f,  0.5f,  0.5f, 0.5f  },
+        { 0.25f, 0.25f, 0.5f, 0.25f },
+    };
+
+    for ( const auto& rect : rects ) {
+        const auto separate = clip_to_buffer( rect, Tile::ClipVertexFormat::SEPARATE );
+        const auto sep_counts = counts;
+
+        const auto interleaved = clip_to_buffer( rect, Tile::ClipVertexFormat::INTERLEAVED );
+        const auto ilv_counts = counts;
+
+        BOOST_REQUIRE( sep_counts[1] > 0 && ilv_counts[1] == sep_counts[1] );
+
+        // SEPARATE の配置
+        const size_t sep_nv = sep_counts[0];
+        const size_t sep_nt = sep_counts[1];
+        const size_t sep_tb = 3 * sep_nt * ((sep_nv > 65536) ? 4 : 2);
+
+        const size_t sep_tris = aligned( 6 * sep_nv );
+        const size_t sep_rest = sep_tris + aligned( sep_tb );
+        const size_t   extras = separate.size() - sep_rest;
+
+        const bool  has_n_array = extras == aligned( 3 * sep_nv ) || extras == aligned( 3 * sep_nv ) + aligned( 4 * sep_nv );
+        const bool has_tc_array = extras == aligned( 4 * sep_nv ) || extras == aligned( 3 * sep_nv ) + aligned( 4 * sep_nv );
+
+        const size_t sep_tc_array = sep_rest + (has_n_array ? aligned( 3 * sep_nv ) : 0);
+
+        // INTERLEAVED の配置
+        const size_t ilv_nv = ilv_counts[0];
+        const size_t ilv_tb = 3 * sep_nt * ((ilv_nv > 65536) ? 4 : 2);
+        const size_t stride = 8 + (has_n_array ? 4 : 0) + (has_tc_array ? 4 : 0);
+
+        BOOST_REQUIRE( interleaved.size() == stride * ilv_nv + aligned( ilv_tb ) );
+
+        const auto sep_triangles = get_triangles( separate, sep_nv, sep_nt, sep_tris,
+                                                  { 0, sep_rest, sep_tc_array },
+                                                  { 6, has_n_array ? 3u : 0u, has_tc_array ? 4u : 0u } );
+
+        const auto ilv_triangles = get_triangles( interleaved, ilv_nv, sep_nt, stride * ilv_nv,
+                                                  { 0, 8, has_n_array ? 12u : 8u },
+                                                  { stride, has_n_array ? stride : 0, has_tc_array ? stride : 0 } );
+
+        BOOST_CHECK( sep_triangles == ilv_triangles );
+
+        // 頂点内の詰め物
+        for ( size_t vi = 0; vi < ilv_nv; ++vi ) {
+            const auto vertex = interleaved.begin() + stride * vi;
+
+            BOOST_CHECK( vertex[6] == 0 && vertex[7] == 0 );
+            BOOST_CHECK( !has_n_array || vertex[11] == 0 );
+        }
+    }
+}
+
+
+/** @brief タイル全体の頂点属性をまとめたクリップ結果
+ *
+ *  タイル全体を包含する直方体での ClipVertexFormat::INTERLEAVED の結果が、
+ *  clip(), clip_prepare() と clip_write(), ClipJob のいずれでも、
+ *  ClipVertexFormat::SEPARATE の結果 (タイルデータ) の頂点と三角形を同じ順序
+ *  でまとめたものになるかを確認する。
+ */
+BOOST_AUTO_TEST_CASE( tile_clip_interleaved_full )
+{
+    const auto tile = create_tile( "tile.bin" );
+
+    // clip_result() に渡された { num_vertices, num_triangles } とデータの複製
+    static std::array<size_t, 2>    counts;
+    static size_t              copy_bytes;
+    static std::vector<Tile::byte_t> data;
+
+    Tile::setup_javascript_functions( &binary_copy,
+                                      []( wasm_i32_t nv, wasm_i32_t nt, const void* src ) {
+                                          const auto bytes = static_cast<const Tile::byte_t*>( src );
+                                          counts = { static_cast<size_t>( nv ), static_cast<size_t>( nt ) };
+                                          data.assign( bytes, bytes + copy_bytes );
+                                      },
+                                      &ray_result );
+
+    const auto aligned = []( size_t bytes ) { return (bytes + 3) / 4 * 4; };
+
+    // SEPARATE の結果
+    Tile::set_clip_vertex_format( Tile::ClipVertexFormat::SEPARATE );
+
+    copy_bytes = tile->clip_prepare( 0, 0, 0, 1 );
+    std::vector<uint32_t> sep_buffer( (copy_bytes + 3) / 4 );
+    tile->clip_write( sep_buffer.data() );
+
+    const auto separate = data;
+    const size_t     nv = counts[0];
+    const size_t     nt = counts[1];
+    const size_t  vsize = (nv > 65536) ? 4 : 2;
+
+    // SEPARATE の配置
+    const size_t sep_tris = aligned( 6 * nv );
+    const size_t sep_rest = sep_tris + aligned( 3 * vsize * nt );
+    const size_t   extras = separate.size() - sep_rest;
+
+    const bool  has_n_array = extras == aligned( 3 * nv ) || extras == aligned( 3 * nv ) + aligned( 4 * nv );
+    const bool has_tc_array = extras == aligned( 4 * nv ) || extras == aligned( 3 * nv ) + aligned( 4 * nv );
+
+    const size_t sep_tc_array = sep_rest + (has_n_array ? aligned( 3 * nv ) : 0);
+
+    // INTERLEAVED の配置
+    const size_t    stride = 8 + (has_n_array ? 4 : 0) + (has_tc_array ? 4 : 0);
+    const size_t ilv_tris  = stride * nv;
+    const size_t ilv_bytes = ilv_tris + aligned( 3 * vsize * nt );
+
+    // SEPARATE から期待する INTERLEAVED の結果を作成
+    std::vector<Tile::byte_t> expected( ilv_bytes, 0 );
+
+    for ( size_t vi = 0; vi < nv; ++vi ) {
+        const auto dst = expected.begin() + stride * vi;
+
+        std::copy_n( separate.begin() + 6 * vi, 6, dst );
+
+        if ( has_n_array ) {
+            std::copy_n( separate.begin() + sep_rest + 3 * vi, 3, dst + 8 );
+        }
+
+        if ( has_tc_array ) {
+            std::copy_n( separate.begin() + sep_tc_array + 4 * vi, 4, dst + (has_n_array ? 12 : 8) );
+        }
+    }
+
+    std::copy_n( separate.begin() + sep_tris, 3 * vsize * nt, expected.begin() + ilv_tris );
+
+    // INTERLEAVED の結果
+    Tile::set_clip_vertex_format( Tile::ClipVertexFormat::INTERLEAVED );
+
+    BOOST_REQUIRE( tile->clip_prepare( 0, 0, 0, 1 ) == ilv_bytes );
+
+    copy_bytes = ilv_bytes;
+
+    // 詰め物が 0 になることを確認するため、出力先を 0 以外で埋めておく
+    std::vector<uint32_t> ilv_buffer( ilv_bytes / 4, 0xFFFFFFFF );
+    tile->clip_write( ilv_buffer.data() );
+
+    BOOST_CHECK( counts[0] == nv && counts[1] == nt );
+    BOOST_CHECK( data == expected );
+
+    data.clear();
+    tile->clip( 0, 0, 0, 1 );
+
+    BOOST_CHECK( counts[0] == nv && counts[1] == nt );
+    BOOST_CHECK( data == expected );
+
+    data.clear();
+    Tile::ClipJob job{ *tile, 0, 0, 0, 1 };
+    BOOST_CHECK( job.step( 1 ) );
+    job.finish();
+
+    BOOST_CHECK( counts[0] == nv && counts[1] == nt );
+    BOOST_CHECK( data == expected );
+}
+
+
+/** @brief 再開可能なクリップ
+ *
+ *  ClipJob を様々な三角形数で進めた結果が、clip() の結果と一致するかを確認
+ *  する。
+ */
+BOOST_AUTO_TEST_CASE( tile_clip_job )
+{
+    const auto tile = create_tile( "tile.bin" );
+
+    // { x, y, z, size }
+    const std::array<float, 4> rects[] = {
+        { 0,     0,    0,     1      },  // タイル全体
+        { 0,     0,    0,     0.5f   },
+        { 0.5f,  0.5f, 0.5f,  0.5f   },
+        { 0.75f, 0.5f, 0.25f, 0.125f },
+    };
+
+    // 0 は step() を呼び出さずに finish() する
+    const size_t step_sizes[] = { 0, 1, 7, 1000 };
+
+    for ( const auto& rect : rects ) {
+        clip_meshes.clear();
+        tile->clip( rect[0], rect[1], rect[2], rect[3] );
+
+        BOOST_REQUIRE( clip_meshes.size() == 1 );
+        const auto expected = clip_meshes[0];
+
+        for ( const auto step_size : step_sizes ) {
+            clip_meshes.clear();
+
+            Tile::ClipJob job{ *tile, rect[0], rect[1], rect[2], rect[3] };
+
+            if ( step_size > 0 ) {
+                while ( !job.step( step_size ) ) {
+                    BOOST_REQUIRE( clip_meshes.empty() );
+                }
+            }
+
+            job.finish();
+
+            BOOST_REQUIRE( clip_meshes.size() == 1 );
+            BOOST_CHECK( clip_meshes[0] == expected );
+        }
+    }
+}
+
+
+/** @brief 他のクリップと交互に進める再開可能なクリップ
+ *
+ *  ClipJob の step() の間に clip() や他の ClipJob の処理を行っても、それぞれ
+ *  の結果が clip() の結果と一致するかを確認する。
+ *
+ *  step() の三角形数はタイルの三角形数から決めるので、step() と間の clip()
+ *  の回数はタイルの大きさによらずほぼ一定になる。
+ */
+BOOST_AUTO_TEST_CASE( tile_clip_job_interleaved )
+{
+    const auto tile = create_tile( "tile.bin" );
+
+    // { x, y, z, size }
+    const std::array<float, 4> rect_a = { 0,     0,     0,     0.5f  };
+    const std::array<float, 4> rect_b = { 0.5f,  0,     0.25f, 0.5f  };
+    const std::array<float, 4> rect_c = { 0.25f, 0.25f, 0.25f, 0.25f };
+
+    clip_meshes.clear();
+    tile->clip( 0, 0, 0, 1 );
+    tile->clip( rect_a[0], rect_a[1], rect_a[2], rect_a[3] );
+    tile->clip( rect_b[0], rect_b[1], rect_b[2], rect_b[3] );
+    tile->clip( rect_c[0], rect_c[1], rect_c[2], rect_c[3] );
+
+    BOOST_REQUIRE( clip_meshes.size() == 4 );
+    const auto expected = clip_meshes;
+
+    // 1 回の step() の三角形数 (2 つのジョブの区切りがずれるようにする)
+    const size_t num_triangles = expected[0].size();
+    const size_t step_a = std::max<size_t>( num_triangles / 8, 1 );
+    const size_t step_b = std::max<size_t>( num_triangles / 5, 1 ) + 1;
+
+    Tile::ClipJob job_a{ *tile, rect_a[0], rect_a[1], rect_a[2], rect_a[3] };
+    Tile::ClipJob job_b{ *tile, rect_b[0], rect_b[1], rect_b[2], rect_b[3] };
+
+    bool done_a = false;
+    bool done_b = false;
+
+    clip_meshes.clear();
+
+    while ( !done_a || !done_b ) {
+        if ( !done_a ) {
+            done_a = job_a.step( step_a );
+        }
+
+        // 途中で他のクリップを行う (結果は最後にまとめて確認する)
+        tile->clip( rect_c[0], rect_c[1], rect_c[2], rect_c[3] );
+
+        if ( !done_b ) {
+            done_b = job_b.step( step_b );
+        }
+    }
+
+    const auto interleaved = clip_meshes;
+
+    clip_meshes.clear();
+    job_a.finish();
+    job_b.finish();
+
+    BOOST_REQUIRE( clip_meshes.size() == 2 );
+    BOOST_CHECK( clip_meshes[0] == expected[1] );
+    BOOST_CHECK( clip_meshes[1] == expected[2] );
+
+    BOOST_REQUIRE( !interleaved.empty() );
+    BOOST_CHECK( std::all_of( interleaved.begin(), interleaved.end(),
+                              [&]( const auto& mesh ) { return mesh == expected[3]; } ) );
+}
+
+
+/** @brief 8 分割のクリップ
+ *
+ *  clip_octants() の各結果が、子の立方体で clip() を実行した結果と一致する
+ *  かを確認する。
+ */
+BOOST_AUTO_TEST_CASE( tile_clip_octants )
+{
+    const auto tile = create_tile( "tile.bin" );
+
+    // { x, y, z, size }
+    const std::array<float, 4> parents[] = {
+        { 0,    0,    0,    1    },
+        { 0.5f, 0,    0.5f, 0.5f },
+        { 0.25f, 0.5f, 0,   0.25f },
+        { 0,    0,    0,    2    },  // タイル全体を含む子がある
+    };
+
+    for ( const auto& parent : parents ) {
+        clip_meshes.clear();
+        tile->clip_octants( parent[0], parent[1], parent[2], parent[3] );
+
+        BOOST_REQUIRE( clip_meshes.size() == 8 );
+
+        const auto octant_meshes = clip_meshes;
+        const float         half = parent[3] / 2;
+
+        for ( size_t oi = 0; oi < 8; ++oi ) {
+            clip_meshes.clear();
+            tile->clip( parent[0] + half * ((oi >> 0) & 1),
+                        parent[1] + half * ((oi >> 1) & 1),
+                        parent[2] + half * ((oi >> 2) & 1),
+                        half );
+
+            BOOST_REQUIRE( clip_meshes.size() == 1 );
+            BOOST_CHECK( clip_meshes[0] == octant_meshes[oi] );
+        }
+    }
+}
+
+
+#if B3DTILE_USE_THREADS
+/** @brief 並列のクリップ
+ *
+ *  並列処理を行ったクリップ結果が、逐次処理の結果とバイト単位で一致するかを
+ *  確認する。
+ */
+BOOST_AUTO_TEST_CASE( tile_clip_parallel )
+{
+    const auto tile = create_tile( "tile.bin" );
+
+    const auto clip_to_buffer = [&tile]( const std::array<float, 4>& rect ) {
+        const size_t bytes = tile->clip_prepare( rect[0], rect[1], rect[2], rect[3] );
+
+        std::vector<uint32_t> buffer( (bytes + 3) / 4 );
+        tile->clip_write( buffer.data() );
+
+        return buffer;
+    };
+
+    // { x, y, z, size }
+    const std::array<float, 4> rects[] = {
+        { 0,     0,    0,     0.5f   },
+        { 0.5f,  0.5f, 0.5f,  0.5f   },
+        { 0.25f, 0.5f, 0,     0.25f  },
+        { -0.5f, 0.1f, -0.3f, 1      },
+    };
+
+    const size_t saved_min_triangles = Tile::Clipper::parallel_min_triangles;
+
+    for ( const auto& rect : rects ) {
+        Tile::Clipper::parallel_min_triangles = std::numeric_limits<size_t>::max();
+        const auto serial = clip_to_buffer( rect );
+
+        Tile::Clipper::parallel_min_triangles = 0;
+        const auto parallel = clip_to_buffer( rect );
+
+        BOOST_CHECK( serial == parallel );
+    }
+
+    Tile::Clipper::parallel_min_triangles = saved_min_triangles;
+}
+
+
+/** @brief WorkerPool によるタスクの実行
+ *
+ *  すべてのタスクが 1 回ずつ実行されるかを確認する。
+ */
+BOOST_AUTO_TEST_CASE( worker_pool )
+{
+    auto& pool = b3dtile::WorkerPool::instance();
+
+    BOOST_CHECK( pool.num_threads() >= 1 );
+
+    for ( size_t num_tasks : { 0, 1, 3, 100 } ) {
+        std::vector<int> counts( num_tasks, 0 );
+
+        pool.run( num_tasks, [&counts]( size_t ti ) { ++counts[ti]; } );
+
+        BOOST_CHECK( std::all_of( counts.begin(), counts.end(), []( int c ) { return c == 1; } ) );
+    }
+}
+#endif
+
+
 BOOST_AUTO_TEST_CASE( tile_descendant_depth )
 {
     const auto tile = create_tile( "tile.bin" );
@@ -144,6 +756,188 @@ BOOST_AUTO_TEST_CASE( tile_find_ray_distance )
 }
 
 
+BOOST_AUTO_TEST_CASE( tile_find_ray_distance_many )
+{
+    const auto tile = create_tile( "tile.bin" );
+
+    const size_t num_rays = 1000;
+    const auto       rays = create_test_rays( num_rays );
+
+    std::vector<wasm_f64_t> results( Tile::RAY_RESULT_NUM_ELEMS * num_rays );
+
+    tile->find_ray_distance_many( num_rays, rays.data(), results.data() );
+
+    // 1 本ずつ処理した結果と一致するか？
+    for ( size_t i = 0; i < num_rays; ++i ) {
+        const auto ray = rays.data() + Tile::RAY_NUM_ELEMS * i;
+
+        tile->find_ray_distance( { ray[0], ray[1], ray[2] },
+                                 { ray[3], ray[4], ray[5] },
+                                 ray[6],
+                                 Rect<float, Tile::DIM>::create_cube( { 0, 0, 0 }, 1 ) );
+
+        for ( size_t j = 0; j < Tile::RAY_RESULT_NUM_ELEMS; ++j ) {
+            BOOST_CHECK( results[Tile::RAY_RESULT_NUM_ELEMS * i + j] == last_ray_result[j] );
+        }
+    }
+}
+
+
+/** @brief 近接したレイの一括処理
+ *
+ *  パケットの複数のレイが同じ葉ノードを処理する場合を確認する。
+ */
+BOOST_AUTO_TEST_CASE( tile_find_ray_distance_many_coherent )
+{
+    const auto tile = create_tile( "tile.bin" );
+
+    // 上方から格子状に平行なレイを生成
+    //
+    // レイの直線は lrect と交差しなければならないので、レイが傾いている分だ
+    // け格子を縮める。
+    const size_t num_side = 40;
+    const size_t num_rays = num_side * num_side;
+
+    std::vector<wasm_f64_t> rays;
+
+    for ( size_t y = 0; y < num_side; ++y ) {
+        for ( size_t x = 0; x < num_side; ++x ) {
+            const double px = 0.9 * (x + 0.5) / num_side;
+            const double py = 0.9 * (y + 0.5) / num_side;
+
+            rays.insert( rays.end(), { px, py, 2,
+                                       0.01, 0.02, -1,
+                                       100,
+                                       0, 0, 0, 1 } );
+        }
+    }
+
+    std::vector<wasm_f64_t> results( Tile::RAY_RESULT_NUM_ELEMS * num_rays );
+    std::vector<wasm_i32_t> occluded( num_rays );
+
+    tile->find_ray_distance_many( num_rays, rays.data(), results.data() );
+    tile->test_ray_occluded_many( num_rays, rays.data(), occluded.data() );
+
+    // 1 本ずつ処理した結果と一致するか？
+    for ( size_t i = 0; i < num_rays; ++i ) {
+        const auto ray = rays.data() + Tile::RAY_NUM_ELEMS * i;
+
+        tile->find_ray_distance( { ray[0], ray[1], ray[2] },
+                                 { ray[3], ray[4], ray[5] },
+                                 ray[6],
+                                 Rect<float, Tile::DIM>::create_cube( { 0, 0, 0 }, 1 ) );
+
+        for ( size_t j = 0; j < Tile::RAY_RESULT_NUM_ELEMS; ++j ) {
+            BOOST_CHECK( results[Tile::RAY_RESULT_NUM_ELEMS * i + j] == last_ray_result[j] );
+        }
+
+        BOOST_CHECK( occluded[i] == ((last_ray_result[0] != ray[6]) ? 1 : 0) );
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE( tile_test_ray_occluded )
+{
+    const auto tile = create_tile( "tile.bin" );
+
+    const size_t num_rays = 1000;
+    const auto       rays = create_test_rays( num_rays );
+
+    std::vector<wasm_i32_t> results( num_rays );
+
+    tile->test_ray_occluded_many( num_rays, rays.data(), results.data() );
+
+    // 交点が見つかるときだけ遮蔽されるか？
+    for ( size_t i = 0; i < num_rays; ++i ) {
+        const auto   ray = rays.data() + Tile::RAY_NUM_ELEMS * i;
+        const auto lrect = Rect<float, Tile::DIM>::create_cube( { 0, 0, 0 }, 1 );
+
+        tile->find_ray_distance( { ray[0], ray[1], ray[2] },
+                                 { ray[3], ray[4], ray[5] },
+                                 ray[6],
+                                 lrect );
+
+        const bool occluded = tile->test_ray_occluded( { ray[0], ray[1], ray[2] },
+                                                       { ray[3], ray[4], ray[5] },
+                                                       ray[6],
+                                                       lrect );
+
+        BOOST_CHECK( occluded == (last_ray_result[0] != ray[6]) );
+        BOOST_CHECK( results[i] == (occluded ? 1 : 0) );
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE( tile_find_ray_hits )
+{
+    const auto tile = create_tile( "tile.bin" );
+
+    const size_t num_rays = 1000;
+    const auto       rays = create_test_rays( num_rays );
+
+    const size_t max_hits = 64;
+
+    std::vector<wasm_f64_t> hits( Tile::RAY_HIT_NUM_ELEMS * max_hits );
+    std::vector<wasm_f64_t> few_hits( Tile::RAY_HIT_NUM_ELEMS * 2 );
+
+    for ( size_t i = 0; i < num_rays; ++i ) {
+        const auto ray = rays.data() + Tile::RAY_NUM_ELEMS * i;
+
+        const size_t num_hits = tile->find_ray_hits( ray, max_hits, hits.data() );
+        BOOST_REQUIRE( num_hits <= max_hits );
+
+        tile->find_ray_distance( { ray[0], ray[1], ray[2] },
+                                 { ray[3], ray[4], ray[5] },
+                                 ray[6],
+                                 Rect<float, Tile::DIM>::create_cube( { 0, 0, 0 }, 1 ) );
+
+        // find_ray_distance() の交点は hits に含まれ、先頭の交点はそれより遠く
+        // ないか？ (find_ray_distance() は最も近い交点を返すとは限らない)
+        if ( num_hits == 0 ) {
+            BOOST_CHECK( last_ray_result[0] == ray[6] );
+            continue;
+        }
+
+        BOOST_CHECK( hits[0] <= last_ray_result[0] );
+
+        bool found = false;
+
+        for ( size_t j = 0; j < num_hits; ++j ) {
+            const auto hit = hits.data() + Tile::RAY_HIT_NUM_ELEMS * j;
+
+            if ( hit[0] == last_ray_result[0] &&
+                 hit[2] == last_ray_result[1] &&
+                 hit[3] == last_ray_result[2] ) {
+                found = true;
+                break;
+            }
+        }
+
+        BOOST_CHECK( found );
+
+        // 近い順に並び、同じ三角形は含まれないか？
+        for ( size_t j = 1; j < num_hits; ++j ) {
+            const auto prev = hits.data() + Tile::RAY_HIT_NUM_ELEMS * (j - 1);
+            const auto curr = hits.data() + Tile::RAY_HIT_NUM_ELEMS * j;
+
+            BOOST_CHECK( prev[0] <= curr[0] );
+            BOOST_CHECK( curr[0] < ray[6] );
+
+            for ( size_t k = 0; k < j; ++k ) {
+                BOOST_CHECK( hits[Tile::RAY_HIT_NUM_ELEMS * k + 1] != curr[1] );
+            }
+        }
+
+        // 最大数を制限したときは先頭の部分と一致するか？
+        BOOST_CHECK( tile->find_ray_hits( ray, 2, few_hits.data() ) == num_hits );
+
+        for ( size_t j = 0; j < Tile::RAY_HIT_NUM_ELEMS * std::min( num_hits, size_t{ 2 } ); ++j ) {
+            BOOST_CHECK( few_hits[j] == hits[j] );
+        }
+    }
+}
+
+
 BOOST_AUTO_TEST_CASE( hash_map )
 {
     using b3dtile::HashMap;
@@ -156,6 +950,63 @@ BOOST_AUTO_TEST_CASE( hash_map )
 }
 
 
+BOOST_AUTO_TEST_CASE( hash_map_reserve )
+{
+    using b3dtile::HashMap;
+
+    HashMap<int> hash_map{ 1000 };
+    BOOST_CHECK( hash_map.capacity() >= 1000 );
+
+    const auto capacity = hash_map.capacity();
+
+    // 予約した要素数までは拡大しない
+    for ( size_t i = 0; i < 1000; ++i ) {
+        hash_map.insert( 7 * i, static_cast<int>( i ) );
+    }
+    BOOST_CHECK( hash_map.capacity() == capacity );
+
+    // reserve() で拡大しても要素は保たれる
+    hash_map.reserve( 5000 );
+    BOOST_CHECK( hash_map.capacity() >= 5000 );
+
+    for ( size_t i = 0; i < 1000; ++i ) {
+        const auto result = hash_map.insert( 7 * i, -1 );
+        BOOST_CHECK( !result.second && result.first == static_cast<int>( i ) );
+    }
+
+    // clear() は領域を保つ
+    hash_map.clear();
+    BOOST_CHECK( hash_map.size() == 0 );
+    BOOST_CHECK( hash_map.capacity() >= 5000 );
+}
+
+
+BOOST_AUTO_TEST_CASE( dense_map )
+{
+    using b3dtile::DenseMap;
+
+    DenseMap<int> dense_map;
+    dense_map.reserve( 1000 );
+
+    // clear() の後は以前の要素が見えないことを確認
+    for ( int gen = 0; gen < 3; ++gen ) {
+        for ( size_t i = 0; i < 1000; i += 2 ) {
+            const auto result = dense_map.insert( i, static_cast<int>( i ) + gen );
+            BOOST_CHECK( result.second );
+        }
+
+        for ( size_t i = 0; i < 1000; i += 2 ) {
+            const auto result = dense_map.insert( i, -1 );
+            BOOST_CHECK( !result.second && result.first == static_cast<int>( i ) + gen );
+        }
+
+        BOOST_CHECK( dense_map.size() == 500 );
+
+        dense_map.clear();
+    }
+}
+
+
 BOOST_AUTO_TEST_CASE( hash_set )
 {
     using b3dtile::HashSet;
@@ -1,18 +1,26 @@
 ﻿#include "../sdfield/Converter.hpp"
+#include "../sdfield/BatchConverter.hpp"
 #include "../sdfield/CovImage.hpp"
 #include "../sdfield/SdfImage.hpp"
 #include "../sdfield/utility.hpp"  // for get_aligned, make_msb_only
 #include "../sdfield/config.hpp"   // for DIST_LOWER, DIST_FACTOR
 #include <boost/test/unit_test.hpp>
 #include <memory>  // for unique_ptr, make_unique
-#include <cmath>   // for floor(), ceil(), round(), exp2(), log2()
+#include <vector>
+#include <utility> // for pair
+#include <algorithm> // for max()
+#include <cmath>   // for floor(), ceil(), round(), exp2(), log2(), hypot(), fabs()
 #include <cstddef> // for size_t, ptrdiff_t
+#include <cstdint> // for uint64_t
+#include <iterator> // for size()
 
 using sdfield::Converter;
+using sdfield::BatchConverter;
 using sdfield::CovImage;
 using sdfield::SdfImage;
 using sdfield::get_aligned;
 using sdfield::img_size_elem_t;
+using sdfield::DistanceEngine;
 
 
 struct Env {};
@@ -394,4 +402,348 @@ BOOST_AUTO_TEST_CASE( conv_slash_image )
 }
 
 
+/** @brief 縞模様の被覆率画像の画素値
+ */
+CovImage::pixel_t
+get_stripe_pixel( CovImage::coord_t x,
+                  CovImage::coord_t y )
+{
+    return static_cast<CovImage::pixel_t>( (x + y) % 7 * CovImage::max_value / 6 );
+}
+
+
+/** @brief SDF 画像の画素列を取得
+ *
+ *  data から始まる SDF 画像の画素を、各行の末尾の詰め物を除いて返す。
+ */
+std::vector<SdfImage::pixel_t>
+get_sdf_pixels( const SdfImage::pixel_t*          data,
+                const Converter::img_size_t& cov_size,
+                Converter::sdf_ext_t          sdf_ext )
+{
+    const auto sdf_size = SdfImage::calc_size( cov_size, sdf_ext );
+    const auto    pitch = get_aligned<4>( static_cast<std::size_t>( sdf_size[0] ) );
+
+    std::vector<SdfImage::pixel_t> pixels;
+
+    for ( std::size_t y = 0; y < sdf_size[1]; ++y ) {
+        pixels.insert( pixels.end(), data + pitch * y, data + pitch * y + sdf_size[0] );
+    }
+
+    return pixels;
+}
+
+
+// テスト conv_reset, batch_conv から呼び出される
+//
+// conv に縞模様の画像を書き込み、変換した SDF 画像の画素列を返す。
+std::vector<SdfImage::pixel_t>
+build_stripe_sdf( Converter&                    conv,
+                  const Converter::img_size_t& isize,
+                  Converter::sdf_ext_t       sdf_ext )
+{
+    using coord_t = CovImage::coord_t;
+
+    CovImageRef cov_image_ref { conv, isize };
+
+    for ( coord_t y = 0; y < static_cast<coord_t>( isize[1] ); ++y ) {
+        for ( coord_t x = 0; x < static_cast<coord_t>( isize[0] ); ++x ) {
+            cov_image_ref.set_pixel( x, y, get_stripe_pixel( x, y ) );
+        }
+    }
+
+    return get_sdf_pixels( conv.build_sdf(), isize, sdf_ext );
+}
+
+
+/** @brief 再初期化した Converter
+ *
+ *  reset() した Converter の変換結果が、新しく構築した Converter の結
+ *  果と一致するかを確認する。
+ */
+BOOST_AUTO_TEST_CASE( conv_reset )
+{
+    using sdfield::cast;
+
+    // 拡大と縮小を交互に行う
+    constexpr std::pair<Converter::img_size_t, Converter::sdf_ext_t> params[] {
+        { { cast,  4,  4 }, 1 },
+        { { cast, 30, 10 }, 3 },
+        { { cast,  7, 13 }, 0 },
+        { { cast, 64, 20 }, 5 },
+        { { cast,  1,  1 }, 2 },
+        { { cast, 33, 17 }, 4 },
+    };
+
+    Converter pooled { { cast, 1, 1 }, 0 };
+
+    for ( const auto& [isize, sdf_ext] : params ) {
+        Converter fresh { isize, sdf_ext };
+        pooled.reset( isize, sdf_ext );
+
+        BOOST_CHECK( build_stripe_sdf( pooled, isize, sdf_ext ) == build_stripe_sdf( fresh, isize, sdf_ext ) );
+    }
+}
+
+
+/** @brief 複数の画像の一括変換
+ *
+ *  BatchConverter の各変換結果が、Converter で個別に変換した結果と一致
+ *  するかを確認する。同じインスタンスを画像数を変えて再利用する。
+ */
+BOOST_AUTO_TEST_CASE( batch_conv )
+{
+    using sdfield::cast;
+    using coord_t = CovImage::coord_t;
+
+    constexpr std::pair<Converter::img_size_t, Converter::sdf_ext_t> params[] {
+        { { cast, 30, 10 }, 3 },
+        { { cast,  1,  1 }, 0 },
+        { { cast,  7, 13 }, 2 },
+        { { cast, 64, 20 }, 5 },
+        { { cast,  5,  3 }, 1 },
+    };
+
+    constexpr auto TABLE_NUM_ELEMS = BatchConverter::TABLE_NUM_ELEMS;
+
+    BatchConverter batch;
+
+    for ( std::size_t num_images : { 5, 2, 0, 4 } ) {
+        // 入力領域での各画像の位置 (詰めて配置)
+        std::vector<std::size_t> cov_offsets;
+        std::size_t              cov_bytes = 0;
+
+        for ( std::size_t i = 0; i < num_images; ++i ) {
+            const auto& isize = params[i].first;
+            cov_offsets.push_back( cov_bytes );
+            cov_bytes += std::size_t{ isize[0] } * isize[1];
+        }
+
+        batch.reserve( num_images, cov_bytes );
+
+        // 画像表と入力領域を設定
+        const auto table = batch.get_table();
+        const auto   cov = batch.get_write_position();
+
+        for ( std::size_t i = 0; i < num_images; ++i ) {
+            const auto& [isize, sdf_ext] = params[i];
+
+            const auto entry = table + TABLE_NUM_ELEMS * i;
+            entry[0] = static_cast<wasm_i32_t>( cov_offsets[i] );
+            entry[1] = isize[0];
+            entry[2] = isize[1];
+            entry[3] = sdf_ext;
+
+            for ( coord_t y = 0; y < static_cast<coord_t>( isize[1] ); ++y ) {
+                for ( coord_t x = 0; x < static_cast<coord_t>( isize[0] ); ++x ) {
+                    cov[cov_offsets[i] + x + y * std::size_t{ isize[0] }] = get_stripe_pixel( x, y );
+                }
+            }
+        }
+
+        const auto sdf = batch.build_sdf();
+
+        for ( std::size_t i = 0; i < num_images; ++i ) {
+            const auto& [isize, sdf_ext] = params[i];
+
+            const auto entry = table + TABLE_NUM_ELEMS * i;
+            BOOST_REQUIRE( entry[4] % 4 == 0 );
+
+            Converter conv { isize, sdf_ext };
+
+            BOOST_CHECK( get_sdf_pixels( sdf + entry[4], isize, sdf_ext ) == build_stripe_sdf( conv, isize, sdf_ext ) );
+        }
+    }
+}
+
+
+
+/** @brief 円の被覆率画像の画素値
+ *
+ *  画素を 16x16 の標本点に分割して、中心 (cx, cy) 半径 r の円の被覆率
+ *  を求める。
+ */
+CovImage::pixel_t
+get_disk_pixel( CovImage::coord_t x,
+                CovImage::coord_t y,
+                double           cx,
+                double           cy,
+                double            r )
+{
+    constexpr int num_div = 16;
+
+    int count = 0;
+
+    for ( int j = 0; j < num_div; ++j ) {
+        for ( int i = 0; i < num_div; ++i ) {
+            const double px = x + (i + 0.5) / num_div;
+            const double py = y + (j + 0.5) / num_div;
+
+            if ( std::hypot( px - cx, py - cy ) < r ) {
+                ++count;
+            }
+        }
+    }
+
+    return static_cast<CovImage::pixel_t>( std::round( count * CovImage::max_value / double{ num_div * num_div } ) );
+}
+
+
+/** @brief 距離変換の手法
+ *
+ *  円の画像を各手法で変換し、SDF 画像の距離が円の符号付き距離に近いか
+ *  を確認する。
+ */
+BOOST_AUTO_TEST_CASE( conv_distance_engine )
+{
+    using sdfield::cast;
+    using sdfield::DIST_LOWER;
+    using sdfield::DIST_FACTOR;
+    using coord_t = CovImage::coord_t;
+
+    // 画素値の量子化と被覆率からの境界の推定による誤差を含む
+    constexpr double tolerance = 0.35;
+
+    for ( const double r : { 3.0, 7.5, 20.0, 60.0 } ) {
+        const auto isize_elem = static_cast<img_size_elem_t>( 2 * r + 12 );
+        const Converter::img_size_t isize { isize_elem, isize_elem };
+        constexpr Converter::sdf_ext_t sdf_ext = 4;
+
+        const double cx = isize_elem / 2.0 + 0.3;
+        const double cy = isize_elem / 2.0 - 0.2;
+
+        for ( const auto engine : { DistanceEngine::SSEDT8, DistanceEngine::SEPARABLE } ) {
+            Converter conv { isize, sdf_ext };
+            conv.set_engine( engine );
+
+            {
+                CovImageRef cov_image_ref { conv, isize };
+
+                for ( coord_t y = 0; y < static_cast<coord_t>( isize[1] ); ++y ) {
+                    for ( coord_t x = 0; x < static_cast<coord_t>( isize[0] ); ++x ) {
+                        cov_image_ref.set_pixel( x, y, get_disk_pixel( x, y, cx, cy, r ) );
+                    }
+                }
+            }
+
+            const SdfImageRef sdf_image_ref { conv, isize, sdf_ext };
+            const auto             sdf_size = SdfImage::calc_size( isize, sdf_ext );
+
+            double max_error = 0;
+
+            for ( coord_t sy = 0; sy < static_cast<coord_t>( sdf_size[1] ); ++sy ) {
+                for ( coord_t sx = 0; sx < static_cast<coord_t>( sdf_size[0] ); ++sx ) {
+                    // 画素中心での円の符号付き距離 (内側が負)
+                    const double px = sx - sdf_ext + 0.5;
+                    const double py = sy - sdf_ext + 0.5;
+                    const double  d = std::hypot( px - cx, py - cy ) - r;
+
+                    // クランプされる範囲は除く
+                    if ( d < DIST_LOWER + 0.5 || d > DIST_LOWER + 1 / DIST_FACTOR - 0.5 ) {
+                        continue;
+                    }
+
+                    const double pixel = sdf_image_ref.get_pixel( sx, sy );
+                    const double sdf_d = pixel / SdfImage::max_value / DIST_FACTOR + DIST_LOWER;
+
+                    max_error = std::max( max_error, std::fabs( sdf_d - d ) );
+                }
+            }
+
+            BOOST_CHECK( max_error < tolerance );
+        }
+    }
+}
+
+
+/** @brief 境界検査用の被覆率画像の画素値
+ *
+ *  pattern は次の画像を表す。
+ *
+ *  - 0: 左上の小さな部分以外が空の画像
+ *  - 1: 右下の小さな穴以外が完全に覆われた画像
+ *  - 2: x < 16 が覆われ、16 画素のブロック境界に縁がある画像
+ *  - 3: 16 <= x < 32 が覆われ、両側のブロック境界に縁がある画像
+ */
+CovImage::pixel_t
+get_block_edge_pixel( int                   pattern,
+                      const Converter::img_size_t& isize,
+                      CovImage::coord_t           x,
+                      CovImage::coord_t           y )
+{
+    using coord_t = CovImage::coord_t;
+
+    constexpr auto max_value = CovImage::max_value;
+
+    const auto w = static_cast<coord_t>( isize[0] );
+    const auto h = static_cast<coord_t>( isize[1] );
+
+    switch ( pattern ) {
+    case 0:
+        return (x >= 2 && x < 5 && y >= 2 && y < 5) ? get_stripe_pixel( x, y ) : 0;
+    case 1:
+        return (x >= w - 5 && x < w - 2 && y >= h - 5 && y < h - 2) ? get_stripe_pixel( x, y ) : max_value;
+    case 2:
+        return (x < 16) ? max_value : 0;
+    default:
+        return (x >= 16 && x < 32) ? max_value : 0;
+    }
+}
+
+
+/** @brief 被覆率の均一な領域とブロック境界の変換結果
+ *
+ *  Grid の行処理と縁の画素の検出に依存する画像について、変換した SDF
+ *  画像が最適化前の実装の結果と一致するかを確認する。期待値は各画素列の
+ *  FNV-1a ハッシュである。
+ */
+BOOST_AUTO_TEST_CASE( conv_block_edges )
+{
+    using sdfield::cast;
+    using coord_t = CovImage::coord_t;
+
+    constexpr img_size_elem_t widths[] = { 17, 18, 33 };
+    constexpr img_size_elem_t height   = 35;
+
+    // 最適化前の実装で得たハッシュ値 [pattern][width]
+    constexpr std::uint64_t expected[4][3] = {
+        { 0x26c4eabc22b958ae, 0x84a54b7c62bf1c24, 0x79a1feff574ab120 },
+        { 0x0772edd7af6e80a1, 0xb0fb2e5b91ea6381, 0x5792688113d093b5 },
+        { 0x4f48ae6a1011c357, 0x4cc942a695a110b5, 0xf87bbb84aba2056f },
+        { 0x2442228596c6832d, 0x3a40fb1ea3bc56c9, 0xf5464a7e18a0d8ff },
+    };
+
+    for ( int pattern = 0; pattern < 4; ++pattern ) {
+        for ( std::size_t wi = 0; wi < std::size( widths ); ++wi ) {
+            const Converter::img_size_t isize { cast, widths[wi], height };
+
+            std::uint64_t hash = 0xcbf29ce484222325;
+
+            for ( const Converter::sdf_ext_t sdf_ext : { 0, 3 } ) {
+                for ( const auto engine : { DistanceEngine::SSEDT8, DistanceEngine::SEPARABLE } ) {
+                    Converter conv { isize, sdf_ext };
+                    conv.set_engine( engine );
+
+                    {
+                        CovImageRef cov_image_ref { conv, isize };
+
+                        for ( coord_t y = 0; y < static_cast<coord_t>( isize[1] ); ++y ) {
+                            for ( coord_t x = 0; x < static_cast<coord_t>( isize[0] ); ++x ) {
+                                cov_image_ref.set_pixel( x, y, get_block_edge_pixel( pattern, isize, x, y ) );
+                            }
+                        }
+                    }
+
+                    for ( const auto pixel : get_sdf_pixels( conv.build_sdf(), isize, sdf_ext ) ) {
+                        hash = (hash ^ pixel) * 0x100000001b3;
+                    }
+                }
+            }
+
+            BOOST_CHECK( hash == expected[pattern][wi] );
+        }
+    }
+}
+
+
 BOOST_AUTO_TEST_SUITE_END()